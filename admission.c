@@ -0,0 +1,71 @@
+#define _DEFAULT_SOURCE
+#include "admission.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int maxConnections = 0;
+static int maxInFlight = 0;
+
+// ohne Mutex, wird bei jedem Command gebraucht
+static int connections = 0;
+static int inFlight = 0;
+static unsigned long rejectedConnections = 0;
+static unsigned long rejectedCommands = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int admissionInit(const ServerConfig *cfg)
+{
+   maxConnections = cfg->maxConnections > 0 ? cfg->maxConnections : 0;
+   maxInFlight = cfg->maxInFlight > 0 ? cfg->maxInFlight : 0;
+   return 0;
+}
+
+// zählt eine neue Verbindung, -1 (und nicht gezählt) wenn das Limit erreicht ist
+int admissionConnect(void)
+{
+   int current = __atomic_add_fetch(&connections, 1, __ATOMIC_RELAXED);
+
+   if (maxConnections > 0 && current > maxConnections)
+   {
+      __atomic_sub_fetch(&connections, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&rejectedConnections, 1, __ATOMIC_RELAXED);
+      return -1;
+   }
+   return 0;
+}
+
+void admissionDisconnect(void)
+{
+   __atomic_sub_fetch(&connections, 1, __ATOMIC_RELAXED);
+}
+
+// wie admissionConnect() für einen Command, admissionEnd() wenn er fertig ist
+int admissionBegin(void)
+{
+   int current = __atomic_add_fetch(&inFlight, 1, __ATOMIC_RELAXED);
+
+   if (maxInFlight > 0 && current > maxInFlight)
+   {
+      __atomic_sub_fetch(&inFlight, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&rejectedCommands, 1, __ATOMIC_RELAXED);
+      return -1;
+   }
+   return 0;
+}
+
+void admissionEnd(void)
+{
+   __atomic_sub_fetch(&inFlight, 1, __ATOMIC_RELAXED);
+}
+
+// aktuelle Last für STATS
+void admissionLoad(AdmissionLoad *load)
+{
+   load->connections = __atomic_load_n(&connections, __ATOMIC_RELAXED);
+   load->maxConnections = maxConnections;
+   load->inFlight = __atomic_load_n(&inFlight, __ATOMIC_RELAXED);
+   load->maxInFlight = maxInFlight;
+   load->rejectedConnections = __atomic_load_n(&rejectedConnections, __ATOMIC_RELAXED);
+   load->rejectedCommands = __atomic_load_n(&rejectedCommands, __ATOMIC_RELAXED);
+}
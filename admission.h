@@ -0,0 +1,36 @@
+#ifndef TWMAILER_ADMISSION_H
+#define TWMAILER_ADMISSION_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Admission Control: bei Überlast früh ablehnen statt alles zu queuen
+// max_connections: weitere Verbindungen bekommen statt der Welcome Message
+// sofort "BUSY" und werden geschlossen (ohne Session-Thread).
+// max_inflight: Commands aller Verbindungen, die gerade laufen oder auf einen
+// Worker warten. Darüber wird der Request noch gelesen (sonst wäre die
+// Verbindung nicht mehr synchron) und statt OK/ERR mit "BUSY" beantwortet,
+// der Client kann es später nochmal versuchen. QUIT und IDLE (wartet nur)
+// zählen nicht. 0 = kein Limit.
+
+typedef struct AdmissionLoad
+{
+   int connections;
+   int maxConnections;
+   int inFlight;
+   int maxInFlight;
+   unsigned long rejectedConnections;
+   unsigned long rejectedCommands;
+} AdmissionLoad;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int admissionInit(const ServerConfig *cfg);
+int admissionConnect(void);
+void admissionDisconnect(void);
+int admissionBegin(void);
+void admissionEnd(void);
+void admissionLoad(AdmissionLoad *load);
+
+#endif
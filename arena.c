@@ -0,0 +1,170 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define BLOCK_SIZE (64 * 1024) // Standardblock inkl. Header
+#define POOL_MAX 256           // freie Standardblöcke im Pool (16 MB)
+
+// Daten beginnen nach dem (auf 16 Bytes aufgerundeten) Header
+#define ALIGN(size) (((size) + 15) & ~(size_t)15)
+#define HEADER_SIZE ALIGN(sizeof(ArenaBlock))
+#define BLOCK_DATA(block) ((char *)(block) + HEADER_SIZE)
+
+struct ArenaBlock
+{
+   ArenaBlock *next;
+   size_t size; // nutzbare Bytes, > BLOCK_SIZE - HEADER_SIZE -> eigener malloc
+   size_t used;
+};
+
+static ArenaBlock *pool = NULL;
+static int poolCount = 0;
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static ArenaBlock *newBlock(size_t size)
+{
+   ArenaBlock *block = NULL;
+
+   if (size <= BLOCK_SIZE - HEADER_SIZE)
+   {
+      pthread_mutex_lock(&poolMutex);
+      if (pool != NULL)
+      {
+         block = pool;
+         pool = block->next;
+         poolCount--;
+      }
+      pthread_mutex_unlock(&poolMutex);
+
+      if (block == NULL && (block = malloc(BLOCK_SIZE)) == NULL)
+      {
+         return NULL;
+      }
+      block->size = BLOCK_SIZE - HEADER_SIZE;
+   }
+   else
+   {
+      // größer als ein Standardblock (z.B. große Nachricht bei SEND)
+      if ((block = malloc(HEADER_SIZE + size)) == NULL)
+      {
+         return NULL;
+      }
+      block->size = size;
+   }
+
+   block->used = 0;
+   block->next = NULL;
+   return block;
+}
+
+static void freeBlock(ArenaBlock *block)
+{
+   if (block->size == BLOCK_SIZE - HEADER_SIZE)
+   {
+      pthread_mutex_lock(&poolMutex);
+      if (poolCount < POOL_MAX)
+      {
+         block->next = pool;
+         pool = block;
+         poolCount++;
+         block = NULL;
+      }
+      pthread_mutex_unlock(&poolMutex);
+   }
+   free(block);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// NULL wenn kein Speicher mehr da ist
+void *arenaAlloc(Arena *arena, size_t size)
+{
+   ArenaBlock *block = arena->blocks;
+
+   size = ALIGN(size == 0 ? 1 : size);
+   if (block == NULL || block->used + size > block->size)
+   {
+      // Rest des alten Blocks bleibt bis zum Reset ungenutzt
+      block = newBlock(size);
+      if (block == NULL)
+      {
+         return NULL;
+      }
+      block->next = arena->blocks;
+      arena->blocks = block;
+   }
+
+   void *pointer = BLOCK_DATA(block) + block->used;
+   block->used += size;
+   arena->last = pointer;
+   return pointer;
+}
+
+// wie realloc(), wächst an Ort und Stelle wenn pointer die letzte
+// Allokation ist und der Block noch Platz hat (pointer == NULL -> alloc)
+void *arenaGrow(Arena *arena, void *pointer, size_t oldSize, size_t newSize)
+{
+   ArenaBlock *block = arena->blocks;
+
+   if (pointer == NULL)
+   {
+      return arenaAlloc(arena, newSize);
+   }
+
+   if (pointer == arena->last && block != NULL &&
+       block->used - ALIGN(oldSize) + ALIGN(newSize) <= block->size)
+   {
+      block->used = block->used - ALIGN(oldSize) + ALIGN(newSize);
+      return pointer;
+   }
+
+   void *grown = arenaAlloc(arena, newSize);
+   if (grown != NULL)
+   {
+      memcpy(grown, pointer, oldSize < newSize ? oldSize : newSize);
+   }
+   return grown;
+}
+
+// nach jedem Command: alles freigeben, ein Standardblock bleibt
+void arenaReset(Arena *arena)
+{
+   ArenaBlock *keep = NULL;
+   ArenaBlock *block = arena->blocks;
+
+   while (block != NULL)
+   {
+      ArenaBlock *next = block->next;
+      if (keep == NULL && block->size == BLOCK_SIZE - HEADER_SIZE)
+      {
+         keep = block;
+         keep->used = 0;
+         keep->next = NULL;
+      }
+      else
+      {
+         freeBlock(block);
+      }
+      block = next;
+   }
+
+   arena->blocks = keep;
+   arena->last = NULL;
+}
+
+// beim Schließen der Verbindung: alle Blöcke zurück in den Pool
+void arenaRelease(Arena *arena)
+{
+   arenaReset(arena);
+   if (arena->blocks != NULL)
+   {
+      freeBlock(arena->blocks);
+      arena->blocks = NULL;
+   }
+}
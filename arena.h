@@ -0,0 +1,34 @@
+#ifndef TWMAILER_ARENA_H
+#define TWMAILER_ARENA_H
+
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Bump-Allocator pro Verbindung für alle Buffer eines Commands
+// Allokationen werden nie einzeln freigegeben, arenaReset() nach jedem
+// Command gibt alles auf einmal frei (ein Block bleibt für den nächsten
+// Command). Blöcke kommen aus einem gemeinsamen Pool, damit neue
+// Verbindungen nicht jedes Mal malloc() brauchen.
+//
+//    char *buffer = arenaAlloc(&commandArena, size);
+//    buffer = arenaGrow(&commandArena, buffer, size, size * 2);
+//    ...
+//    arenaReset(&commandArena);
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena
+{
+   ArenaBlock *blocks; // vorne der Block, aus dem gerade allokiert wird
+   void *last;         // letzte Allokation, kann an Ort und Stelle wachsen
+} Arena;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void *arenaAlloc(Arena *arena, size_t size);
+void *arenaGrow(Arena *arena, void *pointer, size_t oldSize, size_t newSize);
+void arenaReset(Arena *arena);
+void arenaRelease(Arena *arena);
+
+#endif
@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <crypt.h>
+#include <ldap.h>
+#include "auth.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const ServerConfig *authConfig = NULL;
+static const AuthBackend *activeBackend = NULL;
+
+///////////////////////////////////////////////////////////////////////////////
+// LDAP BACKEND
+// URI und Bind-DN Template kommen aus der Config (ldap_uri, ldap_bind_dn)
+
+static int ldapInit(const ServerConfig *cfg)
+{
+   // Template muss genau ein %s für den Username enthalten
+   const char *placeholder = strstr(cfg->ldapBindDn, "%s");
+   if (placeholder == NULL || strchr(placeholder + 2, '%') != NULL ||
+       strchr(cfg->ldapBindDn, '%') != placeholder)
+   {
+      LOG_ERROR("ldap_bind_dn must contain exactly one %%s: %s", cfg->ldapBindDn);
+      return -1;
+   }
+   return 0;
+}
+
+static int ldapAuthenticate(const char *username, const char *password)
+{
+   const int ldapVersion = LDAP_VERSION3;
+   char ldapBindUser[512];
+
+   // LDAP Bind User DN erstellen
+   snprintf(ldapBindUser, sizeof(ldapBindUser), authConfig->ldapBindDn, username);
+   LOG_DEBUG("LDAP bind DN: %s", ldapBindUser);
+
+   // LDAP Verbindung aufbauen
+   LDAP *ldapHandle;
+   int rc = ldap_initialize(&ldapHandle, authConfig->ldapUri);
+   if (rc != LDAP_SUCCESS)
+   {
+      LOG_ERROR("ldap_initialize failed: %s", ldap_err2string(rc));
+      return -1;
+   }
+   LOG_DEBUG("Connected to LDAP server %s", authConfig->ldapUri);
+
+   // LDAP Version setzen
+   rc = ldap_set_option(ldapHandle, LDAP_OPT_PROTOCOL_VERSION, &ldapVersion);
+   if (rc != LDAP_OPT_SUCCESS)
+   {
+      LOG_ERROR("ldap_set_option(PROTOCOL_VERSION): %s", ldap_err2string(rc));
+      ldap_unbind_ext_s(ldapHandle, NULL, NULL);
+      return -1;
+   }
+
+   // TLS starten
+   if (authConfig->ldapStartTls)
+   {
+      rc = ldap_start_tls_s(ldapHandle, NULL, NULL);
+      if (rc != LDAP_SUCCESS)
+      {
+         LOG_ERROR("ldap_start_tls_s(): %s", ldap_err2string(rc));
+         ldap_unbind_ext_s(ldapHandle, NULL, NULL);
+         return -1;
+      }
+   }
+
+   // LDAP Bind (Authentifizierung)
+   BerValue bindCredentials;
+   bindCredentials.bv_val = (char *)password;
+   bindCredentials.bv_len = strlen(password);
+   BerValue *servercredp;
+
+   rc = ldap_sasl_bind_s(
+       ldapHandle,
+       ldapBindUser,
+       LDAP_SASL_SIMPLE,
+       &bindCredentials,
+       NULL,
+       NULL,
+       &servercredp);
+
+   if (rc != LDAP_SUCCESS)
+   {
+      LOG_ERROR("LDAP bind error: %s", ldap_err2string(rc));
+      ldap_unbind_ext_s(ldapHandle, NULL, NULL);
+      return -1;
+   }
+
+   ldap_unbind_ext_s(ldapHandle, NULL, NULL);
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FILE BACKEND
+// Passwort-Datei (auth_file) mit einer "username:hash" Zeile pro User,
+// hash im crypt(3) Format, z.B. erzeugt mit: openssl passwd -6
+
+typedef struct PasswordEntry
+{
+   char *username;
+   char *hash;
+} PasswordEntry;
+
+static PasswordEntry *passwordEntries = NULL;
+static size_t passwordCount = 0;
+
+static int comparePasswordEntries(const void *a, const void *b)
+{
+   return strcmp(((const PasswordEntry *)a)->username,
+                 ((const PasswordEntry *)b)->username);
+}
+
+static void fileCleanup(void)
+{
+   for (size_t i = 0; i < passwordCount; i++)
+   {
+      free(passwordEntries[i].username);
+      free(passwordEntries[i].hash);
+   }
+   free(passwordEntries);
+   passwordEntries = NULL;
+   passwordCount = 0;
+}
+
+static int fileInit(const ServerConfig *cfg)
+{
+   char line[512];
+   size_t capacity = 0;
+
+   if (cfg->authFile[0] == '\0')
+   {
+      LOG_ERROR("auth_backend file requires auth_file");
+      return -1;
+   }
+
+   FILE *file = fopen(cfg->authFile, "r");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen auth_file failed");
+      return -1;
+   }
+
+   // ganze Datei einmal laden, danach nur noch binäre Suche
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0' || line[0] == '#')
+      {
+         continue;
+      }
+
+      char *colon = strchr(line, ':');
+      if (colon == NULL || colon == line || colon[1] == '\0')
+      {
+         LOG_ERROR("Invalid line in %s (expected username:hash)", cfg->authFile);
+         continue;
+      }
+      *colon = '\0';
+
+      if (passwordCount == capacity)
+      {
+         capacity = capacity == 0 ? 16 : capacity * 2;
+         PasswordEntry *grown = realloc(passwordEntries, capacity * sizeof(PasswordEntry));
+         if (grown == NULL)
+         {
+            LOG_ERRNO("realloc failed");
+            fclose(file);
+            fileCleanup();
+            return -1;
+         }
+         passwordEntries = grown;
+      }
+
+      passwordEntries[passwordCount].username = strdup(line);
+      passwordEntries[passwordCount].hash = strdup(colon + 1);
+      passwordCount++;
+   }
+   fclose(file);
+
+   qsort(passwordEntries, passwordCount, sizeof(PasswordEntry), comparePasswordEntries);
+   LOG_INFO("Loaded %zu users from %s", passwordCount, cfg->authFile);
+   return 0;
+}
+
+static int fileAuthenticate(const char *username, const char *password)
+{
+   PasswordEntry key;
+   key.username = (char *)username;
+
+   PasswordEntry *entry = bsearch(&key, passwordEntries, passwordCount,
+                                  sizeof(PasswordEntry), comparePasswordEntries);
+   if (entry == NULL)
+   {
+      LOG_WARN("Unknown user: %s", username);
+      return -1;
+   }
+
+   // crypt_r ist im Gegensatz zu crypt() reentrant, crypt_data ist groß -> heap
+   struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+   if (data == NULL)
+   {
+      LOG_ERRNO("calloc failed");
+      return -1;
+   }
+
+   const char *hashed = crypt_r(password, entry->hash, data);
+   int result = (hashed != NULL && strcmp(hashed, entry->hash) == 0) ? 0 : -1;
+   free(data);
+
+   if (result == -1)
+   {
+      LOG_WARN("Wrong password for user: %s", username);
+   }
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MOCK BACKEND
+// akzeptiert jeden Login, optional mit künstlicher Latenz (auth_mock_latency_ms)
+// nur für Lasttests gedacht!
+
+static int mockInit(const ServerConfig *cfg)
+{
+   LOG_WARN("mock auth backend accepts every login (latency %d ms)",
+            cfg->authMockLatencyMs);
+   return 0;
+}
+
+static int mockAuthenticate(const char *username, const char *password)
+{
+   (void)username;
+   (void)password;
+
+   if (authConfig->authMockLatencyMs > 0)
+   {
+      struct timespec delay;
+      delay.tv_sec = authConfig->authMockLatencyMs / 1000;
+      delay.tv_nsec = (long)(authConfig->authMockLatencyMs % 1000) * 1000000L;
+      while (nanosleep(&delay, &delay) == -1)
+         ; // bei EINTR weiterschlafen
+   }
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const AuthBackend authBackends[] = {
+    {"ldap", ldapInit, ldapAuthenticate, NULL},
+    {"file", fileInit, fileAuthenticate, fileCleanup},
+    {"mock", mockInit, mockAuthenticate, NULL},
+};
+
+// wählt das Backend laut auth_backend aus
+int authInit(const ServerConfig *cfg)
+{
+   authConfig = cfg;
+   activeBackend = NULL;
+
+   for (size_t i = 0; i < sizeof(authBackends) / sizeof(authBackends[0]); i++)
+   {
+      if (strcmp(authBackends[i].name, cfg->authBackend) == 0)
+      {
+         activeBackend = &authBackends[i];
+         break;
+      }
+   }
+
+   if (activeBackend == NULL)
+   {
+      LOG_ERROR("Unknown auth backend: %s", cfg->authBackend);
+      return -1;
+   }
+
+   if (activeBackend->init != NULL && activeBackend->init(cfg) == -1)
+   {
+      activeBackend = NULL;
+      return -1;
+   }
+
+   LOG_INFO("Using auth backend: %s", activeBackend->name);
+   return 0;
+}
+
+int authenticate(const char *username, const char *password)
+{
+   if (activeBackend == NULL)
+   {
+      return -1;
+   }
+   return activeBackend->authenticate(username, password);
+}
+
+void authCleanup(void)
+{
+   if (activeBackend != NULL && activeBackend->cleanup != NULL)
+   {
+      activeBackend->cleanup();
+   }
+   activeBackend = NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef TWMAILER_AUTH_H
+#define TWMAILER_AUTH_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Auth-Backend Interface
+// authenticate() gibt 0 zurück wenn username/password passen, sonst -1
+typedef struct AuthBackend
+{
+   const char *name;
+   int (*init)(const ServerConfig *cfg);
+   int (*authenticate)(const char *username, const char *password);
+   void (*cleanup)(void);
+} AuthBackend;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int authInit(const ServerConfig *cfg);
+int authenticate(const char *username, const char *password);
+void authCleanup(void);
+
+#endif
@@ -0,0 +1,617 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "batch.h"
+#include "protocol.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum
+{
+   BATCH_LOGIN,
+   BATCH_RESUME,
+   BATCH_SEND,
+   BATCH_LIST,
+   BATCH_READ,
+   BATCH_DEL,
+   BATCH_STATS,
+   BATCH_SEARCH
+};
+
+static const char *batchNames[] = {"LOGIN", "RESUME", "SEND", "LIST", "READ", "DEL", "STATS", "SEARCH"};
+
+typedef struct BatchCommand
+{
+   int type;
+   int line; // Zeile im Script, 0 = automatisch (LOGIN/RESUME)
+
+   // getaggter Modus: Antwort aus den Frames, bis "t<index> ." kommt
+   char *reply;
+   size_t replyLength;
+   size_t replyCapacity;
+   int complete;
+} BatchCommand;
+
+// wachsender Buffer für alle Requests
+typedef struct RequestBuffer
+{
+   char *data;
+   size_t length;
+   size_t capacity;
+} RequestBuffer;
+
+// Zeilen einer Antwort, vom Socket oder aus dem Speicher (getaggter Modus)
+typedef int (*ReadLine)(void *source, char *line, size_t maxlen);
+
+typedef struct ReplySource
+{
+   const char *data;
+   size_t length;
+   size_t position;
+} ReplySource;
+
+typedef struct Batch
+{
+   int socket;
+   int tagged; // Commands mit Tag "t<index>", Antworten in beliebiger Reihenfolge
+   RequestBuffer requests;
+   BatchCommand *commands;
+   size_t commandCount;
+   size_t commandCapacity;
+   LineReader reader; // Antworten
+} Batch;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int appendRequest(Batch *batch, const char *data, size_t length)
+{
+   RequestBuffer *requests = &batch->requests;
+
+   if (requests->length + length > requests->capacity)
+   {
+      size_t capacity = requests->capacity == 0 ? 65536 : requests->capacity;
+      while (capacity < requests->length + length)
+      {
+         capacity *= 2;
+      }
+      char *grown = realloc(requests->data, capacity);
+      if (grown == NULL)
+      {
+         return -1;
+      }
+      requests->data = grown;
+      requests->capacity = capacity;
+   }
+
+   memcpy(requests->data + requests->length, data, length);
+   requests->length += length;
+   return 0;
+}
+
+static int addCommand(Batch *batch, int type, int line)
+{
+   if (batch->commandCount == batch->commandCapacity)
+   {
+      size_t capacity = batch->commandCapacity == 0 ? 256 : batch->commandCapacity * 2;
+      BatchCommand *grown = realloc(batch->commands, capacity * sizeof(BatchCommand));
+      if (grown == NULL)
+      {
+         return -1;
+      }
+      batch->commands = grown;
+      batch->commandCapacity = capacity;
+   }
+
+   memset(&batch->commands[batch->commandCount], 0, sizeof(BatchCommand));
+   batch->commands[batch->commandCount].type = type;
+   batch->commands[batch->commandCount].line = line;
+   batch->commandCount++;
+   return 0;
+}
+
+// "t<index> " für den nächsten Command im getaggten Modus, sonst ""
+static const char *commandTag(const Batch *batch, char *tag, size_t size)
+{
+   if (!batch->tagged)
+   {
+      return "";
+   }
+   snprintf(tag, size, "t%zu ", batch->commandCount);
+   return tag;
+}
+
+static int addLogin(Batch *batch, const Credentials *credentials, int line)
+{
+   char request[BUF];
+   char tag[32];
+
+   int length = snprintf(request, sizeof(request), "%sLOGIN\n%s\n%s\n",
+                         commandTag(batch, tag, sizeof(tag)),
+                         credentials->username, credentials->password);
+   return appendRequest(batch, request, length) == -1 ? -1 : addCommand(batch, BATCH_LOGIN, line);
+}
+
+// RESUME mit dem gespeicherten Token, 0 wenn keines vorhanden ist
+static int addResume(Batch *batch)
+{
+   char request[BUF];
+   char token[512];
+   char tag[32];
+
+   if (loadToken(token, sizeof(token)) == -1)
+   {
+      return 0;
+   }
+
+   int length = snprintf(request, sizeof(request), "%sRESUME\n%s\n",
+                         commandTag(batch, tag, sizeof(tag)), token);
+   return appendRequest(batch, request, length) == -1 ? -1 : addCommand(batch, BATCH_RESUME, 0);
+}
+
+// nächste Zeile aus dem Script (ohne \r\n), NULL am Ende
+static const char *nextLine(const char **position, size_t *length)
+{
+   const char *line = *position;
+
+   if (*line == '\0')
+   {
+      return NULL;
+   }
+
+   const char *end = strchr(line, '\n');
+   if (end == NULL)
+   {
+      end = line + strlen(line);
+      *position = end;
+   }
+   else
+   {
+      *position = end + 1;
+   }
+
+   *length = end - line;
+   if (*length > 0 && line[*length - 1] == '\r')
+   {
+      (*length)--;
+   }
+   return line;
+}
+
+// übersetzt das Script in Protokoll-Requests
+static int parseScript(Batch *batch, const char *script, const Credentials *credentials)
+{
+   const char *position = script;
+   const char *line;
+   size_t length;
+   int lineNumber = 0;
+   char text[BUF];
+   char request[BUF];
+   char tag[32];
+   int requestLength;
+
+   while ((line = nextLine(&position, &length)) != NULL)
+   {
+      lineNumber++;
+      if (length == 0 || line[0] == '#')
+      {
+         continue;
+      }
+      if (length >= sizeof(text))
+      {
+         fprintf(stderr, "line %d: line too long\n", lineNumber);
+         return -1;
+      }
+      memcpy(text, line, length);
+      text[length] = '\0';
+
+      char *saveptr;
+      char *command = strtok_r(text, " ", &saveptr);
+      char *argument = strtok_r(NULL, " ", &saveptr);
+      char *rest = strtok_r(NULL, "", &saveptr);
+
+      if (command == NULL)
+      {
+         continue; // nur Leerzeichen
+      }
+      if (strcmp(command, "LOGIN") == 0)
+      {
+         if (credentials->username[0] == '\0')
+         {
+            fprintf(stderr, "line %d: LOGIN needs -u/TWMAILER_USER and a password\n", lineNumber);
+            return -1;
+         }
+         if (addLogin(batch, credentials, lineNumber) == -1)
+         {
+            return -1;
+         }
+      }
+      else if (strcmp(command, "SEND") == 0)
+      {
+         const ProtocolCommand *send = protocolLookup("SEND", 4);
+         if (argument == NULL || rest == NULL || !isValidUsername(argument) ||
+             protocolCheckArg(send, 0, strlen(argument)) == -1 ||
+             protocolCheckArg(send, 1, strlen(rest)) == -1)
+         {
+            fprintf(stderr, "line %d: usage: SEND <receiver> <subject>\n", lineNumber);
+            return -1;
+         }
+         requestLength = snprintf(request, sizeof(request), "%sSEND\n%s\n%s\n",
+                                  commandTag(batch, tag, sizeof(tag)), argument, rest);
+         if (appendRequest(batch, request, requestLength) == -1 ||
+             addCommand(batch, BATCH_SEND, lineNumber) == -1)
+         {
+            return -1;
+         }
+
+         // Nachricht bis zur Zeile mit "." unverändert übernehmen
+         int startLine = lineNumber;
+         while (1)
+         {
+            line = nextLine(&position, &length);
+            lineNumber++;
+            if (line == NULL)
+            {
+               fprintf(stderr, "line %d: message not terminated with '.'\n", startLine);
+               return -1;
+            }
+            if (appendRequest(batch, line, length) == -1 || appendRequest(batch, "\n", 1) == -1)
+            {
+               return -1;
+            }
+            if (length == 1 && line[0] == '.')
+            {
+               break;
+            }
+         }
+      }
+      else if (strcmp(command, "LIST") == 0 || strcmp(command, "STATS") == 0)
+      {
+         int type = command[0] == 'L' ? BATCH_LIST : BATCH_STATS;
+         requestLength = snprintf(request, sizeof(request), "%s%s\n",
+                                  commandTag(batch, tag, sizeof(tag)), command);
+         if (appendRequest(batch, request, requestLength) == -1 ||
+             addCommand(batch, type, lineNumber) == -1)
+         {
+            return -1;
+         }
+      }
+      else if (strcmp(command, "READ") == 0 || strcmp(command, "DEL") == 0)
+      {
+         int type = command[0] == 'R' ? BATCH_READ : BATCH_DEL;
+         // Nummer oder Batch ("3,7,9", "1-500"), prüft genauer der Server
+         if (argument == NULL || atoi(argument) <= 0 ||
+             strspn(argument, "0123456789,-") != strlen(argument) || strlen(argument) > 200)
+         {
+            fprintf(stderr, "line %d: usage: %s <number>[-<number>][,...]\n", lineNumber, command);
+            return -1;
+         }
+         requestLength = snprintf(request, sizeof(request), "%s%s\n%s\n",
+                                  commandTag(batch, tag, sizeof(tag)), command, argument);
+         if (appendRequest(batch, request, requestLength) == -1 ||
+             addCommand(batch, type, lineNumber) == -1)
+         {
+            return -1;
+         }
+      }
+      else if (strcmp(command, "SEARCH") == 0)
+      {
+         if (argument == NULL)
+         {
+            fprintf(stderr, "line %d: usage: SEARCH <words>\n", lineNumber);
+            return -1;
+         }
+         requestLength = snprintf(request, sizeof(request), "%sSEARCH\n%s%s%s\n",
+                                  commandTag(batch, tag, sizeof(tag)), argument,
+                                  rest != NULL ? " " : "", rest != NULL ? rest : "");
+         if (appendRequest(batch, request, requestLength) == -1 ||
+             addCommand(batch, BATCH_SEARCH, lineNumber) == -1)
+         {
+            return -1;
+         }
+      }
+      else if (strcmp(command, "QUIT") == 0)
+      {
+         break; // Rest des Scripts ignorieren
+      }
+      else
+      {
+         fprintf(stderr, "line %d: unknown command '%s'\n", lineNumber, command);
+         return -1;
+      }
+   }
+
+   return appendRequest(batch, "QUIT\n", 5);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// schickt alle Requests, während der Haupt-Thread die Antworten liest
+// (sonst blockieren beide Seiten sobald die Socket-Buffer voll sind)
+static void *batchSender(void *data)
+{
+   Batch *batch = data;
+
+   // Fehler merkt der Haupt-Thread an der geschlossenen Verbindung
+   if (sendAll(batch->socket, batch->requests.data, batch->requests.length) == -1)
+   {
+      perror("send batch failed");
+   }
+   return NULL;
+}
+
+static int socketReadLine(void *source, char *line, size_t maxlen)
+{
+   return lineReaderRead(source, line, maxlen);
+}
+
+// nächste Zeile aus einer gesammelten Antwort, 0 am Ende
+static int replyReadLine(void *source, char *line, size_t maxlen)
+{
+   ReplySource *reply = source;
+   size_t length = 0;
+
+   while (length < maxlen - 1 && reply->position < reply->length)
+   {
+      char c = reply->data[reply->position++];
+      line[length++] = c;
+      if (c == '\n')
+      {
+         break;
+      }
+   }
+   line[length] = '\0';
+   return (int)length;
+}
+
+// liest Frames, bis die Antwort auf Command index vollständig ist, die
+// Antworten anderer Commands werden dabei mitgesammelt
+// -1 bei Verbindungsfehler oder unerwarteter Zeile
+static int collectReply(Batch *batch, size_t index)
+{
+   char line[BUF];
+   char *end;
+
+   while (!batch->commands[index].complete)
+   {
+      if (lineReaderRead(&batch->reader, line, sizeof(line)) <= 0 || line[0] != 't')
+      {
+         return -1;
+      }
+      size_t tag = strtoul(line + 1, &end, 10);
+      if (end == line + 1 || *end != ' ' || tag >= batch->commandCount)
+      {
+         return -1;
+      }
+      BatchCommand *command = &batch->commands[tag];
+      if (strcmp(end + 1, ".\n") == 0)
+      {
+         command->complete = 1;
+         continue;
+      }
+
+      size_t length = strtoul(end + 1, NULL, 10);
+      if (length == 0)
+      {
+         return -1;
+      }
+      if (command->replyLength + length > command->replyCapacity)
+      {
+         size_t capacity = command->replyCapacity == 0 ? 4096 : command->replyCapacity;
+         while (capacity < command->replyLength + length)
+         {
+            capacity *= 2;
+         }
+         char *grown = realloc(command->reply, capacity);
+         if (grown == NULL)
+         {
+            return -1;
+         }
+         command->reply = grown;
+         command->replyCapacity = capacity;
+      }
+      if (lineReaderReadBytes(&batch->reader, command->reply + command->replyLength, length) == -1)
+      {
+         return -1;
+      }
+      command->replyLength += length;
+   }
+   return 0;
+}
+
+// liest die Antwort auf einen Command, 0 = OK, 1 = ERR, -1 = Verbindungsfehler
+static int readResponse(ReadLine readLine, void *source, const BatchCommand *command)
+{
+   char line[BUF];
+
+   if (readLine(source, line, sizeof(line)) <= 0)
+   {
+      return -1;
+   }
+
+   switch (command->type)
+   {
+   case BATCH_LOGIN:
+   case BATCH_RESUME:
+      if (strncmp(line, "OK", 2) != 0)
+      {
+         return 1;
+      }
+      if (command->type == BATCH_RESUME)
+      {
+         saveToken(line); // erneuertes Token
+      }
+      return 0;
+
+   case BATCH_SEND:
+   case BATCH_DEL:
+      return strncmp(line, "OK", 2) == 0 ? 0 : 1;
+
+   case BATCH_LIST:
+   case BATCH_SEARCH:
+      if (strncmp(line, "ERR", 3) == 0 || strncmp(line, "BUSY", 4) == 0)
+      {
+         return 1;
+      }
+      printf("%s", line);
+      for (int i = atoi(line); i > 0; i--)
+      {
+         if (readLine(source, line, sizeof(line)) <= 0)
+         {
+            return -1;
+         }
+         printf("%s", line);
+      }
+      return 0;
+
+   case BATCH_READ:
+      if (strncmp(line, "OK", 2) != 0)
+      {
+         return 1;
+      }
+      // Batch-READ: "OK <count>", dann pro Nachricht Nummer, Inhalt, "."
+      for (int i = line[2] == ' ' ? atoi(line + 3) : 1; i > 0; i--)
+      {
+         do
+         {
+            if (readLine(source, line, sizeof(line)) <= 0)
+            {
+               return -1;
+            }
+            printf("%s", line);
+         } while (strcmp(line, ".\n") != 0);
+      }
+      return 0;
+
+   case BATCH_STATS:
+      if (strncmp(line, "OK", 2) != 0)
+      {
+         return 1;
+      }
+      do
+      {
+         if (readLine(source, line, sizeof(line)) <= 0)
+         {
+            return -1;
+         }
+         printf("%s", line);
+      } while (strcmp(line, ".\n") != 0);
+      return 0;
+   }
+
+   return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int batchRun(int socket, const char *script, const Credentials *credentials, int tagged)
+{
+   Batch *batch;
+   pthread_t sender;
+   int failed = 0;
+   int result;
+
+   // Batch enthält den Lese-Buffer, daher nicht am Stack
+   batch = calloc(1, sizeof(Batch));
+   if (batch == NULL)
+   {
+      fprintf(stderr, "Error: out of memory\n");
+      return -1;
+   }
+   batch->socket = socket;
+   batch->reader.socket = socket;
+   batch->tagged = tagged;
+
+   // ohne Login-Daten die gespeicherte Session verwenden
+   if (credentials->username[0] != '\0')
+   {
+      result = addLogin(batch, credentials, 0);
+   }
+   else
+   {
+      result = addResume(batch);
+   }
+
+   if (result == -1 || parseScript(batch, script, credentials) == -1)
+   {
+      free(batch->requests.data);
+      free(batch->commands);
+      free(batch);
+      return -1;
+   }
+
+   if (pthread_create(&sender, NULL, batchSender, batch) != 0)
+   {
+      fprintf(stderr, "Error: could not start sender thread\n");
+      free(batch->requests.data);
+      free(batch->commands);
+      free(batch);
+      return -1;
+   }
+
+   for (size_t i = 0; i < batch->commandCount; i++)
+   {
+      BatchCommand *command = &batch->commands[i];
+
+      if (batch->tagged)
+      {
+         // Antworten kommen in beliebiger Reihenfolge, ausgegeben wird
+         // trotzdem in Reihenfolge des Scripts
+         ReplySource source = {NULL, 0, 0};
+         result = collectReply(batch, i);
+         if (result == 0)
+         {
+            source.data = command->reply;
+            source.length = command->replyLength;
+            result = readResponse(replyReadLine, &source, command);
+         }
+         free(command->reply);
+         command->reply = NULL;
+      }
+      else
+      {
+         result = readResponse(socketReadLine, &batch->reader, command);
+      }
+      if (result == -1)
+      {
+         fprintf(stderr, "Server closed connection after %zu of %zu commands\n",
+                 i, batch->commandCount);
+         failed = -1;
+         shutdown(socket, SHUT_RDWR); // Sender-Thread nicht hängen lassen
+         break;
+      }
+      if (result == 1)
+      {
+         if (command->line == 0)
+         {
+            fprintf(stderr, "%s failed\n", batchNames[command->type]);
+         }
+         else
+         {
+            fprintf(stderr, "line %d: %s failed\n", command->line, batchNames[command->type]);
+         }
+         failed++;
+      }
+   }
+
+   pthread_join(sender, NULL);
+   fflush(stdout);
+
+   if (failed >= 0)
+   {
+      fprintf(stderr, "%zu commands, %d failed\n", batch->commandCount, failed);
+   }
+
+   for (size_t i = 0; i < batch->commandCount; i++)
+   {
+      free(batch->commands[i].reply); // nach Verbindungsfehler
+   }
+   free(batch->requests.data);
+   free(batch->commands);
+   free(batch);
+   return failed;
+}
@@ -0,0 +1,35 @@
+#ifndef TWMAILER_BATCH_H
+#define TWMAILER_BATCH_H
+
+#include "client.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Batch-Modus des Clients (nicht interaktiv)
+// Das Script enthält einen Command pro Zeile:
+//
+//    SEND <receiver> <subject>
+//    <message lines>
+//    .
+//    LIST
+//    READ <number>        (auch "3,7,9" oder "1-500")
+//    DEL <number>         (ebenso)
+//    SEARCH <words>
+//    STATS
+//    LOGIN
+//
+// Leere Zeilen und Zeilen mit '#' werden ignoriert. Alle Commands werden
+// sofort über die Verbindung geschickt (Pipelining), die Antworten werden
+// parallel dazu gelesen. LIST, SEARCH und READ Ausgaben landen im Protokoll-Format
+// auf stdout, Fehler mit Zeilennummer auf stderr.
+// Mit tagged (-t) bekommt jeder Command ein Tag "t<n>", der Server bearbeitet
+// sie dann gleichzeitig. Die Antworten werden nach Tag gesammelt und trotzdem
+// in Reihenfolge des Scripts ausgegeben. Abhängige Commands (READ einer eben
+// geschickten Nachricht) sind dann nicht mehr garantiert.
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Rückgabe: Anzahl der fehlgeschlagenen Commands, -1 bei Verbindungsfehler
+int batchRun(int socket, const char *script, const Credentials *credentials, int tagged);
+
+#endif
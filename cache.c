@@ -0,0 +1,191 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "cache.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static char cacheBase[512];
+static char cacheDir[700]; // leer -> nicht eingeloggt, kein Cache
+
+///////////////////////////////////////////////////////////////////////////////
+
+// wie mkdir -p, alle Verzeichnisse nur für den User lesbar
+static int makeDirectories(const char *path)
+{
+   char partial[sizeof(cacheDir)];
+
+   snprintf(partial, sizeof(partial), "%s", path);
+   for (char *slash = strchr(partial + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+   {
+      *slash = '\0';
+      if (mkdir(partial, 0700) == -1 && errno != EEXIST)
+      {
+         return -1;
+      }
+      *slash = '/';
+   }
+   return mkdir(partial, 0700) == -1 && errno != EEXIST ? -1 : 0;
+}
+
+static void cachePath(int number, char *path, size_t size)
+{
+   snprintf(path, size, "%s/%d", cacheDir, number);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void cacheInit(const char *ip, int port)
+{
+   const char *path = getenv("TWMAILER_CACHE_DIR");
+   const char *home = getenv("HOME");
+
+   if (path != NULL && *path != '\0')
+   {
+      snprintf(cacheBase, sizeof(cacheBase), "%s", path);
+   }
+   else
+   {
+      snprintf(cacheBase, sizeof(cacheBase), "%s/.twmailer-cache/%s-%d",
+               home != NULL ? home : ".", ip, port);
+   }
+}
+
+// nach LOGIN/RESUME, jeder User hat seinen eigenen Cache
+void cacheSetUser(const char *username)
+{
+   snprintf(cacheDir, sizeof(cacheDir), "%s/%s", cacheBase, username);
+   if (makeDirectories(cacheDir) == -1)
+   {
+      perror("create cache directory failed");
+      cacheDir[0] = '\0';
+   }
+}
+
+// 0 und Inhalt in *data (mit free() freigeben) wenn die Nachricht im Cache ist
+int cacheLookup(int number, unsigned long *uidValidity, size_t *size, char **data)
+{
+   char path[800];
+
+   if (cacheDir[0] == '\0')
+   {
+      return -1;
+   }
+
+   cachePath(number, path, sizeof(path));
+   FILE *file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return -1;
+   }
+
+   if (fscanf(file, "%lu %zu", uidValidity, size) != 2 || fgetc(file) != '\n')
+   {
+      fclose(file);
+      return -1;
+   }
+
+   *data = malloc(*size + 1);
+   if (*data == NULL || fread(*data, 1, *size, file) != *size)
+   {
+      free(*data);
+      fclose(file);
+      return -1;
+   }
+   (*data)[*size] = '\0';
+   fclose(file);
+   return 0;
+}
+
+// schreibt atomar (tmp-Datei + rename), Fehler werden ignoriert
+void cacheStore(int number, unsigned long uidValidity, const char *data, size_t size)
+{
+   char path[800];
+   char tmpPath[810];
+
+   if (cacheDir[0] == '\0')
+   {
+      return;
+   }
+
+   cachePath(number, path, sizeof(path));
+   snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+   FILE *file = fopen(tmpPath, "w");
+   if (file == NULL)
+   {
+      return;
+   }
+   fprintf(file, "%lu %zu\n", uidValidity, size);
+   fwrite(data, 1, size, file);
+   if (fclose(file) != 0 || rename(tmpPath, path) == -1)
+   {
+      unlink(tmpPath);
+   }
+}
+
+void cacheRemove(int number)
+{
+   char path[800];
+
+   if (cacheDir[0] != '\0')
+   {
+      cachePath(number, path, sizeof(path));
+      unlink(path);
+   }
+}
+
+// Stand des letzten SYNC (uidvalidity + modseq), "0 0" wenn unbekannt
+void cacheLoadWatermark(unsigned long *uidValidity, unsigned long *modSeq)
+{
+   char path[800];
+
+   *uidValidity = 0;
+   *modSeq = 0;
+   if (cacheDir[0] == '\0')
+   {
+      return;
+   }
+
+   snprintf(path, sizeof(path), "%s/.sync", cacheDir);
+   FILE *file = fopen(path, "r");
+   if (file != NULL)
+   {
+      if (fscanf(file, "%lu %lu", uidValidity, modSeq) != 2)
+      {
+         *uidValidity = 0;
+         *modSeq = 0;
+      }
+      fclose(file);
+   }
+}
+
+void cacheSaveWatermark(unsigned long uidValidity, unsigned long modSeq)
+{
+   char path[800];
+   char tmpPath[810];
+
+   if (cacheDir[0] == '\0')
+   {
+      return;
+   }
+
+   snprintf(path, sizeof(path), "%s/.sync", cacheDir);
+   snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+   FILE *file = fopen(tmpPath, "w");
+   if (file == NULL)
+   {
+      return;
+   }
+   fprintf(file, "%lu %lu\n", uidValidity, modSeq);
+   if (fclose(file) != 0 || rename(tmpPath, path) == -1)
+   {
+      unlink(tmpPath);
+   }
+}
@@ -0,0 +1,25 @@
+#ifndef TWMAILER_CACHE_H
+#define TWMAILER_CACHE_H
+
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Lokaler Cache für gelesene Nachrichten (Client)
+// $TWMAILER_CACHE_DIR oder ~/.twmailer-cache/<ip>-<port>, darunter pro User
+// eine Datei pro Nachrichtennummer: "<uidvalidity> <size>\n" + Inhalt.
+// Vor der Verwendung wird mit STAT geprüft, ob uidvalidity und Größe noch
+// stimmen (Nachrichtennummern werden vom Server nie wieder vergeben).
+// In ".sync" steht der Stand des letzten SYNC ("<uidvalidity> <modseq>").
+
+///////////////////////////////////////////////////////////////////////////////
+
+void cacheInit(const char *ip, int port);
+void cacheSetUser(const char *username);
+int cacheLookup(int number, unsigned long *uidValidity, size_t *size, char **data);
+void cacheStore(int number, unsigned long uidValidity, const char *data, size_t size);
+void cacheRemove(int number);
+void cacheLoadWatermark(unsigned long *uidValidity, unsigned long *modSeq);
+void cacheSaveWatermark(unsigned long uidValidity, unsigned long modSeq);
+
+#endif
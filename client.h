@@ -0,0 +1,41 @@
+#ifndef TWMAILER_CLIENT_H
+#define TWMAILER_CLIENT_H
+
+#include <sys/types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Gemeinsame Funktionen des Clients (twmailer-client.c), werden auch vom
+// Batch- und Export-Modus verwendet
+
+#define BUF 1024
+
+// Login-Daten für die nicht-interaktiven Modi (Env-Variable oder fd)
+typedef struct Credentials
+{
+   char username[128];
+   char password[256];
+} Credentials;
+
+// gepuffertes zeilenweises Lesen (readline() liest jedes Byte einzeln)
+typedef struct LineReader
+{
+   int socket;
+   char buffer[16384];
+   size_t start;
+   size_t end;
+} LineReader;
+
+// Datei mit dem Session-Token vom letzten LOGIN (pro Server)
+extern char tokenPath[512];
+
+///////////////////////////////////////////////////////////////////////////////
+
+ssize_t readline(int fd, void *vptr, size_t maxlen);
+int lineReaderRead(LineReader *reader, char *line, size_t maxlen);
+int lineReaderReadBytes(LineReader *reader, char *data, size_t length);
+int sendAll(int socket, const char *buffer, size_t length);
+void saveToken(const char *response);
+int loadToken(char *token, size_t size);
+
+#endif
@@ -0,0 +1,2161 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include "commands.h"
+#include "mailbox.h"
+#include "auth.h"
+#include "token.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
+#include "notify.h"
+#include "search.h"
+#include "reclaim.h"
+#include "diskpool.h"
+#include "tagged.h"
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Bereich von Nachrichtennummern für Batch READ/DEL
+typedef struct NumberRange
+{
+   int from;
+   int to;
+} NumberRange;
+
+#define MAX_RANGES 64
+
+// Response-Buffer (aus commandArena), wird gesendet sobald er voll ist
+#define RESPONSE_SIZE (BUF * 16)
+
+///////////////////////////////////////////////////////////////////////////////
+
+char *mailSpoolDir = NULL;
+
+// Session-Daten, jede Client-Verbindung läuft in einem eigenen Thread
+__thread int isAuthenticated = 0;
+__thread char sessionUsername[256]; // LDAP-Username nach Login
+
+// Buffer eines Commands, wird nach jedem Command zurückgesetzt
+__thread Arena commandArena = {NULL, NULL};
+
+// Dispatch-Tabelle, Index = CommandId aus protocol.h (QUIT behandelt der
+// Server selbst)
+const CommandHandler commandHandlers[COMMAND_OTHER] = {
+    [COMMAND_LOGIN] = handleLogin,
+    [COMMAND_RESUME] = handleResume,
+    [COMMAND_SEND] = handleSend,
+    [COMMAND_LIST] = handleList,
+    [COMMAND_READ] = handleRead,
+    [COMMAND_DEL] = handleDel,
+    [COMMAND_STATS] = handleStats,
+    [COMMAND_INDEX] = handleIndex,
+    [COMMAND_STAT] = handleStat,
+    [COMMAND_SYNC] = handleSync,
+    [COMMAND_IDLE] = handleIdle,
+    [COMMAND_SEARCH] = handleSearch,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+//  funktion um die nächste nachrichtennummer für einen benutzer zu bekommen
+int getNextMessageNumber(const char *userDir)
+{
+   DIR *dir;
+   struct dirent *entry;
+   int maxNum = 0;
+   int currentNum;
+
+   dir = opendir(userDir);
+   if (dir == NULL)
+   {
+      return 1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      // Check ob filename format "number.txt"
+      if (sscanf(entry->d_name, "%d.txt", &currentNum) == 1)
+      {
+         if (currentNum > maxNum)
+         {
+            maxNum = currentNum;
+         }
+      }
+   }
+
+   closedir(dir);
+   return maxNum + 1;
+}
+
+// liest den Body bis zur Zeile "." in commandArena (wächst bis
+// max_message_size), Zeilen ohne "\r" mit "\n" verbunden
+// eine zu lange Nachricht wird trotzdem bis "." gelesen und dann abgelehnt
+static int readBody(int socket, ProtocolRequest *request)
+{
+   char buffer[BUF];
+   size_t capacity = BUF * 4;
+   size_t length = 0;
+   int tooLong = 0;
+   int size;
+   TraceSpan span;
+
+   char *body = arenaAlloc(&commandArena, capacity);
+   if (body == NULL)
+   {
+      LOG_ERROR("Out of memory");
+      return -1;
+   }
+   body[0] = '\0';
+
+   span = traceBegin("net.readline_body");
+   while (1)
+   {
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         LOG_ERRNO("readline message failed");
+         traceEnd(&span);
+         return -1;
+      }
+      size = protocolStripLine(buffer, size);
+
+      // Checkt für den End Marker
+      if (strcmp(buffer, ".") == 0)
+      {
+         break;
+      }
+
+      // nachricht anhaengen
+      if (tooLong || length + size + 1 > (size_t)serverConfig.maxMessageSize)
+      {
+         tooLong = 1;
+         continue;
+      }
+      if (length + size + 2 > capacity)
+      {
+         size_t grownCapacity = capacity * 2;
+         while (length + size + 2 > grownCapacity)
+         {
+            grownCapacity *= 2;
+         }
+         char *grown = arenaGrow(&commandArena, body, capacity, grownCapacity);
+         if (grown == NULL)
+         {
+            LOG_ERROR("Out of memory");
+            traceEnd(&span);
+            return -1;
+         }
+         body = grown;
+         capacity = grownCapacity;
+      }
+      if (length > 0)
+      {
+         body[length++] = '\n';
+      }
+      memcpy(body + length, buffer, size + 1);
+      length += size;
+   }
+   traceEnd(&span);
+
+   if (tooLong)
+   {
+      LOG_WARN("Message too long");
+      return -1;
+   }
+   LOG_DEBUG("Message received (%zu bytes)", length);
+   request->body = body;
+   request->bodyLength = length;
+   return 0;
+}
+
+// liest die Argument-Zeilen (und bei SEND den Body) eines Commands laut
+// Protokoll-Tabelle in commandArena und prüft ihre Länge
+// es werden immer alle Zeilen gelesen, damit ein ungültiges Argument nicht
+// als nächster Command interpretiert wird
+int readRequest(int socket, const ProtocolCommand *command, ProtocolRequest *request)
+{
+   TraceSpan span;
+
+   request->command = command;
+   request->body = NULL;
+   request->bodyLength = 0;
+
+   for (int i = 0; i < command->argCount; i++)
+   {
+      char *line = arenaAlloc(&commandArena, BUF);
+      if (line == NULL)
+      {
+         LOG_ERROR("Out of memory");
+         return -1;
+      }
+
+      span = traceBegin("net.readline");
+      int size = readline(socket, line, BUF - 1);
+      traceEnd(&span);
+      if (size <= 0)
+      {
+         LOG_ERRNO("readline %s failed", command->args[i].name);
+         return -1;
+      }
+      request->args[i] = line;
+      request->argLengths[i] = protocolStripLine(line, size);
+   }
+   if (command->hasBody && readBody(socket, request) == -1)
+   {
+      return -1;
+   }
+
+   for (int i = 0; i < command->argCount; i++)
+   {
+      if (protocolCheckArg(command, i, request->argLengths[i]) == -1)
+      {
+         LOG_WARN("%s: invalid %s length: %d", command->name,
+                  command->args[i].name, request->argLengths[i]);
+         return -1;
+      }
+   }
+   return 0;
+}
+
+// LOGIN command handler
+// Authentifizierung über das konfigurierte Backend (ldap, file oder mock)
+int handleLogin(int socket, const ProtocolRequest *request)
+{
+   const char *ldapUsername = request->args[0];
+   const char *ldapPassword = request->args[1];
+   TraceSpan span;
+
+   // Username wird Teil der Spool-Pfade und des Tokens, mock und file
+   // filtern nicht wie LDAP -> hier prüfen
+   if (!isValidUsername(ldapUsername))
+   {
+      LOG_WARN("LOGIN rejected: only lowercase letters (a-z) and digits (0-9) allowed");
+      return -1;
+   }
+
+   LOG_INFO("LOGIN attempt for user: %s", ldapUsername);
+
+   span = traceBegin("auth");
+   int authResult = authenticate(ldapUsername, ldapPassword);
+   traceEnd(&span);
+
+   if (authResult == -1)
+   {
+      LOG_WARN("Authentication failed for user: %s", ldapUsername);
+      return -1;
+   }
+
+   // Authentifizierung erfolgreich!
+   LOG_INFO("Authentication successful for user: %s", ldapUsername);
+
+   // Session-Daten setzen
+   isAuthenticated = 1;
+   strncpy(sessionUsername, ldapUsername, sizeof(sessionUsername) - 1);
+   sessionUsername[sizeof(sessionUsername) - 1] = '\0';
+
+   return sendLoginOk(socket, time(NULL));
+}
+
+// RESUME command handler
+// Format: RESUME\n<token>\n
+// stellt die Session aus einem Token von LOGIN wieder her (ohne LDAP)
+int handleResume(int socket, const ProtocolRequest *request)
+{
+   char username[128];
+   time_t issued;
+   TraceSpan span;
+
+   span = traceBegin("token.verify");
+   int verifyResult = tokenVerify(request->args[0], username, sizeof(username), &issued);
+   traceEnd(&span);
+
+   if (verifyResult == -1 || !isValidUsername(username))
+   {
+      LOG_WARN("RESUME rejected");
+      return -1;
+   }
+
+   LOG_INFO("Session resumed for user: %s", username);
+
+   isAuthenticated = 1;
+   strncpy(sessionUsername, username, sizeof(sessionUsername) - 1);
+   sessionUsername[sizeof(sessionUsername) - 1] = '\0';
+
+   // neues Token mit der ursprünglichen Login-Zeit, kein Verlängern über
+   // session_max_age hinaus
+   return sendLoginOk(socket, issued);
+}
+
+// Antwort auf erfolgreiches LOGIN/RESUME: "OK <token>" bzw. "OK" wenn
+// Tokens deaktiviert sind oder die Session ihr maximales Alter erreicht hat
+int sendLoginOk(int socket, time_t issued)
+{
+   char token[TOKEN_MAX];
+   char response[TOKEN_MAX + 8];
+   TraceSpan span;
+
+   span = traceBegin("token.issue");
+   if (tokenIssue(sessionUsername, issued, token, sizeof(token)) == 0)
+   {
+      snprintf(response, sizeof(response), "OK %s\n", token);
+   }
+   else
+   {
+      strcpy(response, "OK\n");
+   }
+   traceEnd(&span);
+
+   span = traceBegin("net.reply");
+   int sent = writen(socket, response, strlen(response));
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send OK failed");
+      return -1;
+   }
+
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Disk-Jobs
+// Spool-Zugriffe laufen über diskRun() im Disk-Pool (diskpool.h), der
+// Session-Thread macht nur das Netzwerk. Jobs mit viel Output füllen den
+// Response-Buffer nur bis er voll ist, der Session-Thread schickt ihn und
+// gibt den Job erneut ab (Speicher bleibt bei RESPONSE_SIZE, außer eine
+// Antwort wird unter der Postfach-Sperre gesammelt).
+
+// Platz für eine Zeile (Subject, Zeile einer Nachricht, Änderung)
+#define LINE_RESERVE (BUF + 32)
+
+// Response-Buffer (anfangs RESPONSE_SIZE Bytes aus commandArena)
+// Mit socket -1 schicken die output*-Funktionen nichts, der Buffer wächst
+// stattdessen: so wird eine Antwort unter der Postfach-Sperre gesammelt und
+// erst nach mailboxUnlock() mit outputFlush() geschickt.
+typedef struct Output
+{
+   char *data;
+   int length;
+   int capacity;
+} Output;
+
+static int outputAlloc(Output *out)
+{
+   out->data = arenaAlloc(&commandArena, RESPONSE_SIZE);
+   out->length = 0;
+   out->capacity = RESPONSE_SIZE;
+   if (out->data == NULL)
+   {
+      LOG_ERROR("Out of memory");
+      return -1;
+   }
+   return 0;
+}
+
+static int outputFull(const Output *out)
+{
+   return out->length + LINE_RESERVE > out->capacity;
+}
+
+// verdoppelt den Buffer (socket -1)
+static int outputGrow(Output *out)
+{
+   char *grown = arenaGrow(&commandArena, out->data, out->capacity, out->capacity * 2);
+   if (grown == NULL)
+   {
+      LOG_ERROR("Out of memory");
+      return -1;
+   }
+   out->data = grown;
+   out->capacity *= 2;
+   return 0;
+}
+
+// schickt den Buffer und leert ihn
+static int outputFlush(int socket, Output *out)
+{
+   int result = 0;
+
+   if (out->length > 0 && writen(socket, out->data, out->length) == -1)
+   {
+      result = -1;
+   }
+   out->length = 0;
+   return result;
+}
+
+// schickt den Buffer (bzw. lässt ihn wachsen), wenn keine ganze Zeile mehr
+// Platz hat
+static int outputMakeRoom(int socket, Output *out)
+{
+   if (!outputFull(out))
+   {
+      return 0;
+   }
+   return socket == -1 ? outputGrow(out) : outputFlush(socket, out);
+}
+
+// hängt eine kurze Zeile an (Nummer, end marker)
+static int outputAppend(int socket, Output *out, const char *text)
+{
+   size_t length = strlen(text);
+
+   if (out->length + length > (size_t)out->capacity && outputMakeRoom(socket, out) == -1)
+   {
+      return -1;
+   }
+   memcpy(out->data + out->length, text, length);
+   out->length += length;
+   return 0;
+}
+
+static int compareNumbers(const void *a, const void *b)
+{
+   int left = *(const int *)a;
+   int right = *(const int *)b;
+   return (left > right) - (left < right);
+}
+
+// sammelt die Nummern aller Nachrichten aufsteigend sortiert in *numbers
+// (mit free() freigeben), Rückgabe: Anzahl oder -1
+static int scanMessageNumbers(const char *userDir, int **numbers)
+{
+   DIR *dir;
+   struct dirent *entry;
+   int count = 0;
+   int capacity = 0;
+   int number;
+
+   *numbers = NULL;
+   dir = opendir(userDir);
+   if (dir == NULL)
+   {
+      return 0; // noch keine Nachrichten bekommen
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (sscanf(entry->d_name, "%d.txt", &number) != 1)
+      {
+         continue;
+      }
+      if (count == capacity)
+      {
+         capacity = capacity == 0 ? 64 : capacity * 2;
+         int *grown = realloc(*numbers, capacity * sizeof(int));
+         if (grown == NULL)
+         {
+            LOG_ERROR("Out of memory while scanning %s", userDir);
+            free(*numbers);
+            *numbers = NULL;
+            closedir(dir);
+            return -1;
+         }
+         *numbers = grown;
+      }
+      (*numbers)[count++] = number;
+   }
+   closedir(dir);
+
+   qsort(*numbers, count, sizeof(int), compareNumbers);
+   return count;
+}
+
+typedef struct ScanJob
+{
+   const char *userDir;
+   int *numbers;
+   int count;
+} ScanJob;
+
+static void scanJob(void *data)
+{
+   ScanJob *job = data;
+   job->count = scanMessageNumbers(job->userDir, &job->numbers);
+}
+
+// scanMessageNumbers() im Disk-Pool
+static int scanInPool(const char *userDir, int **numbers)
+{
+   ScanJob job = {userDir, NULL, 0};
+
+   diskRun(scanJob, &job);
+   *numbers = job.numbers;
+   return job.count;
+}
+
+// subject ist die dritte zeile, -1 wenn die Datei fehlt oder zu kurz ist
+static int readSubjectFile(const char *filePath, char *line, size_t size)
+{
+   int result = -1;
+
+   line[0] = '\0';
+   FILE *file = fopen(filePath, "r");
+   if (file != NULL)
+   {
+      result = 0;
+      for (int lineNum = 0; lineNum < 3; lineNum++)
+      {
+         if (fgets(line, size, file) == NULL)
+         {
+            line[0] = '\0';
+            result = -1;
+            break;
+         }
+      }
+      fclose(file);
+   }
+   line[strcspn(line, "\n")] = '\0';
+   return result;
+}
+
+// wie readSubjectFile(), subject leer wenn die Datei fehlt
+static void readSubject(const char *userDir, int number, char *line, size_t size)
+{
+   char filePath[1024];
+
+   snprintf(filePath, sizeof(filePath), "%s/%d.txt", userDir, number);
+   readSubjectFile(filePath, line, size);
+}
+
+// "<prefix><nummer> <subject>" Zeilen ab numbers[next]
+typedef struct SubjectJob
+{
+   const char *userDir;
+   const int *numbers;
+   int count;
+   int next;
+   const char *prefix;
+   Output *out;
+} SubjectJob;
+
+static void subjectJob(void *data)
+{
+   SubjectJob *job = data;
+   Output *out = job->out;
+   char line[BUF];
+
+   while (job->next < job->count && !outputFull(out))
+   {
+      int number = job->numbers[job->next++];
+
+      readSubject(job->userDir, number, line, sizeof(line));
+      out->length += snprintf(out->data + out->length, out->capacity - out->length,
+                              "%s%d %s\n", job->prefix, number, line);
+   }
+}
+
+// Subject-Zeilen für INDEX, SEARCH und SYNC FULL, volle Buffer werden gleich
+// geschickt (socket -1: nur sammeln, siehe Output)
+static int sendSubjects(int socket, const char *userDir, const int *numbers, int count,
+                        const char *prefix, Output *out)
+{
+   SubjectJob job = {userDir, numbers, count, 0, prefix, out};
+
+   while (job.next < job.count)
+   {
+      if (outputMakeRoom(socket, out) == -1)
+      {
+         return -1;
+      }
+      diskRun(subjectJob, &job);
+   }
+   return 0;
+}
+
+// Inhalt einer Nachricht, zeilenweise damit der Buffer nie mitten in einer
+// Zeile verschickt wird
+typedef struct MessageJob
+{
+   char filePath[320];
+   FILE *file; // offen zwischen zwei Aufrufen
+   int done;   // 1 = fertig, -1 = Fehler (errno)
+   Output *out;
+} MessageJob;
+
+static void messageJob(void *data)
+{
+   MessageJob *job = data;
+   Output *out = job->out;
+
+   if (job->file == NULL && (job->file = fopen(job->filePath, "r")) == NULL)
+   {
+      job->done = -1;
+      return;
+   }
+   while (!outputFull(out))
+   {
+      if (fgets(out->data + out->length, BUF, job->file) == NULL)
+      {
+         fclose(job->file);
+         job->file = NULL;
+         job->done = 1;
+         return;
+      }
+      out->length += strlen(out->data + out->length);
+   }
+}
+
+static void openMessageJob(void *data)
+{
+   MessageJob *job = data;
+
+   if ((job->file = fopen(job->filePath, "r")) == NULL)
+   {
+      job->done = -1;
+   }
+}
+
+// hängt den Inhalt von <userDir>/<number>.txt an out an
+// nur das Öffnen braucht die geteilte Sperre, eine Nachricht ändert sich nach
+// dem rename nicht mehr und DEL entfernt nur den Namen
+// -1 mit errno (ENOENT wenn es die Nachricht nicht gibt)
+static int sendMessage(int socket, const char *userDir, int number, Output *out)
+{
+   MessageJob job;
+
+   snprintf(job.filePath, sizeof(job.filePath), "%s/%d.txt", userDir, number);
+   job.file = NULL;
+   job.done = 0;
+   job.out = out;
+
+   if (mailboxLockShared(userDir) == -1)
+   {
+      return -1;
+   }
+   diskRun(openMessageJob, &job);
+   int error = errno;
+   mailboxUnlock(userDir);
+   if (job.done == -1)
+   {
+      errno = error;
+      return -1;
+   }
+
+   while (job.done == 0)
+   {
+      if (outputMakeRoom(socket, out) == -1)
+      {
+         if (job.file != NULL)
+         {
+            fclose(job.file);
+         }
+         return -1;
+      }
+      diskRun(messageJob, &job);
+   }
+   return job.done == -1 ? -1 : 0;
+}
+
+// Einträge aus .changes mit since < seq <= until als "+ n subject" bzw.
+// "- n" Zeilen
+typedef struct ChangeJob
+{
+   const char *logPath;
+   FILE *log; // NULL -> wird beim ersten Aufruf geöffnet
+   unsigned long since;
+   unsigned long until;
+   int count;
+   int done;
+   Output *out;
+} ChangeJob;
+
+static void changeJob(void *data)
+{
+   ChangeJob *job = data;
+   Output *out = job->out;
+   char line[BUF];
+   char *change;
+   unsigned long seq;
+
+   if (job->log == NULL && (job->log = fopen(job->logPath, "r")) == NULL)
+   {
+      job->done = 1; // noch keine Änderungen
+      return;
+   }
+   while (!outputFull(out))
+   {
+      if (fgets(line, sizeof(line), job->log) == NULL)
+      {
+         job->done = 1;
+         break;
+      }
+      seq = strtoul(line, &change, 10);
+      if (seq <= job->since)
+      {
+         continue;
+      }
+      if (seq > job->until)
+      {
+         job->done = 1; // nach dem Lesen der .meta angehängt, kommt beim nächsten Mal
+         break;
+      }
+      change++; // Leerzeichen nach der seq
+
+      size_t size = strlen(change);
+      memcpy(out->data + out->length, change, size);
+      out->length += size;
+      job->count++;
+   }
+   if (job->done)
+   {
+      fclose(job->log);
+      job->log = NULL;
+   }
+}
+
+// hängt die Änderungen an out an, volle Buffer werden gleich geschickt
+// (socket -1: nur sammeln)
+// log darf schon offen sein (wird dann geschlossen)
+// Rückgabe: Anzahl der Änderungen oder -1
+static int sendChanges(int socket, const char *logPath, FILE *log, unsigned long since,
+                       unsigned long until, Output *out)
+{
+   ChangeJob job = {logPath, log, since, until, 0, 0, out};
+
+   while (!job.done)
+   {
+      if (outputMakeRoom(socket, out) == -1)
+      {
+         if (job.log != NULL)
+         {
+            fclose(job.log);
+         }
+         return -1;
+      }
+      diskRun(changeJob, &job);
+   }
+   return job.count;
+}
+
+typedef struct MetaJob
+{
+   const char *userDir;
+   MailboxMeta *meta;
+   int result;
+} MetaJob;
+
+static void metaJob(void *data)
+{
+   MetaJob *job = data;
+
+   if (mkdir(job->userDir, 0700) == -1 && errno != EEXIST)
+   {
+      LOG_ERRNO("mkdir failed");
+      job->result = -1;
+      return;
+   }
+   job->result = mailboxLoadMeta(job->userDir, job->meta);
+}
+
+// legt das Postfach an falls nötig und liest .meta (SYNC, IDLE)
+static int loadMetaInPool(const char *userDir, MailboxMeta *meta)
+{
+   MetaJob job = {userDir, meta, -1};
+
+   diskRun(metaJob, &job);
+   return job.result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SEND: schreibt die Nachricht in die tmp-Datei .<n>.tmp (ohne Sperre, wird
+// von keinem Scan gesehen), commitJob hängt sie danach unter der exklusiven
+// Sperre als <n>.txt ein
+typedef struct StoreJob
+{
+   const char *userDir;
+   const char *sender;
+   const char *receiver;
+   const char *subject;
+   const char *message;
+   long fileSize;
+   int number; // Ergebnis: Nachrichtennummer, -1 oder MAILBOX_OVER_QUOTA
+   char tmpPath[300];
+} StoreJob;
+
+static void storeJob(void *data)
+{
+   StoreJob *job = data;
+
+   // Create directory mit permissions 0700
+   if (mkdir(job->userDir, 0700) == -1 && errno != EEXIST)
+   {
+      LOG_ERRNO("mkdir failed");
+      job->number = -1;
+      return;
+   }
+
+   // Nummer aus .meta, wird nie wieder vergeben (Client-Cache)
+   job->number = mailboxAllocateNumber(job->userDir, job->fileSize);
+   if (job->number < 0)
+   {
+      return;
+   }
+
+   // schreibt ins tmp file
+   snprintf(job->tmpPath, sizeof(job->tmpPath), "%s/.%d.tmp", job->userDir, job->number);
+   FILE *file = fopen(job->tmpPath, "w");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen failed");
+      mailboxReleaseUsage(job->userDir, 1, job->fileSize);
+      job->number = -1;
+      return;
+   }
+
+   // formatiert nachricht im file: sender (aus session), receiver, subject, message
+   fprintf(file, "%s\n%s\n%s\n%s\n", job->sender, job->receiver, job->subject, job->message);
+   if (fclose(file) != 0)
+   {
+      // z.B. Volume voll, keine halbe Nachricht liegen lassen
+      LOG_ERRNO("write %s failed", job->tmpPath);
+      unlink(job->tmpPath);
+      mailboxReleaseUsage(job->userDir, 1, job->fileSize);
+      job->number = -1;
+   }
+}
+
+static void commitJob(void *data)
+{
+   StoreJob *job = data;
+   char filePath[300];
+
+   snprintf(filePath, sizeof(filePath), "%s/%d.txt", job->userDir, job->number);
+   if (rename(job->tmpPath, filePath) == -1)
+   {
+      LOG_ERRNO("rename %s failed", job->tmpPath);
+      unlink(job->tmpPath);
+      mailboxReleaseUsage(job->userDir, 1, job->fileSize);
+      job->number = -1;
+      return;
+   }
+
+   LOG_INFO("Message saved to: %s", filePath);
+
+   // für SYNC, Fehler sind nicht fatal (Client macht dann ggf. FULL)
+   mailboxLogChange(job->userDir, '+', job->number, job->subject);
+   searchAdd(job->userDir, job->number, job->sender, job->subject, job->message);
+}
+
+// LIST: erster Aufruf zählt (count -1 wenn es das Postfach nicht gibt),
+// danach liest jeder Aufruf Subjects bis der Buffer voll ist
+typedef struct ListJob
+{
+   const char *userDir;
+   DIR *dir; // offen zwischen zwei Aufrufen
+   int count;
+   int done; // 1 = fertig, -1 = Fehler
+   Output *out;
+} ListJob;
+
+static void countJob(void *data)
+{
+   ListJob *job = data;
+   struct dirent *entry;
+
+   DIR *dir = opendir(job->userDir);
+   if (dir == NULL)
+   {
+      job->count = -1;
+      return;
+   }
+
+   // Liest alle .txt Dateien und zählt sie
+   job->count = 0;
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (strstr(entry->d_name, ".txt") != NULL)
+      {
+         job->count++;
+      }
+   }
+   closedir(dir);
+}
+
+static void listJob(void *data)
+{
+   ListJob *job = data;
+   Output *out = job->out;
+   struct dirent *entry = NULL;
+   char filePath[1024];
+   char line[BUF];
+
+   if (job->dir == NULL && (job->dir = opendir(job->userDir)) == NULL)
+   {
+      LOG_ERRNO("re-opendir failed");
+      job->done = -1;
+      return;
+   }
+
+   // liest .txt dateien und extrahiert subjects (dritte zeile)
+   while (!outputFull(out) && (entry = readdir(job->dir)) != NULL)
+   {
+      if (strstr(entry->d_name, ".txt") == NULL)
+      {
+         continue;
+      }
+      snprintf(filePath, sizeof(filePath), "%s/%s", job->userDir, entry->d_name);
+      if (readSubjectFile(filePath, line, sizeof(line)) == 0)
+      {
+         out->length += snprintf(out->data + out->length, out->capacity - out->length, "%s\n", line);
+      }
+   }
+   if (entry == NULL)
+   {
+      closedir(job->dir);
+      job->dir = NULL;
+      job->done = 1;
+   }
+}
+
+// READ HEADER/RANGE: erster Aufruf öffnet die Datei und liest die Header,
+// danach liest jeder Aufruf chunk Bytes des Bodys ab offset
+typedef struct PartialJob
+{
+   char filePath[320];
+   FILE *file;
+   char (*headers)[BUF];
+   long bodyStart;
+   long bodySize;
+   long offset;
+   char *buffer;
+   size_t chunk;
+   int result;
+} PartialJob;
+
+static void openPartialJob(void *data)
+{
+   PartialJob *job = data;
+
+   job->file = fopen(job->filePath, "r");
+   if (job->file == NULL)
+   {
+      job->result = -1;
+      return;
+   }
+
+   // Header sind die ersten drei Zeilen, der Rest ist der Body
+   for (int i = 0; i < 3; i++)
+   {
+      if (fgets(job->headers[i], BUF, job->file) == NULL)
+      {
+         job->headers[i][0] = '\0';
+      }
+   }
+   job->bodyStart = ftell(job->file);
+   fseek(job->file, 0, SEEK_END);
+   job->bodySize = ftell(job->file) - job->bodyStart;
+   job->result = 0;
+}
+
+static void rangeJob(void *data)
+{
+   PartialJob *job = data;
+
+   // Dateien ändern sich nach SEND nicht mehr, kürzer wäre ein Fehler
+   fseek(job->file, job->bodyStart + job->offset, SEEK_SET);
+   job->result = fread(job->buffer, 1, job->chunk, job->file) == job->chunk ? 0 : -1;
+}
+
+// DEL: Tombstones, Quota, .changes und Index
+// numbers enthält danach nur die wirklich gelöschten
+typedef struct DeleteJob
+{
+   const char *userDir;
+   int *numbers;
+   int count;
+   int batch;
+   int deleted;
+} DeleteJob;
+
+static void deleteJob(void *data)
+{
+   DeleteJob *job = data;
+   char filePath[320];
+   long freedBytes = 0;
+
+   // nur Tombstones anlegen, die Dateien löscht später der Reclaim-Thread
+   // Größe vorher merken, damit die Quota wieder frei wird
+   job->deleted = 0;
+   for (int i = 0; i < job->count; i++)
+   {
+      struct stat info;
+      snprintf(filePath, sizeof(filePath), "%s/%d.txt", job->userDir, job->numbers[i]);
+      int known = stat(filePath, &info) == 0;
+      if (reclaimTombstone(job->userDir, job->numbers[i]) == 0)
+      {
+         job->numbers[job->deleted++] = job->numbers[i];
+         freedBytes += known ? info.st_size : 0;
+      }
+      else if (!job->batch || errno != ENOENT)
+      {
+         LOG_ERRNO("tombstone %s failed", filePath);
+      }
+   }
+   if (job->deleted == 0)
+   {
+      return;
+   }
+   reclaimSchedule(job->userDir);
+
+   // ein Eintrag pro Nachricht, aber nur ein Durchgang über .meta/.changes
+   mailboxLogDeletes(job->userDir, job->numbers, job->deleted, freedBytes);
+   searchRemove(job->userDir, job->numbers, job->deleted);
+}
+
+typedef struct StatJob
+{
+   const char *userDir;
+   int number;
+   struct stat info;
+   MailboxMeta meta;
+   int found;
+} StatJob;
+
+static void statJob(void *data)
+{
+   StatJob *job = data;
+   char filePath[320];
+
+   snprintf(filePath, sizeof(filePath), "%s/%d.txt", job->userDir, job->number);
+   job->found = stat(filePath, &job->info) == 0 && mailboxLoadMeta(job->userDir, &job->meta) == 0;
+}
+
+// SYNC/IDLE: öffnet .changes und prüft, ob das Log bis since + 1 zurückreicht
+typedef struct LogJob
+{
+   const char *logPath;
+   unsigned long since;
+   FILE *log;
+   int complete;
+} LogJob;
+
+static void logJob(void *data)
+{
+   LogJob *job = data;
+   unsigned long seq;
+
+   job->log = fopen(job->logPath, "r");
+   job->complete = job->log != NULL && fscanf(job->log, "%lu", &seq) == 1 && seq <= job->since + 1;
+   if (job->log != NULL)
+   {
+      rewind(job->log);
+   }
+}
+
+typedef struct SearchJob
+{
+   const char *userDir;
+   const char *query;
+   int *numbers;
+   int count;
+} SearchJob;
+
+static void searchJob(void *data)
+{
+   SearchJob *job = data;
+   job->count = searchQuery(job->userDir, job->query, &job->numbers);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// funktion um den SEND command zu verarbeiten
+// format (Pro Version):
+// SEND
+// <Receiver>
+// <Subject>
+// <message>
+// .
+// Sender wird automatisch aus Session gesetzt
+int handleSend(int socket, const ProtocolRequest *request)
+{
+   const char *username = request->args[0]; // Länge schon laut Tabelle geprüft
+   const char *subject = request->args[1];
+   const char *message = request->body;     // schon von readRequest() gelesen
+   char userDir[256];
+   TraceSpan span;
+
+   // Sender wird automatisch aus Session genommen
+   LOG_DEBUG("Sender (from session): %s", sessionUsername);
+
+   // prüft ob receiver nur a-z und 0-9 enthält
+   if (!isValidUsername(username))
+   {
+      LOG_WARN("Invalid receiver: only lowercase letters (a-z) and digits (0-9) allowed");
+      return -1;
+   }
+
+   LOG_DEBUG("Receiver: %s", username);
+   LOG_DEBUG("Subject: %s", subject);
+
+   // Falls Benutzerverzeichnis noch nicht existiert, wird es erstellt
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, username);
+
+   // Größe der Datei wie sie geschrieben wird (für die Quota)
+   StoreJob job = {userDir, sessionUsername, username, subject, message,
+                   strlen(sessionUsername) + strlen(username) + strlen(subject) + request->bodyLength + 4, -1, ""};
+
+   span = traceBegin("disk.store");
+   diskRun(storeJob, &job);
+   traceEnd(&span);
+   if (job.number == MAILBOX_OVER_QUOTA)
+   {
+      LOG_WARN("Quota exceeded for %s, message from %s rejected", username, sessionUsername);
+      return -1;
+   }
+   if (job.number == -1)
+   {
+      return -1;
+   }
+
+   // erst jetzt sichtbar, LIST/SYNC sehen die Nachricht ganz oder gar nicht
+   span = traceBegin("disk.commit");
+   if (mailboxLockExclusive(userDir) == -1)
+   {
+      unlink(job.tmpPath);
+      mailboxReleaseUsage(userDir, 1, job.fileSize);
+      traceEnd(&span);
+      return -1;
+   }
+   diskRun(commitJob, &job);
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   if (job.number == -1)
+   {
+      return -1;
+   }
+   notifyMailbox(username); // Sessions in IDLE aufwecken
+
+   span = traceBegin("net.reply");
+   int sent = writen(socket, "OK\n", 3);
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send OK failed");
+      return -1;
+   }
+
+   return 0;
+}
+
+// Funktion um den LIST command zu verarbeiten
+// Format (Pro Version):
+// LIST
+// (kein username mehr, wird aus Session genommen)
+//
+// Response:
+// count
+// subject1
+// subject2
+int handleList(int socket, const ProtocolRequest *request)
+{
+   char userDir[512];
+   Output out;
+   TraceSpan span;
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   // Username wird aus Session genommen
+   LOG_DEBUG("LIST command for user (from session): %s", sessionUsername);
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+   ListJob job = {userDir, NULL, 0, 0, &out};
+
+   // count und Subjects unter derselben Sperre, geschickt wird erst danach
+   if (mailboxLockShared(userDir) == -1)
+   {
+      return -1;
+   }
+   span = traceBegin("disk.scan");
+   diskRun(countJob, &job);
+   traceEnd(&span);
+   if (job.count == -1)
+   {
+      mailboxUnlock(userDir);
+      // Benutzerverzeichnis existiert nicht, 0 Nachrichten zurückgeben
+      LOG_DEBUG("User directory not found, returning 0 messages");
+      if (writen(socket, "0\n", 2) == -1)
+      {
+         LOG_ERRNO("send 0 count failed");
+         return -1;
+      }
+      return 0;
+   }
+
+   LOG_DEBUG("Found %d messages for user %s", job.count, sessionUsername);
+
+   // erstellt response mit count, Subjects blockweise aus dem Disk-Pool
+   out.length = snprintf(out.data, RESPONSE_SIZE, "%d\n", job.count);
+   span = traceBegin("disk.read_subjects");
+   int result = 0;
+   while (result == 0 && job.done == 0)
+   {
+      result = outputMakeRoom(-1, &out);
+      if (result == 0)
+      {
+         diskRun(listJob, &job);
+      }
+   }
+   if (job.dir != NULL)
+   {
+      closedir(job.dir);
+   }
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   if (result == -1 || job.done == -1)
+   {
+      return -1;
+   }
+
+   span = traceBegin("net.reply");
+   result = outputFlush(socket, &out);
+   traceEnd(&span);
+
+   if (result == -1)
+   {
+      LOG_ERRNO("send LIST response failed");
+      return -1;
+   }
+
+   LOG_DEBUG("LIST response sent (%d messages)", job.count);
+   return 0;
+}
+
+// "3", "1-500" oder "3,7,9" (auch gemischt, z.B. "1-3,7")
+// Rückgabe: Anzahl der Bereiche oder -1 bei ungültiger Eingabe
+static int parseNumberSet(const char *text, NumberRange *ranges, int maxRanges)
+{
+   int count = 0;
+   char *end;
+
+   while (1)
+   {
+      if (count == maxRanges || *text < '0' || *text > '9')
+      {
+         return -1;
+      }
+      long from = strtol(text, &end, 10);
+      long to = from;
+      if (*end == '-')
+      {
+         text = end + 1;
+         if (*text < '0' || *text > '9')
+         {
+            return -1;
+         }
+         to = strtol(text, &end, 10);
+      }
+      if (from <= 0 || to < from || to > INT_MAX)
+      {
+         return -1;
+      }
+      ranges[count].from = (int)from;
+      ranges[count].to = (int)to;
+      count++;
+
+      if (*end == '\0')
+      {
+         return count;
+      }
+      if (*end != ',')
+      {
+         return -1;
+      }
+      text = end + 1;
+   }
+}
+
+static int inNumberSet(const NumberRange *ranges, int count, int number)
+{
+   for (int i = 0; i < count; i++)
+   {
+      if (number >= ranges[i].from && number <= ranges[i].to)
+      {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+// READ <n> HEADER: "OK <body-size>", sender, receiver, subject, "."
+// READ <n> RANGE <offset> <length>: "OK <body-size> <offset> <length>" und
+// danach genau <length> Bytes des Bodys (ohne end marker, der Body kann an
+// beliebiger Stelle abgeschnitten sein). offset/length werden auf den Body
+// begrenzt, damit kann ein Client z.B. einen abgebrochenen Download fortsetzen.
+static int readPartial(int socket, const char *userDir, int number, const char *variant)
+{
+   char *response = arenaAlloc(&commandArena, RESPONSE_SIZE);
+   int responseLen;
+   long offset;
+   long length;
+   PartialJob job;
+   TraceSpan span;
+
+   // Header sind die ersten drei Zeilen, der Rest ist der Body
+   job.headers = arenaAlloc(&commandArena, 3 * BUF);
+   if (response == NULL || job.headers == NULL)
+   {
+      LOG_ERROR("Out of memory");
+      return -1;
+   }
+
+   snprintf(job.filePath, sizeof(job.filePath), "%s/%d.txt", userDir, number);
+   span = traceBegin("disk.fopen");
+   if (mailboxLockShared(userDir) == -1)
+   {
+      traceEnd(&span);
+      return -1;
+   }
+   diskRun(openPartialJob, &job); // danach reicht die offene Datei
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   if (job.result == -1)
+   {
+      LOG_ERRNO("fopen failed");
+      return -1;
+   }
+   long bodySize = job.bodySize;
+
+   int result = 0;
+   span = traceBegin("disk.read+net.reply");
+   if (strcmp(variant, "HEADER") == 0)
+   {
+      responseLen = snprintf(response, RESPONSE_SIZE, "OK %ld\n%s%s%s.\n",
+                             bodySize, job.headers[0], job.headers[1], job.headers[2]);
+      result = writen(socket, response, responseLen) == -1 ? -1 : 0;
+   }
+   else if (sscanf(variant, "RANGE %ld %ld", &offset, &length) == 2 && offset >= 0 && length >= 0)
+   {
+      if (offset > bodySize)
+      {
+         offset = bodySize;
+      }
+      if (length > bodySize - offset)
+      {
+         length = bodySize - offset;
+      }
+
+      responseLen = snprintf(response, RESPONSE_SIZE, "OK %ld %ld %ld\n", bodySize, offset, length);
+      job.offset = offset;
+      while (result == 0 && length > 0)
+      {
+         job.buffer = response + responseLen;
+         job.chunk = RESPONSE_SIZE - responseLen;
+         if ((long)job.chunk > length)
+         {
+            job.chunk = length;
+         }
+         diskRun(rangeJob, &job);
+         if (job.result == -1)
+         {
+            LOG_ERROR("Short read in %s", job.filePath);
+            result = -1;
+            break;
+         }
+         job.offset += job.chunk;
+         length -= job.chunk;
+         result = writen(socket, response, responseLen + job.chunk) == -1 ? -1 : 0;
+         responseLen = 0;
+      }
+      if (result == 0 && responseLen > 0)
+      {
+         result = writen(socket, response, responseLen) == -1 ? -1 : 0; // nur die OK-Zeile (length 0)
+      }
+   }
+   else
+   {
+      LOG_WARN("Invalid READ variant: %s", variant);
+      result = -1;
+   }
+   traceEnd(&span);
+   fclose(job.file);
+
+   if (result == -1)
+   {
+      LOG_ERRNO("READ %d %s failed", number, variant);
+      return -1;
+   }
+   LOG_DEBUG("READ %d %s sent (user: %s)", number, variant, sessionUsername);
+   return 0;
+}
+
+// READ command handler
+// Format (Pro Version): READ\nmessage-number\n
+// Username wird aus Session genommen
+// Batch: statt der Nummer eine Liste/Bereich (z.B. "3,7,9" oder "1-500"),
+// Response: OK <count>, dann pro Nachricht: number, Inhalt, "."
+// Teil-READ: "<n> HEADER" bzw. "<n> RANGE <offset> <length>", siehe readPartial()
+int handleRead(int socket, const ProtocolRequest *request)
+{
+   char *argument = request->args[0];
+   char userDir[300];
+   Output out;
+   NumberRange ranges[MAX_RANGES];
+   int rangeCount;
+   int *numbers = NULL;
+   int count = 0;
+   TraceSpan span;
+
+   LOG_DEBUG("READ command for user (from session): %s", sessionUsername);
+
+   // Receive message number(s)
+   // Teil-READ: "<n> HEADER" oder "<n> RANGE <offset> <length>"
+   char *variant = strchr(argument, ' ');
+   if (variant != NULL)
+   {
+      *variant++ = '\0';
+   }
+
+   rangeCount = parseNumberSet(argument, ranges, MAX_RANGES);
+   if (rangeCount == -1)
+   {
+      LOG_WARN("Invalid message number: %s", argument);
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+
+   if (variant != NULL)
+   {
+      if (strpbrk(argument, ",-") != NULL)
+      {
+         LOG_WARN("READ %s only for single messages", variant);
+         return -1;
+      }
+      return readPartial(socket, userDir, ranges[0].from, variant);
+   }
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   // einzelne Nummer: altes Format "OK", Inhalt, "."
+   if (strpbrk(argument, ",-") == NULL)
+   {
+      span = traceBegin("disk.read+net.reply");
+      out.length = snprintf(out.data, RESPONSE_SIZE, "OK\n");
+      int result = sendMessage(socket, userDir, ranges[0].from, &out);
+      if (result == 0)
+      {
+         result = outputAppend(socket, &out, ".\n");
+      }
+      if (result == 0)
+      {
+         result = outputFlush(socket, &out);
+      }
+      traceEnd(&span);
+
+      if (result == -1)
+      {
+         LOG_ERRNO("READ %d failed", ranges[0].from);
+         return -1;
+      }
+      LOG_DEBUG("Message %d sent to client (user: %s)", ranges[0].from, sessionUsername);
+      return 0;
+   }
+
+   // Batch: "OK <count>", dann pro Nachricht Nummer, Inhalt, "."
+   span = traceBegin("disk.scan");
+   int total = scanInPool(userDir, &numbers);
+   traceEnd(&span);
+   if (total == -1)
+   {
+      return -1;
+   }
+   for (int i = 0; i < total; i++)
+   {
+      if (inNumberSet(ranges, rangeCount, numbers[i]))
+      {
+         numbers[count++] = numbers[i];
+      }
+   }
+   if (count == 0)
+   {
+      LOG_DEBUG("READ %s: no such messages", argument);
+      free(numbers);
+      return -1;
+   }
+
+   span = traceBegin("disk.read+net.reply");
+   out.length = snprintf(out.data, RESPONSE_SIZE, "OK %d\n", count);
+   int result = 0;
+   for (int i = 0; i < count && result == 0; i++)
+   {
+      char header[16];
+
+      snprintf(header, sizeof(header), "%d\n", numbers[i]);
+      result = outputAppend(socket, &out, header);
+      // inzwischen gelöscht -> leerer Inhalt, die Anzahl stimmt trotzdem
+      if (result == 0 && sendMessage(socket, userDir, numbers[i], &out) == -1 && errno != ENOENT)
+      {
+         result = -1;
+      }
+      if (result == 0)
+      {
+         result = outputAppend(socket, &out, ".\n");
+      }
+   }
+   if (result == 0)
+   {
+      result = outputFlush(socket, &out);
+   }
+   traceEnd(&span);
+   free(numbers);
+
+   if (result == -1)
+   {
+      LOG_ERRNO("send READ response failed");
+      return -1;
+   }
+   LOG_DEBUG("%d messages sent to client (user: %s)", count, sessionUsername);
+   return 0;
+}
+
+// DEL command handler
+// Format (Pro Version): DEL\nmessage-number\n
+// Username wird aus Session genommen
+// Batch wie bei READ ("1-500"), Response: OK <anzahl gelöschter Nachrichten>
+int handleDel(int socket, const ProtocolRequest *request)
+{
+   char *argument = request->args[0];
+   char response[64];
+   char userDir[300];
+   NumberRange ranges[MAX_RANGES];
+   int rangeCount;
+   int *numbers = NULL;
+   int count = 0;
+   int size;
+   TraceSpan span;
+
+   LOG_DEBUG("DEL command for user (from session): %s", sessionUsername);
+
+   rangeCount = parseNumberSet(argument, ranges, MAX_RANGES);
+   if (rangeCount == -1)
+   {
+      LOG_WARN("Invalid message number: %s", argument);
+      return -1;
+   }
+   int batch = strpbrk(argument, ",-") != NULL;
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+
+   if (!batch)
+   {
+      numbers = malloc(sizeof(int));
+      if (numbers == NULL)
+      {
+         LOG_ERROR("Out of memory in DEL");
+         return -1;
+      }
+      numbers[0] = ranges[0].from;
+      count = 1;
+      if (mailboxLockExclusive(userDir) == -1)
+      {
+         free(numbers);
+         return -1;
+      }
+   }
+   else
+   {
+      // nur vorhandene Nachrichten, auch bei großen Bereichen wie 1-100000
+      if (mailboxLockExclusive(userDir) == -1)
+      {
+         return -1;
+      }
+      span = traceBegin("disk.scan");
+      int total = scanInPool(userDir, &numbers);
+      traceEnd(&span);
+      if (total == -1)
+      {
+         mailboxUnlock(userDir);
+         return -1;
+      }
+      for (int i = 0; i < total; i++)
+      {
+         if (inNumberSet(ranges, rangeCount, numbers[i]))
+         {
+            numbers[count++] = numbers[i];
+         }
+      }
+   }
+
+   DeleteJob job = {userDir, numbers, count, batch, 0};
+   span = traceBegin("disk.tombstone");
+   diskRun(deleteJob, &job);
+   traceEnd(&span);
+   mailboxUnlock(userDir);
+   free(numbers);
+
+   if (job.deleted == 0)
+   {
+      LOG_DEBUG("DEL %s: no such messages", argument);
+      return -1;
+   }
+
+   LOG_INFO("%d message(s) deleted for user %s", job.deleted, sessionUsername);
+   notifyMailbox(sessionUsername); // andere Sessions desselben Users
+
+   // Send OK (Batch mit Anzahl) wenn es funktioniert hat
+   size = batch ? snprintf(response, sizeof(response), "OK %d\n", job.deleted)
+                : snprintf(response, sizeof(response), "OK\n");
+   span = traceBegin("net.reply");
+   int sent = writen(socket, response, size);
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send OK failed");
+      return -1;
+   }
+
+   return 0;
+}
+
+// INDEX command handler
+// wie LIST, aber mit Nachrichtennummern (aufsteigend), die man für READ/DEL
+// braucht (z.B. für den Export im Client)
+// Response:
+// count
+// number subject
+int handleIndex(int socket, const ProtocolRequest *request)
+{
+   char userDir[512];
+   Output out;
+   int *numbers = NULL;
+   int count;
+   TraceSpan span;
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+
+   // Nummern aller Nachrichten sammeln
+   if (mailboxLockShared(userDir) == -1)
+   {
+      return -1;
+   }
+   span = traceBegin("disk.scan");
+   count = scanInPool(userDir, &numbers);
+   traceEnd(&span);
+   if (count == -1)
+   {
+      mailboxUnlock(userDir);
+      return -1;
+   }
+
+   // subjects unter der Sperre sammeln, danach schicken
+   span = traceBegin("disk.read_subjects");
+   out.length = snprintf(out.data, RESPONSE_SIZE, "%d\n", count);
+   int result = sendSubjects(-1, userDir, numbers, count, "", &out);
+   free(numbers);
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   if (result == -1)
+   {
+      return -1;
+   }
+
+   span = traceBegin("net.reply");
+   result = outputFlush(socket, &out);
+   traceEnd(&span);
+   if (result == -1)
+   {
+      LOG_ERRNO("send INDEX response failed");
+      return -1;
+   }
+
+   LOG_DEBUG("INDEX response sent (%d messages)", count);
+   return 0;
+}
+
+// STAT command handler
+// Format: STAT\nmessage-number\n
+// Response: OK <uidvalidity> <size> bzw. ERR wenn es die Nachricht nicht gibt
+// damit kann der Client eine gecachte Nachricht ohne READ revalidieren
+int handleStat(int socket, const ProtocolRequest *request)
+{
+   char response[64];
+   char userDir[300];
+   StatJob job;
+   int size;
+   TraceSpan span;
+
+   if (protocolParseNumber(request->args[0], &job.number) == -1)
+   {
+      LOG_WARN("Invalid message number: %s", request->args[0]);
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+   job.userDir = userDir;
+
+   span = traceBegin("disk.stat");
+   if (mailboxLockShared(userDir) == -1)
+   {
+      traceEnd(&span);
+      return -1;
+   }
+   diskRun(statJob, &job);
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   if (!job.found)
+   {
+      LOG_DEBUG("STAT %d: message not found", job.number);
+      return -1;
+   }
+
+   size = snprintf(response, sizeof(response), "OK %lu %ld\n", job.meta.uidValidity, (long)job.info.st_size);
+
+   span = traceBegin("net.reply");
+   int sent = writen(socket, response, size);
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send STAT response failed");
+      return -1;
+   }
+   return 0;
+}
+
+// SYNC command handler
+// Request: "<uidvalidity> <modseq>" (beim ersten Mal "0 0")
+// Response:
+// OK <uidvalidity> <modseq> DELTA|FULL
+// + number subject   (neue Nachricht)
+// - number           (gelöschte Nachricht)
+// .
+// DELTA enthält nur die Änderungen seit der modSeq des Clients, FULL (bei
+// anderer uidvalidity oder zu alter modSeq) alle aktuellen Nachrichten
+int handleSync(int socket, const ProtocolRequest *request)
+{
+   char *watermark = request->args[0];
+   char userDir[512];
+   char logPath[600];
+   Output out;
+   unsigned long clientValidity;
+   unsigned long clientSeq;
+   MailboxMeta meta;
+   LogJob logCheck = {logPath, 0, NULL, 0};
+   int full;
+   int count = 0;
+   TraceSpan span;
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   if (sscanf(watermark, "%lu %lu", &clientValidity, &clientSeq) != 2)
+   {
+      LOG_WARN("Invalid SYNC watermark: %s", watermark);
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+   snprintf(logPath, sizeof(logPath), "%s/.changes", userDir);
+
+   // .meta, .changes und die Nachrichten müssen zusammenpassen
+   if (mailboxLockShared(userDir) == -1)
+   {
+      return -1;
+   }
+   span = traceBegin("disk.sync_meta");
+   if (loadMetaInPool(userDir, &meta) == -1)
+   {
+      mailboxUnlock(userDir);
+      traceEnd(&span);
+      return -1;
+   }
+
+   full = clientValidity != meta.uidValidity || clientSeq > meta.modSeq;
+   if (!full && clientSeq < meta.modSeq)
+   {
+      // Log muss bis clientSeq + 1 zurückreichen, sonst FULL
+      logCheck.since = clientSeq;
+      diskRun(logJob, &logCheck);
+      full = !logCheck.complete;
+   }
+
+   // FULL: Subjects unter der Sperre sammeln
+   out.length = snprintf(out.data, RESPONSE_SIZE, "OK %lu %lu %s\n",
+                         meta.uidValidity, meta.modSeq, full ? "FULL" : "DELTA");
+   if (full)
+   {
+      int *numbers;
+      int total = scanInPool(userDir, &numbers);
+
+      if (logCheck.log != NULL)
+      {
+         fclose(logCheck.log);
+      }
+      count = total;
+      if (total != -1 && sendSubjects(-1, userDir, numbers, total, "+ ", &out) == -1)
+      {
+         count = -1;
+      }
+      free(numbers);
+   }
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+
+   // DELTA ohne Sperre: .changes ist schon offen und die Einträge bis
+   // meta.modSeq ändern sich nicht mehr
+   span = traceBegin("disk.sync+net.reply");
+   if (!full && logCheck.log != NULL)
+   {
+      count = sendChanges(socket, logPath, logCheck.log, clientSeq, meta.modSeq, &out);
+   }
+
+   int sent = count == -1 ? -1 : outputAppend(socket, &out, ".\n");
+   if (sent != -1)
+   {
+      sent = outputFlush(socket, &out);
+   }
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send SYNC response failed");
+      return -1;
+   }
+
+   LOG_DEBUG("SYNC %s sent (%d changes since %lu)", full ? "FULL" : "DELTA", count, clientSeq);
+   return 0;
+}
+
+// IDLE command handler
+// parkt die Session bis der Client DONE schickt, Änderungen am Postfach
+// werden sofort im SYNC-Format gepusht (statt LIST/SYNC zu pollen)
+// Response:
+// OK
+// + number subject / - number   (sobald etwas zugestellt/gelöscht wird)
+// .                             (nach DONE, idle_timeout oder wenn
+//                                .changes gekürzt wurde, dann SYNC)
+int handleIdle(int socket, const ProtocolRequest *request)
+{
+   char buffer[BUF];
+   char userDir[512];
+   char logPath[600];
+   Output out;
+   MailboxMeta meta;
+   unsigned long seenSeq;
+   Waiter waiter;
+   struct pollfd fds[2];
+   time_t deadline;
+   int result = 0;
+   int size;
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+   snprintf(logPath, sizeof(logPath), "%s/.changes", userDir);
+
+   if (loadMetaInPool(userDir, &meta) == -1)
+   {
+      return -1;
+   }
+   seenSeq = meta.modSeq;
+
+   // vor dem OK registrieren, damit keine Zustellung verloren geht
+   if (notifyRegister(&waiter, sessionUsername) == -1)
+   {
+      return -1;
+   }
+   if (writen(socket, "OK\n", 3) == -1)
+   {
+      LOG_ERRNO("send OK failed");
+      notifyUnregister(&waiter);
+      return -1;
+   }
+   LOG_DEBUG("%s is idling", sessionUsername);
+
+   fds[0].fd = socket;
+   fds[0].events = POLLIN;
+   fds[1].fd = waiter.pipe[0];
+   fds[1].events = POLLIN;
+   deadline = time(NULL) + serverConfig.idleTimeout;
+
+   while (1)
+   {
+      int timeout = -1; // idle_timeout = 0 -> ohne Timeout
+      if (serverConfig.idleTimeout > 0)
+      {
+         timeout = (int)(deadline - time(NULL)) * 1000;
+         if (timeout <= 0)
+         {
+            LOG_DEBUG("IDLE timeout for %s", sessionUsername);
+            break;
+         }
+      }
+
+      if (poll(fds, 2, timeout) == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         LOG_ERRNO("poll failed");
+         result = -1;
+         break;
+      }
+
+      if (fds[1].revents & POLLIN)
+      {
+         notifyDrain(&waiter);
+         if (loadMetaInPool(userDir, &meta) == 0 && meta.modSeq > seenSeq)
+         {
+            // .changes inzwischen über seenSeq hinaus gekürzt: IDLE beenden,
+            // der Client holt sich den Stand dann mit SYNC (FULL)
+            LogJob logCheck = {logPath, seenSeq, NULL, 0};
+            diskRun(logJob, &logCheck);
+            if (!logCheck.complete)
+            {
+               if (logCheck.log != NULL)
+               {
+                  fclose(logCheck.log);
+               }
+               LOG_INFO("IDLE for %s ended, change log no longer reaches modseq %lu",
+                        sessionUsername, seenSeq);
+               break;
+            }
+
+            TraceSpan span = traceBegin("idle.push");
+            int count = sendChanges(socket, logPath, logCheck.log, seenSeq, meta.modSeq, &out);
+            if (count == -1 || outputFlush(socket, &out) == -1)
+            {
+               LOG_ERRNO("send IDLE notification failed");
+               traceEnd(&span);
+               result = -1;
+               break;
+            }
+            traceEnd(&span);
+            LOG_DEBUG("IDLE pushed %d changes to %s", count, sessionUsername);
+            seenSeq = meta.modSeq;
+         }
+      }
+
+      if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+      {
+         size = readline(socket, buffer, BUF - 1);
+         if (size <= 0)
+         {
+            result = -1; // Client ist weg
+            break;
+         }
+         buffer[strcspn(buffer, "\r\n")] = '\0';
+         if (strcmp(buffer, "DONE") != 0)
+         {
+            LOG_WARN("Expected DONE during IDLE, got: %s", buffer);
+         }
+         break;
+      }
+   }
+   notifyUnregister(&waiter);
+
+   if (result == -1 || writen(socket, ".\n", 2) == -1)
+   {
+      return -1;
+   }
+   return 0;
+}
+
+// SEARCH command handler
+// Request: Suchwörter in einer Zeile, gefunden wird was alle Wörter in
+// Sender, Subject oder Body enthält (Groß-/Kleinschreibung egal)
+// Response wie INDEX:
+// count
+// number subject
+int handleSearch(int socket, const ProtocolRequest *request)
+{
+   char *query = request->args[0];
+   char userDir[512];
+   Output out;
+   TraceSpan span;
+
+   if (outputAlloc(&out) == -1)
+   {
+      return -1;
+   }
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, sessionUsername);
+   SearchJob job = {userDir, query, NULL, 0};
+
+   if (mailboxLockShared(userDir) == -1)
+   {
+      return -1;
+   }
+   span = traceBegin("search.query");
+   diskRun(searchJob, &job);
+   traceEnd(&span);
+   if (job.count == -1)
+   {
+      mailboxUnlock(userDir);
+      LOG_WARN("SEARCH failed for query: %s", query);
+      return -1;
+   }
+
+   // subjects unter der Sperre sammeln, danach schicken
+   span = traceBegin("disk.read_subjects");
+   out.length = snprintf(out.data, RESPONSE_SIZE, "%d\n", job.count);
+   int result = sendSubjects(-1, userDir, job.numbers, job.count, "", &out);
+   mailboxUnlock(userDir);
+   traceEnd(&span);
+   free(job.numbers);
+   if (result == -1)
+   {
+      return -1;
+   }
+
+   span = traceBegin("net.reply");
+   result = outputFlush(socket, &out);
+   traceEnd(&span);
+   if (result == -1)
+   {
+      LOG_ERRNO("send SEARCH response failed");
+      return -1;
+   }
+
+   LOG_DEBUG("SEARCH '%s': %d messages", query, job.count);
+   return 0;
+}
+
+// STATS command handler (nur für Admins laut stats_admins)
+// Response: OK, Stats im Prometheus Text-Format, "."
+int handleStats(int socket, const ProtocolRequest *request)
+{
+   size_t length;
+   char *text;
+   TraceSpan span;
+
+   if (!statsIsAdmin(sessionUsername))
+   {
+      LOG_WARN("STATS rejected - %s is not an admin", sessionUsername);
+      return -1;
+   }
+
+   span = traceBegin("stats.format");
+   text = statsFormat(&length);
+   traceEnd(&span);
+   if (text == NULL)
+   {
+      LOG_ERROR("Could not format stats");
+      return -1;
+   }
+
+   span = traceBegin("net.reply");
+   int sent = 0;
+   if (writen(socket, "OK\n", 3) == -1 ||
+       writen(socket, text, length) == -1 ||
+       writen(socket, ".\n", 2) == -1)
+   {
+      sent = -1;
+   }
+   traceEnd(&span);
+
+   if (sent == -1)
+   {
+      LOG_ERRNO("send STATS response failed");
+      free(text);
+      return -1;
+   }
+
+   free(text);
+   return 0;
+}
+
+// readline() - Stevens Implementation from PDF
+ssize_t readline(int fd, void *vptr, size_t maxlen)
+{
+   ssize_t n, rc;
+   char c, *ptr;
+
+   ptr = vptr;
+   for (n = 1; n < maxlen; n++)
+   {
+   again:
+      if ((rc = read(fd, &c, 1)) == 1)
+      {
+         *ptr++ = c;
+         if (c == '\n')
+            break; // newline is stored, like fgets()
+      }
+      else if (rc == 0)
+      {
+         if (n == 1)
+            return (0); // EOF, no data read
+         else
+            break; // EOF, some data was read
+      }
+      else
+      {
+         if (errno == EINTR)
+            goto again;
+         return (-1); // error, errno set by read()
+      }
+   }
+
+   *ptr = 0; // null terminate like fgets()
+   statsBytesIn += (ptr - (char *)vptr);
+   return (n);
+}
+
+// writen() - Stevens Implementation, schreibt alle n Bytes (send() kann
+// bei großen Antworten auch nur einen Teil schreiben)
+ssize_t writen(int fd, const void *vptr, size_t n)
+{
+   size_t nleft;
+   ssize_t nwritten;
+   const char *ptr;
+
+   // getaggter Command: Antwort als Frame (tagged.h)
+   if (taggedReplying())
+   {
+      return taggedWrite(vptr, n);
+   }
+
+   ptr = vptr;
+   nleft = n;
+   while (nleft > 0)
+   {
+      // kein SIGPIPE, wenn der Client die Verbindung schon geschlossen hat
+      if ((nwritten = send(fd, ptr, nleft, MSG_NOSIGNAL)) <= 0)
+      {
+         if (nwritten < 0 && errno == EINTR)
+            nwritten = 0; // and call send() again
+         else
+            return (-1); // error
+      }
+
+      nleft -= nwritten;
+      ptr += nwritten;
+   }
+
+   statsBytesOut += n;
+   return (n);
+}
@@ -0,0 +1,47 @@
+#ifndef TWMAILER_COMMANDS_H
+#define TWMAILER_COMMANDS_H
+
+#include <sys/types.h>
+#include "arena.h"
+#include "protocol.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Command-Handler des Servers und die Socket-Hilfsfunktionen
+// eigenes Modul, damit der Micro-Benchmark die Handler ohne main() und
+// ohne Netzwerk-Setup direkt aufrufen kann
+
+#define BUF 1024
+
+extern char *mailSpoolDir;
+
+// Session-Daten (pro Thread, jede Client-Verbindung hat einen eigenen)
+extern __thread int isAuthenticated;
+extern __thread char sessionUsername[256];
+extern __thread Arena commandArena;
+
+// Handler pro Command, die Argument-Zeilen hat readRequest() schon gelesen
+typedef int (*CommandHandler)(int socket, const ProtocolRequest *request);
+extern const CommandHandler commandHandlers[COMMAND_OTHER];
+
+///////////////////////////////////////////////////////////////////////////////
+
+int readRequest(int socket, const ProtocolCommand *command, ProtocolRequest *request);
+int handleLogin(int socket, const ProtocolRequest *request);
+int handleResume(int socket, const ProtocolRequest *request);
+int sendLoginOk(int socket, time_t issued);
+int handleSend(int socket, const ProtocolRequest *request);
+int handleList(int socket, const ProtocolRequest *request);
+int handleRead(int socket, const ProtocolRequest *request);
+int handleDel(int socket, const ProtocolRequest *request);
+int handleStats(int socket, const ProtocolRequest *request);
+int handleIndex(int socket, const ProtocolRequest *request);
+int handleStat(int socket, const ProtocolRequest *request);
+int handleSync(int socket, const ProtocolRequest *request);
+int handleIdle(int socket, const ProtocolRequest *request);
+int handleSearch(int socket, const ProtocolRequest *request);
+int getNextMessageNumber(const char *userDir);
+ssize_t readline(int fd, void *buffer, size_t n);
+ssize_t writen(int fd, const void *buffer, size_t n);
+
+#endif
@@ -0,0 +1,229 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define CONFIG_STRING 0
+#define CONFIG_INT 1
+
+ServerConfig serverConfig;
+
+// Tabelle aller bekannten Keys -> Feld in ServerConfig
+typedef struct ConfigEntry
+{
+   const char *key;
+   int type;
+   size_t offset;
+   size_t size; // nur für Strings
+} ConfigEntry;
+
+#define CONFIG_STR(key, field) \
+   {key, CONFIG_STRING, offsetof(ServerConfig, field), sizeof(((ServerConfig *)0)->field)}
+#define CONFIG_NUM(key, field) \
+   {key, CONFIG_INT, offsetof(ServerConfig, field), sizeof(int)}
+
+static const ConfigEntry configEntries[] = {
+    CONFIG_STR("auth_backend", authBackend),
+    CONFIG_STR("auth_file", authFile),
+    CONFIG_NUM("auth_mock_latency_ms", authMockLatencyMs),
+    CONFIG_STR("ldap_uri", ldapUri),
+    CONFIG_STR("ldap_bind_dn", ldapBindDn),
+    CONFIG_NUM("ldap_start_tls", ldapStartTls),
+    CONFIG_NUM("session_token_ttl", sessionTokenTtl),
+    CONFIG_NUM("session_max_age", sessionMaxAge),
+    CONFIG_STR("session_secret_file", sessionSecretFile),
+    CONFIG_STR("log_level", logLevelName),
+    CONFIG_STR("log_file", logFile),
+    CONFIG_NUM("log_ring_size", logRingSize),
+    CONFIG_STR("stats_admins", statsAdmins),
+    CONFIG_STR("stats_file", statsFile),
+    CONFIG_NUM("stats_interval", statsInterval),
+    CONFIG_STR("trace_file", traceFile),
+    CONFIG_NUM("trace_sample_rate", traceSampleRate),
+    CONFIG_NUM("idle_timeout", idleTimeout),
+    CONFIG_NUM("search_cache_size", searchCacheSize),
+    CONFIG_NUM("max_message_size", maxMessageSize),
+    CONFIG_NUM("quota_messages", quotaMessages),
+    CONFIG_NUM("quota_kbytes", quotaKbytes),
+    CONFIG_NUM("retention_days", retentionDays),
+    CONFIG_NUM("retention_max_messages", retentionMaxMessages),
+    CONFIG_STR("retention_file", retentionFile),
+    CONFIG_NUM("retention_interval", retentionInterval),
+    CONFIG_NUM("retention_batch", retentionBatch),
+    CONFIG_NUM("reclaim_batch", reclaimBatch),
+    CONFIG_NUM("disk_threads", diskThreads),
+    CONFIG_NUM("disk_queue_size", diskQueueSize),
+    CONFIG_NUM("command_threads", commandThreads),
+    CONFIG_NUM("tagged_max_inflight", taggedMaxInFlight),
+    CONFIG_NUM("tagged_output_kbytes", taggedOutputKbytes),
+    CONFIG_NUM("max_connections", maxConnections),
+    CONFIG_NUM("max_inflight", maxInFlight),
+    CONFIG_NUM("listen_backlog", listenBacklog),
+    CONFIG_NUM("user_rate_limit", userRateLimit),
+    CONFIG_NUM("user_rate_burst", userRateBurst),
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Default-Werte entsprechen dem bisherigen (hard-coded) Verhalten
+void configDefaults(ServerConfig *cfg)
+{
+   memset(cfg, 0, sizeof(*cfg));
+   strcpy(cfg->authBackend, "ldap");
+   strcpy(cfg->ldapUri, "ldap://ldap.technikum-wien.at:389");
+   strcpy(cfg->ldapBindDn, "uid=%s,ou=people,dc=technikum-wien,dc=at");
+   cfg->ldapStartTls = 1;
+   cfg->authMockLatencyMs = 0;
+   cfg->sessionTokenTtl = 24 * 60 * 60;
+   cfg->sessionMaxAge = 7 * 24 * 60 * 60;
+   strcpy(cfg->logLevelName, "info");
+   cfg->logRingSize = 1024;
+   cfg->statsInterval = 10;
+   cfg->traceSampleRate = 100;
+   cfg->idleTimeout = 30 * 60;
+   cfg->searchCacheSize = 32;
+   cfg->maxMessageSize = 1024 * 1024;
+   cfg->retentionInterval = 60 * 60;
+   cfg->retentionBatch = 100;
+   cfg->reclaimBatch = 100;
+   cfg->diskThreads = 4;
+   cfg->diskQueueSize = 256;
+   cfg->commandThreads = 8;
+   cfg->taggedMaxInFlight = 16;
+   cfg->taggedOutputKbytes = 16 * 1024;
+   cfg->maxConnections = 1024;
+   cfg->maxInFlight = 256;
+   cfg->listenBacklog = 128;
+   cfg->userRateLimit = 0;
+   cfg->userRateBurst = 20;
+}
+
+// setzt einen einzelnen Wert, -1 bei unbekanntem Key oder ungültigem Wert
+int configSet(ServerConfig *cfg, const char *key, const char *value)
+{
+   for (size_t i = 0; i < sizeof(configEntries) / sizeof(configEntries[0]); i++)
+   {
+      const ConfigEntry *entry = &configEntries[i];
+      if (strcmp(entry->key, key) != 0)
+      {
+         continue;
+      }
+
+      char *field = (char *)cfg + entry->offset;
+      if (entry->type == CONFIG_STRING)
+      {
+         if (strlen(value) >= entry->size)
+         {
+            fprintf(stderr, "Config value too long for %s\n", key);
+            return -1;
+         }
+         strcpy(field, value);
+      }
+      else
+      {
+         char *end;
+         long number = strtol(value, &end, 10);
+         if (*value == '\0' || *end != '\0')
+         {
+            fprintf(stderr, "Config value for %s must be a number: %s\n", key, value);
+            return -1;
+         }
+         *(int *)field = (int)number;
+      }
+      return 0;
+   }
+
+   fprintf(stderr, "Unknown config key: %s\n", key);
+   return -1;
+}
+
+// "key=value" von der Kommandozeile (-o)
+int configSetOption(ServerConfig *cfg, const char *option)
+{
+   char key[64];
+   const char *equals = strchr(option, '=');
+
+   if (equals == NULL || equals == option || (size_t)(equals - option) >= sizeof(key))
+   {
+      fprintf(stderr, "Invalid option (expected key=value): %s\n", option);
+      return -1;
+   }
+
+   memcpy(key, option, equals - option);
+   key[equals - option] = '\0';
+   return configSet(cfg, key, equals + 1);
+}
+
+// Entfernt Leerzeichen am Anfang und Ende (in place)
+static char *trim(char *str)
+{
+   char *end;
+
+   while (isspace((unsigned char)*str))
+   {
+      str++;
+   }
+
+   end = str + strlen(str);
+   while (end > str && isspace((unsigned char)end[-1]))
+   {
+      end--;
+   }
+   *end = '\0';
+
+   return str;
+}
+
+// Config-Datei laden: eine "key = value" Zeile pro Eintrag, '#' für Kommentare
+int configLoad(ServerConfig *cfg, const char *path)
+{
+   char line[512];
+   int lineNum = 0;
+   FILE *file = fopen(path, "r");
+   if (file == NULL)
+   {
+      perror("fopen config failed");
+      return -1;
+   }
+
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      lineNum++;
+
+      char *comment = strchr(line, '#');
+      if (comment != NULL)
+      {
+         *comment = '\0';
+      }
+
+      char *key = trim(line);
+      if (*key == '\0')
+      {
+         continue; // leere Zeile
+      }
+
+      char *equals = strchr(key, '=');
+      if (equals == NULL)
+      {
+         fprintf(stderr, "%s:%d: expected key = value\n", path, lineNum);
+         fclose(file);
+         return -1;
+      }
+      *equals = '\0';
+
+      if (configSet(cfg, trim(key), trim(equals + 1)) == -1)
+      {
+         fprintf(stderr, "%s:%d: invalid config entry\n", path, lineNum);
+         fclose(file);
+         return -1;
+      }
+   }
+
+   fclose(file);
+   return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef TWMAILER_CONFIG_H
+#define TWMAILER_CONFIG_H
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Server-Konfiguration
+// wird aus einer "key = value" Datei (-c) und/oder -o key=value gesetzt
+typedef struct ServerConfig
+{
+   // Auth-Backend: "ldap", "file" oder "mock"
+   char authBackend[32];
+   char authFile[256];      // Passwort-Datei für das "file" Backend
+   int authMockLatencyMs;   // künstliche Verzögerung für das "mock" Backend
+
+   // LDAP
+   char ldapUri[256];
+   char ldapBindDn[256];    // DN Template, %s wird durch den Username ersetzt
+   int ldapStartTls;
+
+   // Session-Resumption (RESUME), Gültigkeit in Sekunden, 0 = deaktiviert
+   int sessionTokenTtl;
+   int sessionMaxAge;           // ab dem LOGIN, RESUME verlängert nicht
+   char sessionSecretFile[256]; // leer -> zufälliges Secret pro Serverstart
+
+   // Logging
+   char logLevelName[16];   // error, warn, info oder debug
+   char logFile[256];       // leer -> stdout
+   int logRingSize;         // Einträge pro Thread-Ringbuffer
+
+   // Statistiken (STATS Command und periodischer Dump)
+   char statsAdmins[256];   // Usernamen mit Zugriff auf STATS, durch ',' getrennt
+   char statsFile[256];     // leer -> kein Dump
+   int statsInterval;       // Sekunden zwischen zwei Dumps
+
+   // Tracing (Chrome Trace Format)
+   char traceFile[256];     // leer -> kein Tracing
+   int traceSampleRate;     // ca. jeder n-te Command wird aufgezeichnet
+
+   // IDLE: Sekunden ohne DONE bis der Server IDLE selbst beendet
+   int idleTimeout;
+
+   // SEARCH: so viele Postfach-Indizes bleiben im Speicher (LRU)
+   int searchCacheSize;
+
+   // SEND: maximale Größe des Nachrichtentexts in Bytes
+   int maxMessageSize;
+
+   // Quota pro Postfach, 0 = unbegrenzt
+   int quotaMessages;
+   int quotaKbytes;
+
+   // Retention (Hintergrund-Thread), 0 = kein Limit
+   int retentionDays;
+   int retentionMaxMessages;
+   char retentionFile[256];  // Regeln pro User, leer -> nur die globalen
+   int retentionInterval;    // Sekunden zwischen zwei Durchgängen
+   int retentionBatch;       // Nachrichten pro Block
+
+   // DEL: Tombstones, die der Reclaim-Thread pro Block löscht
+   int reclaimBatch;
+
+   // Disk-Pool: Worker-Threads für Spool-Zugriffe (0 = im Session-Thread)
+   // und Plätze in der Queue davor
+   int diskThreads;
+   int diskQueueSize;
+
+   // getaggte Commands: Worker für alle Verbindungen, max. gleichzeitige
+   // Commands pro Verbindung und max. noch nicht geschickte Antworten (KB)
+   int commandThreads;
+   int taggedMaxInFlight;
+   int taggedOutputKbytes;
+
+   // Admission Control (0 = kein Limit) und Backlog für listen()
+   int maxConnections;
+   int maxInFlight;
+   int listenBacklog;
+
+   // Rate-Limit pro User: Commands pro Sekunde (0 = aus) und Burst
+   int userRateLimit;
+   int userRateBurst;
+} ServerConfig;
+
+extern ServerConfig serverConfig;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void configDefaults(ServerConfig *cfg);
+int configSet(ServerConfig *cfg, const char *key, const char *value);
+int configSetOption(ServerConfig *cfg, const char *option);
+int configLoad(ServerConfig *cfg, const char *path);
+
+#endif
@@ -0,0 +1,182 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "diskpool.h"
+#include "sched.h"
+#include "commands.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define MAX_DISK_THREADS 64
+
+// liegt auf dem Stack des abgebenden Threads, bis done gesetzt ist
+typedef struct DiskJob
+{
+   FairItem item; // muss vorne stehen (Cast von fairPop())
+   DiskFunction function;
+   void *data;
+   int error; // errno nach dem Job
+   int done;
+   pthread_cond_t doneCond;
+} DiskJob;
+
+// eine Queue pro User (fair, siehe sched.h), insgesamt queueSize Plätze
+static FairQueue queue;
+static int queueSize = 0;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workers[MAX_DISK_THREADS];
+static int workerCount = 0;
+static int poolRunning = 0;
+static int poolStop = 0;
+
+// Jobs, die ein Worker selbst abgibt, laufen direkt (sonst Deadlock wenn
+// alle Worker aufeinander warten)
+static __thread int isDiskWorker = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void *diskWorker(void *data)
+{
+   (void)data;
+   isDiskWorker = 1;
+
+   pthread_mutex_lock(&queueMutex);
+   while (1)
+   {
+      if (queue.length == 0)
+      {
+         if (poolStop)
+         {
+            break; // erst aufhören wenn die Queue leer ist
+         }
+         pthread_cond_wait(&notEmpty, &queueMutex);
+         continue;
+      }
+
+      DiskJob *job = (DiskJob *)fairPop(&queue);
+      pthread_cond_signal(&notFull);
+      pthread_mutex_unlock(&queueMutex);
+
+      errno = 0;
+      job->function(job->data);
+      int error = errno;
+
+      pthread_mutex_lock(&queueMutex);
+      job->error = error;
+      job->done = 1;
+      pthread_cond_signal(&job->doneCond);
+   }
+   pthread_mutex_unlock(&queueMutex);
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int diskInit(const ServerConfig *cfg)
+{
+   int threads = cfg->diskThreads;
+
+   if (threads <= 0)
+   {
+      return 0; // disk_threads = 0 -> alles direkt im Session-Thread
+   }
+   if (threads > MAX_DISK_THREADS)
+   {
+      LOG_WARN("disk_threads limited to %d", MAX_DISK_THREADS);
+      threads = MAX_DISK_THREADS;
+   }
+
+   queueSize = cfg->diskQueueSize > 0 ? cfg->diskQueueSize : 256;
+   fairInit(&queue);
+   poolStop = 0;
+
+   for (workerCount = 0; workerCount < threads; workerCount++)
+   {
+      if (pthread_create(&workers[workerCount], NULL, diskWorker, NULL) != 0)
+      {
+         LOG_ERROR("Could not start disk thread");
+         diskShutdown();
+         return -1;
+      }
+   }
+   poolRunning = 1;
+
+   LOG_INFO("Disk pool: %d threads, queue size %d", workerCount, queueSize);
+   return 0;
+}
+
+// Sessions, die danach noch auf Disk zugreifen, machen das selbst
+void diskShutdown(void)
+{
+   pthread_mutex_lock(&queueMutex);
+   poolRunning = 0;
+   poolStop = 1;
+   pthread_cond_broadcast(&notEmpty);
+   pthread_cond_broadcast(&notFull);
+   pthread_mutex_unlock(&queueMutex);
+
+   for (int i = 0; i < workerCount; i++)
+   {
+      pthread_join(workers[i], NULL);
+   }
+   workerCount = 0;
+
+   fairDestroy(&queue);
+}
+
+// führt function(data) in einem Disk-Worker aus und wartet darauf
+void diskRun(DiskFunction function, void *data)
+{
+   DiskJob job;
+
+   if (isDiskWorker)
+   {
+      function(data);
+      return;
+   }
+
+   job.function = function;
+   job.data = data;
+   job.error = 0;
+   job.done = 0;
+
+   pthread_mutex_lock(&queueMutex);
+   while (poolRunning && queue.length >= queueSize)
+   {
+      pthread_cond_wait(&notFull, &queueMutex);
+   }
+   // ohne Speicher für den User direkt ausführen
+   if (!poolRunning || fairPush(&queue, sessionUsername, &job.item, 1) == -1)
+   {
+      pthread_mutex_unlock(&queueMutex);
+      function(data);
+      return;
+   }
+   pthread_cond_init(&job.doneCond, NULL);
+   pthread_cond_signal(&notEmpty);
+
+   while (!job.done)
+   {
+      pthread_cond_wait(&job.doneCond, &queueMutex);
+   }
+   pthread_mutex_unlock(&queueMutex);
+
+   pthread_cond_destroy(&job.doneCond);
+   errno = job.error;
+}
+
+// wartende Jobs (für STATS)
+int diskQueueLength(void)
+{
+   pthread_mutex_lock(&queueMutex);
+   int length = queue.length;
+   pthread_mutex_unlock(&queueMutex);
+   return length;
+}
@@ -0,0 +1,27 @@
+#ifndef TWMAILER_DISKPOOL_H
+#define TWMAILER_DISKPOOL_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Thread-Pool für Spool-Zugriffe (mkdir, opendir, fopen, write, unlink)
+// Die Session-Threads machen nur noch Netzwerk und geben Disk-Operationen als
+// Job an disk_threads Worker ab. Die Queue hat disk_queue_size Plätze, ist
+// sie voll, wartet der abgebende Thread (Backpressure statt beliebig vieler
+// gleichzeitiger Disk-Zugriffe bei vielen Verbindungen).
+// Die Queue ist pro User (sessionUsername) und wird reihum bedient, siehe
+// sched.h.
+// diskRun() kehrt erst zurück, wenn der Job fertig ist, errno des Jobs wird
+// übernommen. Ohne diskInit() (z.B. Microbench) laufen Jobs direkt.
+
+typedef void (*DiskFunction)(void *data);
+
+///////////////////////////////////////////////////////////////////////////////
+
+int diskInit(const ServerConfig *cfg);
+void diskShutdown(void);
+void diskRun(DiskFunction function, void *data);
+int diskQueueLength(void);
+
+#endif
@@ -0,0 +1,476 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "export.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct ExportMessage
+{
+   int number;
+   char *data; // Nachricht im Spool-Format (sender, receiver, subject, body)
+   size_t length;
+   int done;
+   int failed;
+} ExportMessage;
+
+typedef struct Export
+{
+   const struct sockaddr_in *address;
+   const Credentials *credentials;
+   const char *target;
+   int format;
+   char fromDate[64]; // Datum für die mbox "From " Zeilen
+
+   ExportMessage *messages;
+   int count;
+   int next;          // nächste Nachricht die ein Worker holt (atomic)
+   int activeWorkers; // geschützt durch mutex
+
+   pthread_mutex_t mutex;
+   pthread_cond_t changed; // Nachricht fertig oder Worker beendet
+} Export;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// verbindet, liest die Welcome Message und meldet sich an
+// (LOGIN mit den Credentials, sonst RESUME mit dem gespeicherten Token)
+static int exportConnect(const Export *export, LineReader *reader)
+{
+   char request[BUF];
+   char line[BUF];
+   char token[512];
+   int length;
+
+   reader->start = reader->end = 0;
+   reader->socket = socket(AF_INET, SOCK_STREAM, 0);
+   if (reader->socket == -1)
+   {
+      perror("Socket error");
+      return -1;
+   }
+
+   if (connect(reader->socket, (const struct sockaddr *)export->address, sizeof(*export->address)) == -1)
+   {
+      perror("Connect error - no server available");
+      close(reader->socket);
+      return -1;
+   }
+
+   if (export->credentials->username[0] != '\0')
+   {
+      length = snprintf(request, sizeof(request), "LOGIN\n%s\n%s\n",
+                        export->credentials->username, export->credentials->password);
+   }
+   else if (loadToken(token, sizeof(token)) == 0)
+   {
+      length = snprintf(request, sizeof(request), "RESUME\n%s\n", token);
+   }
+   else
+   {
+      fprintf(stderr, "No credentials and no saved session, please LOGIN first\n");
+      close(reader->socket);
+      return -1;
+   }
+
+   // Welcome Message, dann Antwort auf LOGIN/RESUME
+   if (lineReaderRead(reader, line, sizeof(line)) <= 0 ||
+       sendAll(reader->socket, request, length) == -1 ||
+       lineReaderRead(reader, line, sizeof(line)) <= 0)
+   {
+      fprintf(stderr, "Server closed connection\n");
+      close(reader->socket);
+      return -1;
+   }
+   if (strncmp(line, "OK", 2) != 0)
+   {
+      fprintf(stderr, "Login failed\n");
+      close(reader->socket);
+      return -1;
+   }
+   return 0;
+}
+
+static void exportDisconnect(LineReader *reader)
+{
+   sendAll(reader->socket, "QUIT\n", 5);
+   close(reader->socket);
+}
+
+// INDEX: Nummern aller Nachrichten
+static int fetchIndex(Export *export)
+{
+   LineReader *reader;
+   char line[BUF];
+
+   reader = malloc(sizeof(LineReader));
+   if (reader == NULL || exportConnect(export, reader) == -1)
+   {
+      free(reader);
+      return -1;
+   }
+
+   if (sendAll(reader->socket, "INDEX\n", 6) == -1 || lineReaderRead(reader, line, sizeof(line)) <= 0 ||
+       strncmp(line, "ERR", 3) == 0)
+   {
+      fprintf(stderr, "INDEX failed\n");
+      exportDisconnect(reader);
+      free(reader);
+      return -1;
+   }
+
+   export->count = atoi(line);
+   export->messages = calloc(export->count > 0 ? export->count : 1, sizeof(ExportMessage));
+   if (export->messages == NULL)
+   {
+      exportDisconnect(reader);
+      free(reader);
+      return -1;
+   }
+
+   for (int i = 0; i < export->count; i++)
+   {
+      if (lineReaderRead(reader, line, sizeof(line)) <= 0)
+      {
+         exportDisconnect(reader);
+         free(reader);
+         return -1;
+      }
+      export->messages[i].number = atoi(line); // "<nummer> <subject>"
+   }
+
+   exportDisconnect(reader);
+   free(reader);
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// READ einer Nachricht, Inhalt bis zum end marker in message->data
+// 0 = OK, 1 = ERR (z.B. inzwischen gelöscht), -1 = Verbindungsfehler
+static int fetchMessage(LineReader *reader, ExportMessage *message)
+{
+   char line[BUF];
+   size_t capacity = 0;
+   int length;
+
+   length = snprintf(line, sizeof(line), "READ\n%d\n", message->number);
+   if (sendAll(reader->socket, line, length) == -1 || lineReaderRead(reader, line, sizeof(line)) <= 0)
+   {
+      return -1;
+   }
+   if (strcmp(line, "OK\n") != 0)
+   {
+      return 1;
+   }
+
+   while (1)
+   {
+      length = lineReaderRead(reader, line, sizeof(line));
+      if (length <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(line, ".\n") == 0)
+      {
+         return 0;
+      }
+
+      if (message->length + length > capacity)
+      {
+         capacity = capacity == 0 ? 4096 : capacity * 2;
+         while (capacity < message->length + length)
+         {
+            capacity *= 2;
+         }
+         char *grown = realloc(message->data, capacity);
+         if (grown == NULL)
+         {
+            return -1;
+         }
+         message->data = grown;
+      }
+      memcpy(message->data + message->length, line, length);
+      message->length += length;
+   }
+}
+
+// schreibt eine Nachricht mit Headern, in der mbox mit "From " Zeile und
+// ">From " Quoting im Body (mboxrd)
+static int writeMessage(FILE *file, const Export *export, const ExportMessage *message)
+{
+   const char *position = message->data;
+   const char *end = message->data + message->length;
+   const char *headers[3] = {"From: ", "To: ", "Subject: "};
+   char sender[BUF] = "unknown";
+   int lineNumber = 0;
+
+   if (export->format == EXPORT_MBOX)
+   {
+      size_t senderLength = position < end ? strcspn(position, "\n") : 0;
+      if (senderLength > 0 && senderLength < sizeof(sender))
+      {
+         memcpy(sender, position, senderLength);
+         sender[senderLength] = '\0';
+      }
+      fprintf(file, "From %s %s\n", sender, export->fromDate);
+   }
+
+   while (position < end)
+   {
+      const char *newline = memchr(position, '\n', end - position);
+      size_t length = newline != NULL ? (size_t)(newline - position) : (size_t)(end - position);
+
+      if (lineNumber < 3)
+      {
+         fputs(headers[lineNumber], file);
+      }
+      else if (lineNumber == 3)
+      {
+         fprintf(file, "X-TWMailer-Number: %d\n\n", message->number);
+      }
+
+      if (lineNumber >= 3 && export->format == EXPORT_MBOX)
+      {
+         const char *text = position;
+         while (text < position + length && *text == '>')
+         {
+            text++;
+         }
+         if (position + length - text >= 5 && strncmp(text, "From ", 5) == 0)
+         {
+            fputc('>', file);
+         }
+      }
+
+      fwrite(position, 1, length, file);
+      fputc('\n', file);
+      position += length + 1;
+      lineNumber++;
+   }
+
+   if (lineNumber <= 3)
+   {
+      fprintf(file, "X-TWMailer-Number: %d\n\n", message->number);
+   }
+   if (export->format == EXPORT_MBOX)
+   {
+      fputc('\n', file);
+   }
+   return ferror(file) ? -1 : 0;
+}
+
+static int writeMessageFile(const Export *export, const ExportMessage *message)
+{
+   char path[1024];
+
+   snprintf(path, sizeof(path), "%s/%d.eml", export->target, message->number);
+   FILE *file = fopen(path, "w");
+   if (file == NULL)
+   {
+      perror("open export file failed");
+      return -1;
+   }
+
+   int result = writeMessage(file, export, message);
+   if (fclose(file) != 0)
+   {
+      result = -1;
+   }
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ein Worker pro Verbindung, holt sich die nächste freie Nachricht
+static void *exportWorker(void *data)
+{
+   Export *export = data;
+   LineReader *reader = malloc(sizeof(LineReader));
+
+   if (reader != NULL && exportConnect(export, reader) == 0)
+   {
+      while (1)
+      {
+         int index = __atomic_fetch_add(&export->next, 1, __ATOMIC_RELAXED);
+         if (index >= export->count)
+         {
+            break;
+         }
+
+         ExportMessage *message = &export->messages[index];
+         int result = fetchMessage(reader, message);
+         if (result != 0)
+         {
+            fprintf(stderr, "READ %d failed\n", message->number);
+            message->failed = 1;
+         }
+         else if (export->format == EXPORT_DIRECTORY)
+         {
+            message->failed = writeMessageFile(export, message) == -1;
+         }
+
+         // Verzeichnis: Daten werden nicht mehr gebraucht
+         if (export->format == EXPORT_DIRECTORY || message->failed)
+         {
+            free(message->data);
+            message->data = NULL;
+         }
+
+         pthread_mutex_lock(&export->mutex);
+         message->done = 1;
+         pthread_cond_broadcast(&export->changed);
+         pthread_mutex_unlock(&export->mutex);
+
+         if (result == -1)
+         {
+            break; // Verbindung kaputt, die anderen Worker machen weiter
+         }
+      }
+      exportDisconnect(reader);
+   }
+   free(reader);
+
+   pthread_mutex_lock(&export->mutex);
+   export->activeWorkers--;
+   pthread_cond_broadcast(&export->changed);
+   pthread_mutex_unlock(&export->mutex);
+   return NULL;
+}
+
+// schreibt die Nachrichten der Reihe nach in die mbox, sobald sie da sind
+static int writeMbox(Export *export)
+{
+   int failed = 0;
+   FILE *file = fopen(export->target, "w");
+
+   if (file == NULL)
+   {
+      perror("open mbox failed");
+   }
+
+   for (int i = 0; i < export->count; i++)
+   {
+      ExportMessage *message = &export->messages[i];
+
+      pthread_mutex_lock(&export->mutex);
+      while (!message->done && export->activeWorkers > 0)
+      {
+         pthread_cond_wait(&export->changed, &export->mutex);
+      }
+      pthread_mutex_unlock(&export->mutex);
+
+      // nicht fertig und kein Worker mehr aktiv -> alle Verbindungen weg
+      if (!message->done || message->failed || file == NULL ||
+          writeMessage(file, export, message) == -1)
+      {
+         failed++;
+      }
+      free(message->data);
+      message->data = NULL;
+   }
+
+   if (file != NULL && fclose(file) != 0)
+   {
+      perror("write mbox failed");
+      return export->count;
+   }
+   return failed;
+}
+
+int exportMailbox(const struct sockaddr_in *address, const Credentials *credentials,
+                  const char *target, int format, int connections)
+{
+   Export export;
+   pthread_t *workers;
+   struct timespec start, end;
+   int failed = 0;
+   time_t now = time(NULL);
+
+   memset(&export, 0, sizeof(export));
+   export.address = address;
+   export.credentials = credentials;
+   export.target = target;
+   export.format = format;
+   strftime(export.fromDate, sizeof(export.fromDate), "%a %b %e %H:%M:%S %Y", gmtime(&now));
+   pthread_mutex_init(&export.mutex, NULL);
+   pthread_cond_init(&export.changed, NULL);
+
+   if (format == EXPORT_DIRECTORY && mkdir(target, 0700) == -1 && errno != EEXIST)
+   {
+      perror("mkdir export directory failed");
+      return -1;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   if (fetchIndex(&export) == -1)
+   {
+      free(export.messages);
+      return -1;
+   }
+
+   // mehr Verbindungen als Nachrichten bringen nichts
+   if (connections > export.count)
+   {
+      connections = export.count > 0 ? export.count : 1;
+   }
+
+   workers = calloc(connections, sizeof(pthread_t));
+   if (workers == NULL)
+   {
+      free(export.messages);
+      return -1;
+   }
+
+   export.activeWorkers = connections;
+   for (int i = 0; i < connections; i++)
+   {
+      if (pthread_create(&workers[i], NULL, exportWorker, &export) != 0)
+      {
+         fprintf(stderr, "Error: could not start export thread\n");
+         pthread_mutex_lock(&export.mutex);
+         export.activeWorkers -= connections - i;
+         pthread_mutex_unlock(&export.mutex);
+         connections = i;
+         break;
+      }
+   }
+
+   if (format == EXPORT_MBOX)
+   {
+      failed = writeMbox(&export);
+   }
+
+   for (int i = 0; i < connections; i++)
+   {
+      pthread_join(workers[i], NULL);
+   }
+
+   if (format == EXPORT_DIRECTORY)
+   {
+      for (int i = 0; i < export.count; i++)
+      {
+         failed += !export.messages[i].done || export.messages[i].failed;
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   fprintf(stderr, "Exported %d of %d messages to %s in %.2f s (%d connections)\n",
+           export.count - failed, export.count, target,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, connections);
+
+   free(workers);
+   free(export.messages);
+   pthread_mutex_destroy(&export.mutex);
+   pthread_cond_destroy(&export.changed);
+   return failed;
+}
@@ -0,0 +1,24 @@
+#ifndef TWMAILER_EXPORT_H
+#define TWMAILER_EXPORT_H
+
+#include <netinet/in.h>
+#include "client.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Export-Modus des Clients (Backup/Migration)
+// Holt mit INDEX alle Nachrichtennummern und verteilt die READs auf
+// mehrere parallele Verbindungen. Jede Nachricht wird entweder als
+// <dir>/<nummer>.eml oder in eine gemeinsame mbox-Datei geschrieben (in
+// der Reihenfolge der Nummern).
+
+#define EXPORT_DIRECTORY 0
+#define EXPORT_MBOX 1
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Rückgabe: Anzahl der nicht exportierten Nachrichten, -1 bei Fehler
+int exportMailbox(const struct sockaddr_in *address, const Credentials *credentials,
+                  const char *target, int format, int connections);
+
+#endif
@@ -0,0 +1,96 @@
+#include "histogram.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Bucket-Index für einen Wert
+static int bucketIndex(unsigned long value)
+{
+   if (value < HISTOGRAM_SUB_COUNT)
+   {
+      return (int)value;
+   }
+
+   int msb = 63 - __builtin_clzl(value);
+   if (msb >= HISTOGRAM_MAX_BITS)
+   {
+      return HISTOGRAM_BUCKETS - 1; // zu groß -> letzter Bucket
+   }
+
+   int shift = msb - HISTOGRAM_SUB_BITS;
+   int sub = (int)(value >> shift) - HISTOGRAM_SUB_COUNT;
+   return (shift + 1) * HISTOGRAM_SUB_COUNT + sub;
+}
+
+// größter Wert der noch in den Bucket fällt
+static unsigned long bucketUpperBound(int index)
+{
+   if (index < HISTOGRAM_SUB_COUNT)
+   {
+      return (unsigned long)index;
+   }
+
+   int shift = index / HISTOGRAM_SUB_COUNT - 1;
+   unsigned long sub = (unsigned long)(index % HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_COUNT);
+   return ((sub + 1) << shift) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void histogramRecord(Histogram *histogram, unsigned long value)
+{
+   __atomic_fetch_add(&histogram->counts[bucketIndex(value)], 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&histogram->total, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+
+   unsigned long max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+   while (value > max &&
+          !__atomic_compare_exchange_n(&histogram->max, &max, value, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+}
+
+void histogramMerge(Histogram *target, const Histogram *source)
+{
+   for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      target->counts[i] += source->counts[i];
+   }
+   target->total += source->total;
+   target->sum += source->sum;
+   if (source->max > target->max)
+   {
+      target->max = source->max;
+   }
+}
+
+// percentile zwischen 0.0 und 1.0, z.B. 0.99 für p99
+unsigned long histogramPercentile(const Histogram *histogram, double percentile)
+{
+   unsigned long total = __atomic_load_n(&histogram->total, __ATOMIC_RELAXED);
+   unsigned long max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+   unsigned long seen = 0;
+
+   if (total == 0)
+   {
+      return 0;
+   }
+
+   // Anzahl der Werte die <= dem Ergebnis sein müssen (aufgerundet)
+   unsigned long target = (unsigned long)(percentile * (double)total);
+   if ((double)target < percentile * (double)total || target == 0)
+   {
+      target++;
+   }
+
+   for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      seen += __atomic_load_n(&histogram->counts[i], __ATOMIC_RELAXED);
+      if (seen >= target)
+      {
+         unsigned long upper = bucketUpperBound(i);
+         return upper < max ? upper : max;
+      }
+   }
+
+   return max;
+}
@@ -0,0 +1,31 @@
+#ifndef TWMAILER_HISTOGRAM_H
+#define TWMAILER_HISTOGRAM_H
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Latenz-Histogramm (HDR-Style, log-linear)
+// Werte < 32 werden exakt gezählt, darüber wird jede Zweierpotenz in 32
+// Buckets geteilt -> max. ~3% Abweichung bei konstantem Speicherbedarf.
+// Alle Updates sind atomic, das Histogramm kann von mehreren Threads
+// gleichzeitig befüllt werden.
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+typedef struct Histogram
+{
+   unsigned long counts[HISTOGRAM_BUCKETS];
+   unsigned long total;
+   unsigned long sum;
+   unsigned long max;
+} Histogram;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void histogramRecord(Histogram *histogram, unsigned long value);
+void histogramMerge(Histogram *target, const Histogram *source);
+unsigned long histogramPercentile(const Histogram *histogram, double percentile);
+
+#endif
@@ -0,0 +1,340 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define LOG_TEXT_MAX 224
+#define LOG_IDLE_SLEEP_NS (2 * 1000 * 1000) // Writer schläft 2ms wenn nichts los ist
+
+typedef struct LogRecord
+{
+   struct timespec time;
+   int level;
+   int hasErrno;
+   int err;
+   char text[LOG_TEXT_MAX];
+} LogRecord;
+
+// Single-Producer/Single-Consumer Ringbuffer pro Thread
+// head wird nur vom eigenen Thread geschrieben, tail nur vom Writer-Thread
+typedef struct LogRing
+{
+   LogRecord *records;
+   unsigned long mask;
+   unsigned long head;
+   unsigned long tail;
+   unsigned long dropped;
+   int id;
+   int inUse;   // 0 -> Thread ist beendet, Ring kann übernommen werden
+   int writing; // Thread schreibt gerade, logShutdown() wartet darauf
+   struct LogRing *next;
+} LogRing;
+
+int logLevel = LOG_LEVEL_INFO;
+
+static LogRing *rings = NULL; // lock-free Liste, es wird nur vorne eingefügt
+static __thread LogRing *threadRing = NULL;
+static pthread_key_t ringKey;
+static pthread_t writerThread;
+static int writerRunning = 0;
+static int stopRequested = 0;
+static int nextRingId = 0;
+static unsigned long ringSize = 1024;
+static FILE *logFile = NULL;
+
+static const char *levelNames[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// wird beim Beenden eines Threads aufgerufen -> Ring freigeben
+static void releaseRing(void *data)
+{
+   LogRing *ring = data;
+   __atomic_store_n(&ring->inUse, 0, __ATOMIC_RELEASE);
+}
+
+// Ring für den aktuellen Thread holen (einmal pro Thread)
+static LogRing *acquireRing(void)
+{
+   LogRing *ring;
+
+   // zuerst einen Ring von einem beendeten Thread wiederverwenden
+   for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+   {
+      int expected = 0;
+      if (__atomic_compare_exchange_n(&ring->inUse, &expected, 1, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      {
+         pthread_setspecific(ringKey, ring);
+         return ring;
+      }
+   }
+
+   ring = calloc(1, sizeof(LogRing));
+   if (ring == NULL)
+   {
+      return NULL;
+   }
+   ring->records = calloc(ringSize, sizeof(LogRecord));
+   if (ring->records == NULL)
+   {
+      free(ring);
+      return NULL;
+   }
+   ring->mask = ringSize - 1;
+   ring->inUse = 1;
+   ring->id = __atomic_fetch_add(&nextRingId, 1, __ATOMIC_RELAXED);
+
+   // vorne in die Liste einhängen
+   ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+
+   pthread_setspecific(ringKey, ring);
+   return ring;
+}
+
+// eine Zeile im Log-Format: Zeit, Level, Ring-Id, Text (+ strerror)
+static void writeLine(const struct timespec *time, int level, int id, const char *text,
+                      int hasErrno, int err)
+{
+   char timeText[32];
+   struct tm tm;
+
+   localtime_r(&time->tv_sec, &tm);
+   strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &tm);
+   fprintf(logFile, "%s.%03ld %-5s [%d] %s", timeText, time->tv_nsec / 1000000,
+           levelNames[level], id, text);
+   if (hasErrno)
+   {
+      fprintf(logFile, ": %s", strerror(err));
+   }
+   fputc('\n', logFile);
+}
+
+// schreibt alle fertigen Einträge aller Ringe, gibt die Anzahl zurück
+static int drainRings(void)
+{
+   int written = 0;
+
+   for (LogRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+   {
+      unsigned long tail = ring->tail;
+      unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+      while (tail != head)
+      {
+         LogRecord *record = &ring->records[tail & ring->mask];
+         writeLine(&record->time, record->level, ring->id, record->text,
+                   record->hasErrno, record->err);
+         tail++;
+         written++;
+      }
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+      unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+      if (dropped > 0)
+      {
+         char text[64];
+         struct timespec now;
+
+         clock_gettime(CLOCK_REALTIME, &now);
+         snprintf(text, sizeof(text), "%lu log messages dropped (ring buffer full)", dropped);
+         writeLine(&now, LOG_LEVEL_WARN, ring->id, text, 0, 0);
+         written++;
+      }
+   }
+
+   return written;
+}
+
+static void *logWriter(void *data)
+{
+   (void)data;
+   const struct timespec idle = {0, LOG_IDLE_SLEEP_NS};
+
+   while (1)
+   {
+      int stop = __atomic_load_n(&stopRequested, __ATOMIC_ACQUIRE);
+
+      if (drainRings() > 0)
+      {
+         fflush(logFile);
+      }
+      else if (stop)
+      {
+         break; // alles geschrieben
+      }
+      else
+      {
+         nanosleep(&idle, NULL);
+      }
+   }
+
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// log_level, log_file (leer -> stdout) und log_ring_size aus der Config
+int logInit(const ServerConfig *cfg)
+{
+   logLevel = -1;
+   for (int i = 0; i < (int)(sizeof(levelNames) / sizeof(levelNames[0])); i++)
+   {
+      if (strcasecmp(cfg->logLevelName, levelNames[i]) == 0)
+      {
+         logLevel = i;
+      }
+   }
+   if (logLevel == -1)
+   {
+      fprintf(stderr, "Invalid log_level: %s (error, warn, info or debug)\n", cfg->logLevelName);
+      logLevel = LOG_LEVEL_INFO;
+      return -1;
+   }
+
+   // Ringgröße auf Zweierpotenz aufrunden (Index per Maske statt Modulo)
+   ringSize = 16;
+   while (ringSize < (unsigned long)cfg->logRingSize)
+   {
+      ringSize *= 2;
+   }
+
+   if (cfg->logFile[0] != '\0')
+   {
+      logFile = fopen(cfg->logFile, "a");
+      if (logFile == NULL)
+      {
+         perror("fopen log_file failed");
+         return -1;
+      }
+   }
+   else
+   {
+      logFile = stdout;
+   }
+
+   if (pthread_key_create(&ringKey, releaseRing) != 0)
+   {
+      fprintf(stderr, "pthread_key_create failed\n");
+      return -1;
+   }
+
+   stopRequested = 0;
+   if (pthread_create(&writerThread, NULL, logWriter, NULL) != 0)
+   {
+      fprintf(stderr, "Could not start log writer thread\n");
+      return -1;
+   }
+   __atomic_store_n(&writerRunning, 1, __ATOMIC_RELEASE);
+
+   return 0;
+}
+
+// restliche Einträge schreiben und Writer-Thread beenden
+// Threads, die noch laufen (Client-Threads beim exit()), loggen danach nach
+// stderr. Wer writerRunning schon gesehen hat, schreibt seinen Eintrag noch
+// fertig in den Ring, darauf wird gewartet, damit der Writer ihn mitnimmt.
+void logShutdown(void)
+{
+   const struct timespec pause = {0, 100 * 1000};
+
+   if (!__atomic_load_n(&writerRunning, __ATOMIC_ACQUIRE))
+   {
+      return;
+   }
+
+   __atomic_store_n(&writerRunning, 0, __ATOMIC_SEQ_CST);
+   for (LogRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+   {
+      while (__atomic_load_n(&ring->writing, __ATOMIC_SEQ_CST))
+      {
+         nanosleep(&pause, NULL);
+      }
+   }
+
+   // der Writer hört erst nach einem leeren Durchlauf auf, die Ringe sind
+   // danach also vollständig geschrieben
+   __atomic_store_n(&stopRequested, 1, __ATOMIC_RELEASE);
+   pthread_join(writerThread, NULL);
+
+   fflush(logFile);
+   if (logFile != stdout)
+   {
+      fclose(logFile);
+   }
+   logFile = NULL;
+}
+
+void logWrite(int level, int withErrno, const char *format, ...)
+{
+   int savedErrno = errno;
+   va_list args;
+
+   // vor logInit() bzw. nach logShutdown(): synchron nach stderr
+   // writing vor dem zweiten Blick auf writerRunning setzen, siehe logShutdown()
+   LogRing *ring = threadRing;
+   if (__atomic_load_n(&writerRunning, __ATOMIC_ACQUIRE) &&
+       (ring != NULL || (ring = threadRing = acquireRing()) != NULL))
+   {
+      __atomic_store_n(&ring->writing, 1, __ATOMIC_SEQ_CST);
+      if (!__atomic_load_n(&writerRunning, __ATOMIC_SEQ_CST))
+      {
+         __atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+         ring = NULL;
+      }
+   }
+   else
+   {
+      ring = NULL;
+   }
+
+   if (ring == NULL)
+   {
+      va_start(args, format);
+      vfprintf(stderr, format, args);
+      va_end(args);
+      if (withErrno)
+      {
+         fprintf(stderr, ": %s", strerror(savedErrno));
+      }
+      fputc('\n', stderr);
+      errno = savedErrno;
+      return;
+   }
+   unsigned long head = ring->head;
+   unsigned long tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+   // Ring voll -> verwerfen statt blockieren
+   if (head - tail > ring->mask)
+   {
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+      errno = savedErrno;
+      return;
+   }
+
+   LogRecord *record = &ring->records[head & ring->mask];
+   clock_gettime(CLOCK_REALTIME, &record->time);
+   record->level = level;
+   record->hasErrno = withErrno;
+   record->err = savedErrno;
+
+   va_start(args, format);
+   vsnprintf(record->text, sizeof(record->text), format, args);
+   va_end(args);
+
+   __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+   __atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+   errno = savedErrno;
+}
@@ -0,0 +1,46 @@
+#ifndef TWMAILER_LOG_H
+#define TWMAILER_LOG_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Asynchrones Logging
+// jeder Thread schreibt lock-free in seinen eigenen Ringbuffer, ein
+// Writer-Thread schreibt die Einträge gesammelt in die Log-Datei/stdout.
+// Deaktivierte Levels kosten nur einen Vergleich (siehe LOG_ENABLED).
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+extern int logLevel;
+
+#define LOG_ENABLED(level) ((level) <= logLevel)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, 0, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, 0, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, 0, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, 0, __VA_ARGS__)
+
+// wie perror(): hängt strerror(errno) an die Meldung an
+#define LOG_ERRNO(...) LOG_AT(LOG_LEVEL_ERROR, 1, __VA_ARGS__)
+
+#define LOG_AT(level, withErrno, ...)              \
+   do                                              \
+   {                                               \
+      if (LOG_ENABLED(level))                      \
+      {                                            \
+         logWrite(level, withErrno, __VA_ARGS__);  \
+      }                                            \
+   } while (0)
+
+///////////////////////////////////////////////////////////////////////////////
+
+int logInit(const ServerConfig *cfg);
+void logShutdown(void);
+void logWrite(int level, int withErrno, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif
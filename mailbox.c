@@ -0,0 +1,547 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "mailbox.h"
+#include "commands.h"
+#include "config.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define LOCK_BUCKETS 256
+#define CHANGES_MAX (256 * 1024)     // .changes wird ab dieser Größe gekürzt
+#define CHANGES_KEEP (CHANGES_MAX / 2) // auf die neuesten so vielen Bytes
+
+// Sperren eines Postfachs, existiert nur solange sie jemand benutzt
+// (refs: Halter und Wartende der Sperre, Threads in einer mailbox*-Funktion)
+typedef struct MailboxLock
+{
+   struct MailboxLock *next; // Hash-Kette
+   int refs;
+   pthread_mutex_t mutex;
+   pthread_cond_t changed;
+   int readers;
+   int writer;
+   int writersWaiting;
+   pthread_mutex_t metaMutex; // .meta/.changes (Read-Modify-Write bei SEND/DEL)
+   char userDir[512];
+} MailboxLock;
+
+static MailboxLock *locks[LOCK_BUCKETS];
+static pthread_mutex_t locksMutex = PTHREAD_MUTEX_INITIALIZER;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// FNV-1a über den Pfad des Postfachs
+static MailboxLock **lockBucket(const char *userDir)
+{
+   unsigned int hash = 2166136261u;
+
+   for (const unsigned char *c = (const unsigned char *)userDir; *c != '\0'; c++)
+   {
+      hash = (hash ^ *c) * 16777619u;
+   }
+   return &locks[hash % LOCK_BUCKETS];
+}
+
+// Eintrag für userDir holen bzw. anlegen, mit releaseLock() wieder abgeben
+// NULL nur wenn kein Speicher mehr da ist
+static MailboxLock *acquireLock(const char *userDir)
+{
+   MailboxLock **bucket = lockBucket(userDir);
+   MailboxLock *lock;
+
+   pthread_mutex_lock(&locksMutex);
+   for (lock = *bucket; lock != NULL; lock = lock->next)
+   {
+      if (strcmp(lock->userDir, userDir) == 0)
+      {
+         break;
+      }
+   }
+   if (lock == NULL)
+   {
+      lock = calloc(1, sizeof(MailboxLock));
+      if (lock == NULL)
+      {
+         pthread_mutex_unlock(&locksMutex);
+         LOG_ERROR("Out of memory");
+         return NULL;
+      }
+      snprintf(lock->userDir, sizeof(lock->userDir), "%s", userDir);
+      pthread_mutex_init(&lock->mutex, NULL);
+      pthread_cond_init(&lock->changed, NULL);
+      pthread_mutex_init(&lock->metaMutex, NULL);
+      lock->next = *bucket;
+      *bucket = lock;
+   }
+   lock->refs++;
+   pthread_mutex_unlock(&locksMutex);
+   return lock;
+}
+
+// letzter Benutzer gibt den Eintrag frei
+static void releaseLock(MailboxLock *lock)
+{
+   pthread_mutex_lock(&locksMutex);
+   if (--lock->refs > 0)
+   {
+      pthread_mutex_unlock(&locksMutex);
+      return;
+   }
+   for (MailboxLock **link = lockBucket(lock->userDir); *link != NULL; link = &(*link)->next)
+   {
+      if (*link == lock)
+      {
+         *link = lock->next;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&locksMutex);
+
+   pthread_mutex_destroy(&lock->mutex);
+   pthread_cond_destroy(&lock->changed);
+   pthread_mutex_destroy(&lock->metaMutex);
+   free(lock);
+}
+
+// metaMutex des Postfachs holen (mit Referenz auf den Eintrag)
+static MailboxLock *lockMeta(const char *userDir)
+{
+   MailboxLock *lock = acquireLock(userDir);
+   if (lock != NULL)
+   {
+      pthread_mutex_lock(&lock->metaMutex);
+   }
+   return lock;
+}
+
+static void unlockMeta(MailboxLock *lock)
+{
+   pthread_mutex_unlock(&lock->metaMutex);
+   releaseLock(lock);
+}
+
+// schreibt .meta atomar (tmp-Datei + rename)
+static int saveMeta(const char *userDir, const MailboxMeta *meta)
+{
+   char path[600];
+   char tmpPath[600];
+
+   snprintf(path, sizeof(path), "%s/.meta", userDir);
+   snprintf(tmpPath, sizeof(tmpPath), "%s/.meta.tmp", userDir);
+
+   FILE *file = fopen(tmpPath, "w");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", tmpPath);
+      return -1;
+   }
+   fprintf(file, "%lu %d %lu %d %ld\n", meta->uidValidity, meta->nextNumber,
+           meta->modSeq, meta->messageCount, meta->byteCount);
+   if (fclose(file) != 0)
+   {
+      LOG_ERRNO("write %s failed", tmpPath);
+      return -1;
+   }
+
+   if (rename(tmpPath, path) == -1)
+   {
+      LOG_ERRNO("rename %s failed", tmpPath);
+      return -1;
+   }
+   return 0;
+}
+
+// zählt Nachrichten und Bytes einmalig über den Verzeichnis-Scan
+// (Postfächer ohne Zähler in .meta)
+static void scanUsage(const char *userDir, MailboxMeta *meta)
+{
+   char path[600];
+   struct dirent *entry;
+   struct stat info;
+   int number;
+
+   meta->messageCount = 0;
+   meta->byteCount = 0;
+
+   DIR *dir = opendir(userDir);
+   if (dir == NULL)
+   {
+      return;
+   }
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (sscanf(entry->d_name, "%d.txt", &number) == 1)
+      {
+         snprintf(path, sizeof(path), "%s/%s", userDir, entry->d_name);
+         if (stat(path, &info) == 0)
+         {
+            meta->messageCount++;
+            meta->byteCount += info.st_size;
+         }
+      }
+   }
+   closedir(dir);
+}
+
+// liest .meta, legt sie an falls es sie noch nicht gibt (auch für Spools
+// von älteren Versionen: nächste Nummer dann über den Verzeichnis-Scan)
+// metaMutex des Postfachs muss gehalten werden
+static int loadMeta(const char *userDir, MailboxMeta *meta)
+{
+   char path[600];
+
+   snprintf(path, sizeof(path), "%s/.meta", userDir);
+   FILE *file = fopen(path, "r");
+   if (file != NULL)
+   {
+      // ältere .meta haben noch keine modSeq bzw. keine Zähler
+      meta->modSeq = 0;
+      int fields = fscanf(file, "%lu %d %lu %d %ld", &meta->uidValidity, &meta->nextNumber,
+                          &meta->modSeq, &meta->messageCount, &meta->byteCount);
+      fclose(file);
+      if (fields == 5 && meta->nextNumber > 0)
+      {
+         return 0;
+      }
+      if (fields >= 2 && meta->nextNumber > 0)
+      {
+         scanUsage(userDir, meta);
+         return saveMeta(userDir, meta);
+      }
+      LOG_WARN("Corrupt %s, recreating", path);
+   }
+
+   meta->uidValidity = (unsigned long)time(NULL);
+   meta->nextNumber = getNextMessageNumber(userDir);
+   meta->modSeq = 0;
+   scanUsage(userDir, meta);
+
+   // neue uidValidity -> alte Änderungen gelten nicht mehr
+   snprintf(path, sizeof(path), "%s/.changes", userDir);
+   unlink(path);
+   return saveMeta(userDir, meta);
+}
+
+// kürzt .changes (size Bytes) auf die neuesten CHANGES_KEEP Bytes, ab einer
+// ganzen Zeile. tmp-Datei + rename: SYNC/IDLE, die das Log gerade lesen,
+// behalten die alte Datei. Clients mit älterer modSeq bekommen danach FULL.
+// metaMutex des Postfachs muss gehalten werden
+static void compactChanges(const char *userDir, long size)
+{
+   char path[600];
+   char tmpPath[610];
+   char buffer[8192];
+   size_t length;
+   int c;
+
+   snprintf(path, sizeof(path), "%s/.changes", userDir);
+   snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+   FILE *in = fopen(path, "r");
+   if (in == NULL)
+   {
+      return;
+   }
+   if (fseek(in, size - CHANGES_KEEP, SEEK_SET) == -1)
+   {
+      fclose(in);
+      return;
+   }
+   while ((c = fgetc(in)) != EOF && c != '\n')
+   {
+      // Rest der angeschnittenen Zeile
+   }
+
+   FILE *out = fopen(tmpPath, "w");
+   if (out == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", tmpPath);
+      fclose(in);
+      return;
+   }
+   while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+   {
+      fwrite(buffer, 1, length, out);
+   }
+   fclose(in);
+   if (fclose(out) != 0 || rename(tmpPath, path) == -1)
+   {
+      LOG_ERRNO("compact %s failed", path);
+      unlink(tmpPath);
+      return;
+   }
+   LOG_DEBUG("%s compacted (%ld bytes)", path, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mailboxLoadMeta(const char *userDir, MailboxMeta *meta)
+{
+   MailboxLock *lock;
+
+   if ((lock = lockMeta(userDir)) == NULL)
+   {
+      return -1;
+   }
+   int result = loadMeta(userDir, meta);
+   unlockMeta(lock);
+   return result;
+}
+
+// vergibt die nächste Nachrichtennummer (userDir muss existieren) und
+// rechnet eine Nachricht mit size Bytes auf die Quota an
+// ersetzt den Verzeichnis-Scan von getNextMessageNumber() bei jedem SEND
+// MAILBOX_OVER_QUOTA wenn quota_messages bzw. quota_kbytes überschritten wäre
+int mailboxAllocateNumber(const char *userDir, long size)
+{
+   MailboxLock *lock;
+   MailboxMeta meta;
+   int number = -1;
+
+   if ((lock = lockMeta(userDir)) == NULL)
+   {
+      return -1;
+   }
+   if (loadMeta(userDir, &meta) == 0)
+   {
+      if ((serverConfig.quotaMessages > 0 && meta.messageCount >= serverConfig.quotaMessages) ||
+          (serverConfig.quotaKbytes > 0 && meta.byteCount + size > serverConfig.quotaKbytes * 1024L))
+      {
+         unlockMeta(lock);
+         return MAILBOX_OVER_QUOTA;
+      }
+
+      number = meta.nextNumber++;
+      meta.messageCount++;
+      meta.byteCount += size;
+      if (saveMeta(userDir, &meta) == -1)
+      {
+         number = -1;
+      }
+   }
+   unlockMeta(lock);
+   return number;
+}
+
+// gibt angerechnete Quota wieder frei (SEND konnte die Datei nicht schreiben)
+int mailboxReleaseUsage(const char *userDir, int count, long bytes)
+{
+   MailboxLock *lock;
+   MailboxMeta meta;
+   int result = -1;
+
+   if ((lock = lockMeta(userDir)) == NULL)
+   {
+      return -1;
+   }
+   if (loadMeta(userDir, &meta) == 0)
+   {
+      meta.messageCount = meta.messageCount > count ? meta.messageCount - count : 0;
+      meta.byteCount = meta.byteCount > bytes ? meta.byteCount - bytes : 0;
+      result = saveMeta(userDir, &meta);
+   }
+   unlockMeta(lock);
+   return result;
+}
+
+// hängt eine Änderung an <userDir>/.changes an und erhöht modSeq
+// Zeilen: "<seq> + <nummer> <subject>" bzw. "<seq> - <nummer>"
+int mailboxLogChange(const char *userDir, char type, int number, const char *subject)
+{
+   MailboxLock *lock;
+   char path[600];
+   MailboxMeta meta;
+   int result = -1;
+
+   if ((lock = lockMeta(userDir)) == NULL)
+   {
+      return -1;
+   }
+   if (loadMeta(userDir, &meta) == -1)
+   {
+      unlockMeta(lock);
+      return -1;
+   }
+   meta.modSeq++;
+
+   snprintf(path, sizeof(path), "%s/.changes", userDir);
+   FILE *file = fopen(path, "a");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", path);
+      unlockMeta(lock);
+      return -1;
+   }
+   if (type == '+')
+   {
+      fprintf(file, "%lu + %d %s\n", meta.modSeq, number, subject);
+   }
+   else
+   {
+      fprintf(file, "%lu - %d\n", meta.modSeq, number);
+   }
+   long size = ftell(file);
+   // .meta erst nach dem Eintrag, sonst könnte ein SYNC eine Änderung verpassen
+   if (fclose(file) != 0)
+   {
+      LOG_ERRNO("write %s failed", path);
+   }
+   else
+   {
+      result = saveMeta(userDir, &meta);
+   }
+   if (result == 0 && size > CHANGES_MAX)
+   {
+      compactChanges(userDir, size);
+   }
+   unlockMeta(lock);
+   return result;
+}
+
+// wie mailboxLogChange() für mehrere gelöschte Nachrichten (Batch-DEL):
+// ein Durchgang, .meta wird nur einmal geschrieben
+// bytes = Summe der Größen der gelöschten Dateien (Quota)
+int mailboxLogDeletes(const char *userDir, const int *numbers, int count, long bytes)
+{
+   MailboxLock *lock;
+   char path[600];
+   MailboxMeta meta;
+   int result = -1;
+
+   if (count == 0)
+   {
+      return 0;
+   }
+
+   if ((lock = lockMeta(userDir)) == NULL)
+   {
+      return -1;
+   }
+   if (loadMeta(userDir, &meta) == -1)
+   {
+      unlockMeta(lock);
+      return -1;
+   }
+
+   snprintf(path, sizeof(path), "%s/.changes", userDir);
+   FILE *file = fopen(path, "a");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", path);
+      unlockMeta(lock);
+      return -1;
+   }
+   for (int i = 0; i < count; i++)
+   {
+      fprintf(file, "%lu - %d\n", ++meta.modSeq, numbers[i]);
+   }
+   meta.messageCount = meta.messageCount > count ? meta.messageCount - count : 0;
+   meta.byteCount = meta.byteCount > bytes ? meta.byteCount - bytes : 0;
+
+   long size = ftell(file);
+   if (fclose(file) != 0)
+   {
+      LOG_ERRNO("write %s failed", path);
+   }
+   else
+   {
+      result = saveMeta(userDir, &meta);
+   }
+   if (result == 0 && size > CHANGES_MAX)
+   {
+      compactChanges(userDir, size);
+   }
+   unlockMeta(lock);
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// geteilte Sperre (LIST, READ, ...), wartet solange ein Schreiber die Sperre
+// hat oder auf sie wartet (Schreiber verhungern nicht hinter Lesern)
+// -1 nur wenn kein Speicher für den Eintrag da ist
+int mailboxLockShared(const char *userDir)
+{
+   MailboxLock *lock = acquireLock(userDir);
+   if (lock == NULL)
+   {
+      return -1;
+   }
+
+   pthread_mutex_lock(&lock->mutex);
+   while (lock->writer || lock->writersWaiting > 0)
+   {
+      pthread_cond_wait(&lock->changed, &lock->mutex);
+   }
+   lock->readers++;
+   pthread_mutex_unlock(&lock->mutex);
+   return 0;
+}
+
+// exklusive Sperre (DEL, neue Nachricht einhängen)
+int mailboxLockExclusive(const char *userDir)
+{
+   MailboxLock *lock = acquireLock(userDir);
+   if (lock == NULL)
+   {
+      return -1;
+   }
+
+   pthread_mutex_lock(&lock->mutex);
+   lock->writersWaiting++;
+   while (lock->writer || lock->readers > 0)
+   {
+      pthread_cond_wait(&lock->changed, &lock->mutex);
+   }
+   lock->writersWaiting--;
+   lock->writer = 1;
+   pthread_mutex_unlock(&lock->mutex);
+   return 0;
+}
+
+// gibt eine geteilte oder die exklusive Sperre frei (auch aus einem anderen
+// Thread als dem, der sie geholt hat), der Eintrag existiert solange sie
+// gehalten wird
+void mailboxUnlock(const char *userDir)
+{
+   MailboxLock *lock;
+
+   pthread_mutex_lock(&locksMutex);
+   for (lock = *lockBucket(userDir); lock != NULL; lock = lock->next)
+   {
+      if (strcmp(lock->userDir, userDir) == 0)
+      {
+         break;
+      }
+   }
+   pthread_mutex_unlock(&locksMutex);
+   if (lock == NULL)
+   {
+      LOG_ERROR("mailboxUnlock %s without lock", userDir);
+      return;
+   }
+
+   pthread_mutex_lock(&lock->mutex);
+   if (lock->writer)
+   {
+      lock->writer = 0;
+   }
+   else
+   {
+      lock->readers--;
+   }
+   if (lock->readers == 0)
+   {
+      pthread_cond_broadcast(&lock->changed);
+   }
+   pthread_mutex_unlock(&lock->mutex);
+   releaseLock(lock);
+}
@@ -0,0 +1,54 @@
+#ifndef TWMAILER_MAILBOX_H
+#define TWMAILER_MAILBOX_H
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Metadaten pro Postfach (<spool>/<user>/.meta)
+// uidValidity wird beim Anlegen gesetzt und ändert sich nur, wenn das
+// Postfach neu angelegt wird. Nachrichtennummern werden nie wieder
+// vergeben (auch nach DEL nicht), daher beschreibt (uidValidity, Nummer)
+// immer denselben Inhalt und Clients können Nachrichten cachen.
+// Jedes SEND/DEL wird mit fortlaufender modSeq in <spool>/<user>/.changes
+// protokolliert, SYNC schickt dann nur die Änderungen seit einer modSeq.
+// .changes wird ab 256 KB auf die neuesten Einträge gekürzt, für ältere
+// modSeqs gibt es dann FULL.
+// Anzahl und Größe der Nachrichten (für die Quota) werden bei SEND/DEL
+// mitgezählt, damit SEND dafür nicht das Verzeichnis scannen muss.
+//
+// Sperren pro Postfach (Reader-Writer): LIST, READ, INDEX, STAT, SYNC und
+// SEARCH lesen mit geteilter Sperre, DEL, Retention und das Einhängen einer
+// neuen Nachricht (rename der fertig geschriebenen tmp-Datei, .changes,
+// Suchindex) brauchen die exklusive. Leser sammeln ihre Antwort unter der
+// Sperre (damit z.B. Anzahl und Subjects von LIST zusammenpassen) bzw.
+// öffnen nur die Dateien, geschickt wird erst nach mailboxUnlock(): ein
+// Client, der nicht liest, blockiert so kein DEL/SEND. Die Sperren liegen in
+// einer Tabelle nach Pfad, ein Eintrag wird beim ersten Benutzer angelegt und
+// vom letzten wieder freigegeben.
+// Sperren nur in Session-/Worker-Threads holen, nie in einem Disk-Job (die
+// Disk-Worker würden sonst hinter einer Session warten, die auf den Pool
+// wartet).
+
+typedef struct MailboxMeta
+{
+   unsigned long uidValidity;
+   int nextNumber;
+   unsigned long modSeq; // Nummer der letzten Änderung in .changes
+   int messageCount;
+   long byteCount;       // Summe der Dateigrößen
+} MailboxMeta;
+
+// Rückgabe von mailboxAllocateNumber() wenn die Quota überschritten wäre
+#define MAILBOX_OVER_QUOTA -2
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mailboxLoadMeta(const char *userDir, MailboxMeta *meta);
+int mailboxAllocateNumber(const char *userDir, long size);
+int mailboxReleaseUsage(const char *userDir, int count, long bytes);
+int mailboxLogChange(const char *userDir, char type, int number, const char *subject);
+int mailboxLogDeletes(const char *userDir, const int *numbers, int count, long bytes);
+int mailboxLockShared(const char *userDir);
+int mailboxLockExclusive(const char *userDir);
+void mailboxUnlock(const char *userDir);
+
+#endif
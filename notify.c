@@ -0,0 +1,80 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "notify.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static Waiter *waiters = NULL;
+static pthread_mutex_t waitersMutex = PTHREAD_MUTEX_INITIALIZER;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int notifyRegister(Waiter *waiter, const char *username)
+{
+   if (pipe(waiter->pipe) == -1)
+   {
+      LOG_ERRNO("pipe failed");
+      return -1;
+   }
+
+   // nicht blockierend: volle Pipe heißt nur, dass schon eine Meldung wartet
+   for (int i = 0; i < 2; i++)
+   {
+      fcntl(waiter->pipe[i], F_SETFL, fcntl(waiter->pipe[i], F_GETFL) | O_NONBLOCK);
+      fcntl(waiter->pipe[i], F_SETFD, FD_CLOEXEC);
+   }
+   strncpy(waiter->username, username, sizeof(waiter->username) - 1);
+   waiter->username[sizeof(waiter->username) - 1] = '\0';
+
+   pthread_mutex_lock(&waitersMutex);
+   waiter->next = waiters;
+   waiters = waiter;
+   pthread_mutex_unlock(&waitersMutex);
+   return 0;
+}
+
+void notifyUnregister(Waiter *waiter)
+{
+   pthread_mutex_lock(&waitersMutex);
+   for (Waiter **link = &waiters; *link != NULL; link = &(*link)->next)
+   {
+      if (*link == waiter)
+      {
+         *link = waiter->next;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&waitersMutex);
+
+   close(waiter->pipe[0]);
+   close(waiter->pipe[1]);
+}
+
+// weckt alle Sessions, die auf das Postfach von username warten
+void notifyMailbox(const char *username)
+{
+   pthread_mutex_lock(&waitersMutex);
+   for (Waiter *waiter = waiters; waiter != NULL; waiter = waiter->next)
+   {
+      if (strcmp(waiter->username, username) == 0 &&
+          write(waiter->pipe[1], "!", 1) == -1 && errno != EAGAIN)
+      {
+         LOG_ERRNO("notify %s failed", username);
+      }
+   }
+   pthread_mutex_unlock(&waitersMutex);
+}
+
+// nach dem Aufwachen alle angesammelten Meldungen verwerfen
+void notifyDrain(Waiter *waiter)
+{
+   char buffer[64];
+
+   while (read(waiter->pipe[0], buffer, sizeof(buffer)) > 0)
+      ;
+}
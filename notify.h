@@ -0,0 +1,24 @@
+#ifndef TWMAILER_NOTIFY_H
+#define TWMAILER_NOTIFY_H
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Registry der Sessions, die gerade in IDLE auf neue Mails warten
+// Jeder Waiter hat eine Pipe, notifyMailbox() schreibt ein Byte hinein und
+// weckt damit den poll() im IDLE-Handler (zusammen mit dem Client-Socket).
+
+typedef struct Waiter
+{
+   char username[256];
+   int pipe[2]; // [0] wird gepollt, [1] von notifyMailbox() beschrieben
+   struct Waiter *next;
+} Waiter;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int notifyRegister(Waiter *waiter, const char *username);
+void notifyUnregister(Waiter *waiter);
+void notifyMailbox(const char *username);
+void notifyDrain(Waiter *waiter);
+
+#endif
@@ -0,0 +1,159 @@
+#define _DEFAULT_SOURCE
+#include <string.h>
+#include <limits.h>
+#include "protocol.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Argumente und Grenzen jedes Commands, Index = CommandId
+static const ProtocolCommand commands[] = {
+    {"LOGIN", COMMAND_LOGIN, 0, 0, 2, {{"username", 1, 127}, {"password", 0, 255}}},
+    {"RESUME", COMMAND_RESUME, 0, 0, 1, {{"token", 1, PROTOCOL_LINE_MAX}}},
+    {"SEND", COMMAND_SEND, 1, 1, 2, {{"receiver", 1, 8}, {"subject", 1, 80}}},
+    {"LIST", COMMAND_LIST, 1, 0, 0, {{NULL, 0, 0}}},
+    {"READ", COMMAND_READ, 1, 0, 1, {{"message number", 1, PROTOCOL_LINE_MAX}}},
+    {"DEL", COMMAND_DEL, 1, 0, 1, {{"message number", 1, PROTOCOL_LINE_MAX}}},
+    {"STATS", COMMAND_STATS, 1, 0, 0, {{NULL, 0, 0}}},
+    {"INDEX", COMMAND_INDEX, 1, 0, 0, {{NULL, 0, 0}}},
+    {"STAT", COMMAND_STAT, 1, 0, 1, {{"message number", 1, 10}}},
+    {"SYNC", COMMAND_SYNC, 1, 0, 1, {{"watermark", 3, 64}}},
+    {"IDLE", COMMAND_IDLE, 1, 0, 0, {{NULL, 0, 0}}},
+    {"SEARCH", COMMAND_SEARCH, 1, 0, 1, {{"query", 0, PROTOCOL_LINE_MAX}}},
+    {"QUIT", COMMAND_QUIT, 0, 0, 0, {{NULL, 0, 0}}},
+};
+
+#define COMMAND_TABLE_SIZE ((int)(sizeof(commands) / sizeof(commands[0])))
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Command-Zeile (ohne Zeilenende) -> Tabelleneintrag, NULL wenn unbekannt
+// name muss nicht nullterminiert sein und kann '\0' enthalten (readline())
+const ProtocolCommand *protocolLookup(const char *name, size_t length)
+{
+   if (length == 0)
+   {
+      return NULL;
+   }
+   for (int i = 0; i < COMMAND_TABLE_SIZE; i++)
+   {
+      // erst erstes Zeichen vergleichen, die meisten Einträge scheiden so aus
+      if (commands[i].name[0] == name[0] &&
+          strlen(commands[i].name) == length &&
+          memcmp(commands[i].name, name, length) == 0)
+      {
+         return &commands[i];
+      }
+   }
+   return NULL;
+}
+
+const char *protocolCommandName(CommandId id)
+{
+   return id >= 0 && id < COMMAND_TABLE_SIZE ? commands[id].name : "OTHER";
+}
+
+// entfernt "\n" bzw. "\r\n" am Ende (in place), gibt die neue Länge zurück
+int protocolStripLine(char *line, int length)
+{
+   if (length > 0 && line[length - 1] == '\n')
+   {
+      length--;
+   }
+   if (length > 0 && line[length - 1] == '\r')
+   {
+      length--;
+   }
+   line[length] = '\0';
+   return length;
+}
+
+// Command-Zeile (ohne Zeilenende) mit Tag: "<tag> <COMMAND>", Tag sind 1 bis
+// PROTOCOL_TAG_MAX Zeichen a-z, A-Z, 0-9. Das Leerzeichen wird durch '\0'
+// ersetzt, *command zeigt danach auf den Command-Namen.
+// Rückgabe: Länge des Tags, 0 ohne Tag, -1 bei ungültigem Tag
+int protocolSplitTag(char *line, int length, char **command, int *commandLength)
+{
+   char *space = memchr(line, ' ', length);
+
+   *command = line;
+   *commandLength = length;
+   if (space == NULL)
+   {
+      return 0;
+   }
+
+   int tagLength = space - line;
+   if (tagLength == 0 || tagLength > PROTOCOL_TAG_MAX)
+   {
+      return -1;
+   }
+   for (int i = 0; i < tagLength; i++)
+   {
+      char c = line[i];
+      if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+      {
+         return -1;
+      }
+   }
+
+   *space = '\0';
+   *command = space + 1;
+   *commandLength = length - tagLength - 1;
+   return tagLength;
+}
+
+// 0 wenn die Länge des Arguments laut Tabelle erlaubt ist
+int protocolCheckArg(const ProtocolCommand *command, int index, int length)
+{
+   const ProtocolArg *arg = &command->args[index];
+   return length >= arg->minLength && length <= arg->maxLength ? 0 : -1;
+}
+
+// strikte Nachrichtennummer (nur Ziffern, > 0), statt atoi()
+int protocolParseNumber(const char *text, int *value)
+{
+   long number = 0;
+
+   if (*text == '\0')
+   {
+      return -1;
+   }
+   for (; *text != '\0'; text++)
+   {
+      if (*text < '0' || *text > '9')
+      {
+         return -1;
+      }
+      number = number * 10 + (*text - '0');
+      if (number > INT_MAX)
+      {
+         return -1;
+      }
+   }
+   if (number == 0)
+   {
+      return -1;
+   }
+   *value = (int)number;
+   return 0;
+}
+
+// Validiert Username: nur a-z und 0-9 erlaubt
+int isValidUsername(const char *username)
+{
+   if (username == NULL || *username == '\0')
+   {
+      return 0; // leer
+   }
+
+   for (int i = 0; username[i] != '\0'; i++)
+   {
+      char c = username[i];
+      if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')))
+      {
+         return 0; // ungültiges Zeichen
+      }
+   }
+
+   return 1; // valid
+}
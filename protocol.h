@@ -0,0 +1,79 @@
+#ifndef TWMAILER_PROTOCOL_H
+#define TWMAILER_PROTOCOL_H
+
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Protokoll-Tabelle und Hilfsfunktionen, von Server und Client gemeinsam
+// verwendet. Ein Request ist eine Command-Zeile, danach argCount
+// Argument-Zeilen und bei SEND der Body bis zur Zeile ".". Zeilen enden mit
+// "\n" oder "\r\n" (protocolStripLine()).
+// Vor dem Command kann ein Tag stehen ("a1 LIST", siehe tagged.h), getrennt
+// mit protocolSplitTag(). protocolLookup() sucht den Command in der Tabelle,
+// Argumente und Body liest der Server danach mit readRequest() (commands.h)
+// in die commandArena, geprüft mit protocolCheckArg().
+// Bei Überlast antwortet der Server statt mit OK/ERR mit "BUSY" (auch statt
+// der Welcome Message), siehe admission.h.
+
+// Command-Ids, Reihenfolge wie in der Tabelle (auch für die Stats)
+typedef enum CommandId
+{
+   COMMAND_LOGIN,
+   COMMAND_RESUME,
+   COMMAND_SEND,
+   COMMAND_LIST,
+   COMMAND_READ,
+   COMMAND_DEL,
+   COMMAND_STATS,
+   COMMAND_INDEX,
+   COMMAND_STAT,
+   COMMAND_SYNC,
+   COMMAND_IDLE,
+   COMMAND_SEARCH,
+   COMMAND_QUIT,
+   COMMAND_OTHER // unbekannter Command
+} CommandId;
+
+#define PROTOCOL_MAX_ARGS 2
+#define PROTOCOL_LINE_MAX 1000 // max. Länge einer Argument-Zeile
+#define PROTOCOL_TAG_MAX 16    // getaggte Command-Zeile "<tag> <COMMAND>"
+
+typedef struct ProtocolArg
+{
+   const char *name; // für Fehlermeldungen
+   int minLength;
+   int maxLength;
+} ProtocolArg;
+
+typedef struct ProtocolCommand
+{
+   const char *name;
+   CommandId id;
+   int needsAuth;
+   int hasBody; // Zeilen bis "." nach den Argumenten (SEND)
+   int argCount;
+   ProtocolArg args[PROTOCOL_MAX_ARGS];
+} ProtocolCommand;
+
+typedef struct ProtocolRequest
+{
+   const ProtocolCommand *command; // NULL bei unbekanntem Command
+   char *args[PROTOCOL_MAX_ARGS];  // ohne Zeilenende, nullterminiert
+   int argLengths[PROTOCOL_MAX_ARGS];
+   char *body;                     // ohne die "." Zeile, ohne Zeilenende
+                                   // der letzten Zeile und ohne "\r"
+   size_t bodyLength;
+} ProtocolRequest;
+
+///////////////////////////////////////////////////////////////////////////////
+
+const ProtocolCommand *protocolLookup(const char *name, size_t length);
+const char *protocolCommandName(CommandId id);
+int protocolStripLine(char *line, int length);
+int protocolSplitTag(char *line, int length, char **command, int *commandLength);
+int protocolCheckArg(const ProtocolCommand *command, int index, int length);
+int protocolParseNumber(const char *text, int *value);
+int isValidUsername(const char *username);
+
+#endif
@@ -0,0 +1,197 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include "reclaim.h"
+#include "commands.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Pause zwischen zwei Blöcken, damit große DELs über die Zeit verteilt werden
+#define BATCH_PAUSE_NS (10 * 1000 * 1000)
+
+// vorgemerkte Postfächer (jedes höchstens einmal in der Liste)
+typedef struct PendingMailbox
+{
+   char userDir[512];
+   struct PendingMailbox *next;
+} PendingMailbox;
+
+static PendingMailbox *pending = NULL;
+static pthread_mutex_t pendingMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pendingCond = PTHREAD_COND_INITIALIZER;
+static int batchSize = 100;
+static int reclaimStop = 0;
+static pthread_t reclaimThread;
+static int reclaimRunning = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// löscht die Tombstones eines Postfachs, nach jedem Block eine Pause
+static void reclaimMailbox(const char *userDir)
+{
+   char path[600];
+   struct dirent *entry;
+   const struct timespec pause = {0, BATCH_PAUSE_NS};
+   int number;
+   char suffix[16];
+   int removed = 0;
+   int inBatch = 0;
+
+   DIR *dir = opendir(userDir);
+   if (dir == NULL)
+   {
+      return;
+   }
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (sscanf(entry->d_name, ".%d.%15s", &number, suffix) != 2 || strcmp(suffix, "deleted") != 0)
+      {
+         continue;
+      }
+      snprintf(path, sizeof(path), "%s/%s", userDir, entry->d_name);
+      if (unlink(path) == -1)
+      {
+         LOG_ERRNO("unlink %s failed", path);
+         continue;
+      }
+      removed++;
+      if (++inBatch == batchSize)
+      {
+         inBatch = 0;
+         nanosleep(&pause, NULL);
+      }
+   }
+   closedir(dir);
+
+   if (removed > 0)
+   {
+      LOG_DEBUG("Reclaimed %d deleted message(s) in %s", removed, userDir);
+   }
+}
+
+static void *reclaimWorker(void *data)
+{
+   (void)data;
+
+   pthread_mutex_lock(&pendingMutex);
+   while (!reclaimStop)
+   {
+      if (pending == NULL)
+      {
+         pthread_cond_wait(&pendingCond, &pendingMutex);
+         continue;
+      }
+
+      PendingMailbox *mailbox = pending;
+      pending = mailbox->next;
+      pthread_mutex_unlock(&pendingMutex);
+
+      reclaimMailbox(mailbox->userDir);
+      free(mailbox);
+
+      pthread_mutex_lock(&pendingMutex);
+   }
+   pthread_mutex_unlock(&pendingMutex);
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int reclaimInit(const ServerConfig *cfg)
+{
+   struct dirent *entry;
+   char userDir[512];
+
+   batchSize = cfg->reclaimBatch > 0 ? cfg->reclaimBatch : 100;
+
+   // Reste vom letzten Lauf
+   DIR *spool = opendir(mailSpoolDir);
+   if (spool != NULL)
+   {
+      while ((entry = readdir(spool)) != NULL)
+      {
+         if (entry->d_name[0] != '.' && isValidUsername(entry->d_name))
+         {
+            snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, entry->d_name);
+            reclaimSchedule(userDir);
+         }
+      }
+      closedir(spool);
+   }
+
+   reclaimStop = 0;
+   if (pthread_create(&reclaimThread, NULL, reclaimWorker, NULL) != 0)
+   {
+      LOG_ERROR("Could not start reclaim thread");
+      return -1;
+   }
+   reclaimRunning = 1;
+   return 0;
+}
+
+// übrige Tombstones bleiben liegen und werden beim nächsten Start gelöscht
+void reclaimShutdown(void)
+{
+   if (!reclaimRunning)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pendingMutex);
+   reclaimStop = 1;
+   pthread_cond_signal(&pendingCond);
+   pthread_mutex_unlock(&pendingMutex);
+   pthread_join(reclaimThread, NULL);
+   reclaimRunning = 0;
+
+   while (pending != NULL)
+   {
+      PendingMailbox *next = pending->next;
+      free(pending);
+      pending = next;
+   }
+}
+
+// DEL: <n>.txt -> .<n>.deleted, errno wie bei rename() (ENOENT wenn es
+// die Nachricht nicht gibt)
+int reclaimTombstone(const char *userDir, int number)
+{
+   char path[600];
+   char tombstone[600];
+
+   snprintf(path, sizeof(path), "%s/%d.txt", userDir, number);
+   snprintf(tombstone, sizeof(tombstone), "%s/.%d.deleted", userDir, number);
+   return rename(path, tombstone);
+}
+
+// merkt ein Postfach für den Reclaim-Thread vor
+void reclaimSchedule(const char *userDir)
+{
+   pthread_mutex_lock(&pendingMutex);
+   PendingMailbox **tail = &pending;
+   for (; *tail != NULL; tail = &(*tail)->next)
+   {
+      if (strcmp((*tail)->userDir, userDir) == 0)
+      {
+         pthread_mutex_unlock(&pendingMutex);
+         return; // schon vorgemerkt
+      }
+   }
+
+   PendingMailbox *mailbox = malloc(sizeof(PendingMailbox));
+   if (mailbox != NULL)
+   {
+      snprintf(mailbox->userDir, sizeof(mailbox->userDir), "%s", userDir);
+      mailbox->next = NULL;
+      *tail = mailbox;
+      pthread_cond_signal(&pendingCond);
+   }
+   pthread_mutex_unlock(&pendingMutex);
+}
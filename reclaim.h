@@ -0,0 +1,24 @@
+#ifndef TWMAILER_RECLAIM_H
+#define TWMAILER_RECLAIM_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Verzögertes Löschen für DEL
+// DEL benennt <n>.txt nur in den Tombstone .<n>.deleted um (reine
+// Metadaten-Operation im selben Verzeichnis, unabhängig von der Dateigröße)
+// und antwortet sofort. Alle Scans suchen "<n>.txt" und sehen Tombstones
+// daher nicht mehr. Ein Hintergrund-Thread löscht die Tombstones der
+// vorgemerkten Postfächer später in Blöcken von reclaim_batch Dateien.
+// Beim Start werden alle Postfächer einmal vorgemerkt (Tombstones, die vor
+// einem Absturz nicht mehr gelöscht wurden).
+
+///////////////////////////////////////////////////////////////////////////////
+
+int reclaimInit(const ServerConfig *cfg);
+void reclaimShutdown(void);
+int reclaimTombstone(const char *userDir, int number);
+void reclaimSchedule(const char *userDir);
+
+#endif
@@ -0,0 +1,380 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include "retention.h"
+#include "commands.h"
+#include "mailbox.h"
+#include "search.h"
+#include "reclaim.h"
+#include "notify.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ioprio_set() hat keinen glibc-Wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_BE_NORMAL 4 // Default-Stufe von best-effort
+
+// Pause zwischen zwei Blöcken, damit Sessions dazwischen auf Disk kommen
+#define BATCH_PAUSE_NS (50 * 1000 * 1000)
+
+typedef struct RetentionRule
+{
+   char username[256];
+   int maxDays;
+   int maxMessages;
+   struct RetentionRule *next;
+} RetentionRule;
+
+typedef struct MessageEntry
+{
+   int number;
+   time_t mtime;
+   long size;
+} MessageEntry;
+
+static int defaultDays = 0;
+static int defaultMessages = 0;
+static char ruleFile[256];
+static int sweepInterval = 3600;
+static int batchSize = 100;
+static int workerStop = 0;
+static pthread_t workerThread;
+static int workerRunning = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int stopRequested(void)
+{
+   return __atomic_load_n(&workerStop, __ATOMIC_ACQUIRE);
+}
+
+// retention_file wird bei jedem Durchgang neu gelesen (Änderungen ohne Neustart)
+static RetentionRule *loadRules(void)
+{
+   char line[512];
+   RetentionRule *rules = NULL;
+
+   if (ruleFile[0] == '\0')
+   {
+      return NULL;
+   }
+   FILE *file = fopen(ruleFile, "r");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", ruleFile);
+      return NULL;
+   }
+
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      RetentionRule rule;
+      if (line[0] == '#' || sscanf(line, "%255s %d %d", rule.username, &rule.maxDays, &rule.maxMessages) != 3)
+      {
+         continue;
+      }
+      RetentionRule *entry = malloc(sizeof(RetentionRule));
+      if (entry == NULL)
+      {
+         break;
+      }
+      *entry = rule;
+      entry->next = rules;
+      rules = entry;
+   }
+   fclose(file);
+   return rules;
+}
+
+static void freeRules(RetentionRule *rules)
+{
+   while (rules != NULL)
+   {
+      RetentionRule *next = rules->next;
+      free(rules);
+      rules = next;
+   }
+}
+
+static int compareEntries(const void *a, const void *b)
+{
+   const MessageEntry *x = a;
+   const MessageEntry *y = b;
+   return (x->number > y->number) - (x->number < y->number);
+}
+
+// alle Nachrichten mit Alter und Größe, aufsteigend nach Nummer (= älteste
+// zuerst), -1 bei Fehler
+static int scanMailbox(const char *userDir, MessageEntry **entries)
+{
+   char path[600];
+   struct dirent *entry;
+   struct stat info;
+   int number;
+   int count = 0;
+   int capacity = 64;
+
+   DIR *dir = opendir(userDir);
+   if (dir == NULL)
+   {
+      return -1;
+   }
+   *entries = malloc(capacity * sizeof(MessageEntry));
+   if (*entries == NULL)
+   {
+      closedir(dir);
+      return -1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (sscanf(entry->d_name, "%d.txt", &number) != 1)
+      {
+         continue;
+      }
+      if (snprintf(path, sizeof(path), "%s/%s", userDir, entry->d_name) >= (int)sizeof(path) ||
+          stat(path, &info) == -1)
+      {
+         continue; // Pfad zu lang oder inzwischen per DEL gelöscht
+      }
+      if (count == capacity)
+      {
+         MessageEntry *grown = realloc(*entries, 2 * capacity * sizeof(MessageEntry));
+         if (grown == NULL)
+         {
+            break;
+         }
+         *entries = grown;
+         capacity *= 2;
+      }
+      (*entries)[count].number = number;
+      (*entries)[count].mtime = info.st_mtime;
+      (*entries)[count].size = info.st_size;
+      count++;
+   }
+   closedir(dir);
+
+   qsort(*entries, count, sizeof(MessageEntry), compareEntries);
+   return count;
+}
+
+// I/O-Klasse nur für diesen Thread (unter Linux), idle für Scan und unlink(),
+// normal solange die Sperre gehalten wird: mit idle könnte der Thread bei
+// viel I/O beliebig lange warten und alle Sessions des Postfachs mit ihm
+static void setIoPriority(int idle)
+{
+#ifdef SYS_ioprio_set
+   int value = idle ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+                    : (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_BE_NORMAL;
+   if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, value) == -1)
+   {
+      LOG_ERRNO("ioprio_set failed");
+   }
+#else
+   (void)idle;
+#endif
+}
+
+// löscht einen Block wie DEL: unter der exklusiven Sperre nur umbenennen
+// (Tombstones wie bei DEL) und .changes/.meta und Suchindex, die Dateien
+// selbst erst danach mit niedriger I/O-Priorität.
+static int deleteBatch(const char *username, const char *userDir,
+                       const MessageEntry *victims, int count, int *numbers)
+{
+   char path[600];
+   int deleted = 0;
+   long bytes = 0;
+
+   setIoPriority(0);
+   if (mailboxLockExclusive(userDir) == -1)
+   {
+      setIoPriority(1);
+      return 0;
+   }
+   for (int i = 0; i < count; i++)
+   {
+      if (reclaimTombstone(userDir, victims[i].number) == 0)
+      {
+         numbers[deleted++] = victims[i].number;
+         bytes += victims[i].size;
+      }
+   }
+
+   if (deleted > 0)
+   {
+      mailboxLogDeletes(userDir, numbers, deleted, bytes);
+      searchRemove(userDir, numbers, deleted);
+   }
+   mailboxUnlock(userDir);
+   setIoPriority(1);
+
+   // nach einem Absturz hier räumt reclaim.c die Tombstones beim Start weg
+   for (int i = 0; i < deleted; i++)
+   {
+      snprintf(path, sizeof(path), "%s/.%d.deleted", userDir, numbers[i]);
+      if (unlink(path) == -1 && errno != ENOENT) // evtl. schon vom Reclaim-Thread
+      {
+         LOG_ERRNO("unlink %s failed", path);
+      }
+   }
+
+   if (deleted > 0)
+   {
+      notifyMailbox(username);
+   }
+   return deleted;
+}
+
+static void expireMailbox(const char *username, int maxDays, int maxMessages)
+{
+   char userDir[512];
+   MessageEntry *entries;
+   const struct timespec pause = {0, BATCH_PAUSE_NS};
+
+   snprintf(userDir, sizeof(userDir), "%s/%s", mailSpoolDir, username);
+   int count = scanMailbox(userDir, &entries);
+   if (count <= 0)
+   {
+      if (count == 0)
+      {
+         free(entries);
+      }
+      return;
+   }
+
+   // die ältesten über maxMessages und alles älter als maxDays, in-place
+   // nach vorne sortiert (entries ist aufsteigend)
+   time_t cutoff = maxDays > 0 ? time(NULL) - (time_t)maxDays * 24 * 60 * 60 : 0;
+   int excess = maxMessages > 0 && count > maxMessages ? count - maxMessages : 0;
+   int victims = 0;
+   for (int i = 0; i < count; i++)
+   {
+      if (i < excess || entries[i].mtime < cutoff)
+      {
+         entries[victims++] = entries[i];
+      }
+   }
+
+   int *numbers = malloc(batchSize * sizeof(int));
+   int expired = 0;
+   for (int start = 0; numbers != NULL && start < victims && !stopRequested(); start += batchSize)
+   {
+      int length = victims - start < batchSize ? victims - start : batchSize;
+      expired += deleteBatch(username, userDir, entries + start, length, numbers);
+      nanosleep(&pause, NULL);
+   }
+
+   if (expired > 0)
+   {
+      LOG_INFO("Retention: %d message(s) expired for user %s", expired, username);
+   }
+   free(numbers);
+   free(entries);
+}
+
+static void sweep(void)
+{
+   struct dirent *entry;
+
+   DIR *spool = opendir(mailSpoolDir);
+   if (spool == NULL)
+   {
+      LOG_ERRNO("opendir %s failed", mailSpoolDir);
+      return;
+   }
+
+   RetentionRule *rules = loadRules();
+   while ((entry = readdir(spool)) != NULL && !stopRequested())
+   {
+      if (entry->d_name[0] == '.' || !isValidUsername(entry->d_name))
+      {
+         continue;
+      }
+
+      int maxDays = defaultDays;
+      int maxMessages = defaultMessages;
+      for (RetentionRule *rule = rules; rule != NULL; rule = rule->next)
+      {
+         if (strcmp(rule->username, entry->d_name) == 0)
+         {
+            maxDays = rule->maxDays;
+            maxMessages = rule->maxMessages;
+            break;
+         }
+      }
+      if (maxDays > 0 || maxMessages > 0)
+      {
+         expireMailbox(entry->d_name, maxDays, maxMessages);
+      }
+   }
+   freeRules(rules);
+   closedir(spool);
+}
+
+static void *retentionWorker(void *data)
+{
+   (void)data;
+   const struct timespec second = {1, 0};
+
+   setIoPriority(1);
+   while (!stopRequested())
+   {
+      sweep();
+
+      // in 1s Schritten schlafen, damit retentionShutdown() nicht lange wartet
+      for (int i = 0; i < sweepInterval && !stopRequested(); i++)
+      {
+         nanosleep(&second, NULL);
+      }
+   }
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int retentionInit(const ServerConfig *cfg)
+{
+   defaultDays = cfg->retentionDays;
+   defaultMessages = cfg->retentionMaxMessages;
+   snprintf(ruleFile, sizeof(ruleFile), "%s", cfg->retentionFile);
+   sweepInterval = cfg->retentionInterval > 0 ? cfg->retentionInterval : 3600;
+   batchSize = cfg->retentionBatch > 0 ? cfg->retentionBatch : 100;
+
+   if (defaultDays <= 0 && defaultMessages <= 0 && ruleFile[0] == '\0')
+   {
+      return 0; // keine Regeln, kein Thread
+   }
+
+   workerStop = 0;
+   if (pthread_create(&workerThread, NULL, retentionWorker, NULL) != 0)
+   {
+      LOG_ERROR("Could not start retention thread");
+      return -1;
+   }
+   workerRunning = 1;
+   LOG_INFO("Retention: max %d days, max %d messages, every %d s",
+            defaultDays, defaultMessages, sweepInterval);
+   return 0;
+}
+
+void retentionShutdown(void)
+{
+   if (workerRunning)
+   {
+      __atomic_store_n(&workerStop, 1, __ATOMIC_RELEASE);
+      pthread_join(workerThread, NULL);
+      workerRunning = 0;
+   }
+}
@@ -0,0 +1,22 @@
+#ifndef TWMAILER_RETENTION_H
+#define TWMAILER_RETENTION_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Hintergrund-Thread, der alte Nachrichten löscht (statt cron + find -delete)
+// Regeln: retention_days (max. Alter) und retention_max_messages (die
+// ältesten darüber werden gelöscht), pro User überschreibbar in
+// retention_file mit Zeilen "<user> <max_days> <max_messages>" (0 = kein
+// Limit). Alle retention_interval Sekunden werden alle Postfächer geprüft,
+// gelöscht wird in Blöcken von retention_batch Nachrichten, jeweils wie ein
+// DEL (.changes/.meta, Suchindex, IDLE-Sessions). Der Thread läuft mit
+// niedriger I/O-Priorität, nur nicht solange er eine Postfach-Sperre hält.
+
+///////////////////////////////////////////////////////////////////////////////
+
+int retentionInit(const ServerConfig *cfg);
+void retentionShutdown(void);
+
+#endif
@@ -0,0 +1,255 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sched.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define BUCKET_SLOTS 256
+
+// Token Bucket pro User, wird beim ersten Command angelegt
+typedef struct Bucket
+{
+   char name[256];
+   double tokens; // < 0: so viele Commands warten schon
+   struct timespec updated;
+   struct Bucket *next;
+} Bucket;
+
+static Bucket *buckets[BUCKET_SLOTS];
+static pthread_mutex_t bucketMutex = PTHREAD_MUTEX_INITIALIZER;
+static double rateLimit = 0; // Commands pro Sekunde, 0 = aus
+static double rateBurst = 1;
+static unsigned long throttled = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void fairInit(FairQueue *queue)
+{
+   queue->current = NULL;
+   queue->unused = NULL;
+   queue->length = 0;
+}
+
+// Queue muss leer sein
+void fairDestroy(FairQueue *queue)
+{
+   while (queue->unused != NULL)
+   {
+      FairUser *user = queue->unused;
+      queue->unused = user->next;
+      free(user);
+   }
+}
+
+// hängt item an die Queue von user an, -1 wenn kein Speicher für einen
+// neuen User da ist
+// linear über die aktiven User (nur User mit wartenden Einträgen)
+int fairPush(FairQueue *queue, const char *user, FairItem *item, int cost)
+{
+   FairUser *entry = queue->current;
+
+   item->next = NULL;
+   item->cost = cost > 0 ? cost : 1;
+
+   if (entry != NULL)
+   {
+      do
+      {
+         if (strcmp(entry->name, user) == 0)
+         {
+            entry->tail->next = item;
+            entry->tail = item;
+            queue->length++;
+            return 0;
+         }
+         entry = entry->next;
+      } while (entry != queue->current);
+   }
+
+   // neuer aktiver User
+   entry = queue->unused;
+   if (entry != NULL)
+   {
+      queue->unused = entry->next;
+   }
+   else if ((entry = malloc(sizeof(FairUser))) == NULL)
+   {
+      return -1;
+   }
+   snprintf(entry->name, sizeof(entry->name), "%s", user);
+   entry->head = item;
+   entry->tail = item;
+
+   if (queue->current == NULL)
+   {
+      entry->deficit = FAIR_QUANTUM;
+      entry->prev = entry;
+      entry->next = entry;
+      queue->current = entry;
+   }
+   else
+   {
+      // ans Ende der Runde, Guthaben gibt es wenn er dran ist
+      entry->deficit = 0;
+      entry->prev = queue->current->prev;
+      entry->next = queue->current;
+      entry->prev->next = entry;
+      queue->current->prev = entry;
+   }
+   queue->length++;
+   return 0;
+}
+
+// nächster Eintrag nach Deficit Round-Robin, NULL wenn die Queue leer ist
+FairItem *fairPop(FairQueue *queue)
+{
+   if (queue->current == NULL)
+   {
+      return NULL;
+   }
+
+   // zum nächsten User mit genug Guthaben (terminiert, jeder bekommt pro
+   // Runde FAIR_QUANTUM dazu)
+   while (queue->current->head->cost > queue->current->deficit)
+   {
+      queue->current = queue->current->next;
+      queue->current->deficit += FAIR_QUANTUM;
+   }
+
+   FairUser *user = queue->current;
+   FairItem *item = user->head;
+   user->head = item->next;
+   user->deficit -= item->cost;
+   queue->length--;
+
+   if (user->head == NULL)
+   {
+      // keine wartenden Einträge mehr: aus dem Ring, Guthaben verfällt
+      if (user->next == user)
+      {
+         queue->current = NULL;
+      }
+      else
+      {
+         user->prev->next = user->next;
+         user->next->prev = user->prev;
+         queue->current = user->next;
+         queue->current->deficit += FAIR_QUANTUM;
+      }
+      user->next = queue->unused;
+      queue->unused = user;
+   }
+   return item;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int schedInit(const ServerConfig *cfg)
+{
+   rateLimit = cfg->userRateLimit > 0 ? cfg->userRateLimit : 0;
+   rateBurst = cfg->userRateBurst > 0 ? cfg->userRateBurst : 1;
+   if (rateLimit > 0)
+   {
+      LOG_INFO("Rate limit: %g commands/s per user, burst %g", rateLimit, rateBurst);
+   }
+   return 0;
+}
+
+void schedShutdown(void)
+{
+   pthread_mutex_lock(&bucketMutex);
+   for (int i = 0; i < BUCKET_SLOTS; i++)
+   {
+      while (buckets[i] != NULL)
+      {
+         Bucket *bucket = buckets[i];
+         buckets[i] = bucket->next;
+         free(bucket);
+      }
+   }
+   pthread_mutex_unlock(&bucketMutex);
+}
+
+// wartet falls user über user_rate_limit ist
+// das Token wird gleich reserviert, mehrere Sessions desselben Users warten
+// also hintereinander, liefert die Wartezeit in Mikrosekunden
+unsigned long schedThrottle(const char *user)
+{
+   struct timespec now;
+   unsigned int hash = 0;
+   Bucket *bucket;
+   double wait = 0;
+
+   if (rateLimit <= 0 || user[0] == '\0')
+   {
+      return 0;
+   }
+
+   for (const char *c = user; *c != '\0'; c++)
+   {
+      hash = hash * 31 + (unsigned char)*c;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   pthread_mutex_lock(&bucketMutex);
+   for (bucket = buckets[hash % BUCKET_SLOTS]; bucket != NULL; bucket = bucket->next)
+   {
+      if (strcmp(bucket->name, user) == 0)
+      {
+         break;
+      }
+   }
+   if (bucket == NULL)
+   {
+      bucket = malloc(sizeof(Bucket));
+      if (bucket == NULL)
+      {
+         pthread_mutex_unlock(&bucketMutex);
+         return 0; // ohne Limit weiter
+      }
+      snprintf(bucket->name, sizeof(bucket->name), "%s", user);
+      bucket->tokens = rateBurst;
+      bucket->updated = now;
+      bucket->next = buckets[hash % BUCKET_SLOTS];
+      buckets[hash % BUCKET_SLOTS] = bucket;
+   }
+
+   // nachfüllen, höchstens bis zum Burst
+   bucket->tokens += ((now.tv_sec - bucket->updated.tv_sec) +
+                      (now.tv_nsec - bucket->updated.tv_nsec) / 1e9) * rateLimit;
+   if (bucket->tokens > rateBurst)
+   {
+      bucket->tokens = rateBurst;
+   }
+   bucket->updated = now;
+
+   bucket->tokens -= 1;
+   if (bucket->tokens < 0)
+   {
+      wait = -bucket->tokens / rateLimit;
+      throttled++;
+   }
+   pthread_mutex_unlock(&bucketMutex);
+
+   if (wait > 0)
+   {
+      struct timespec pause = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+      LOG_DEBUG("User %s over rate limit, waiting %.3f s", user, wait);
+      nanosleep(&pause, NULL);
+   }
+   return (unsigned long)(wait * 1e6);
+}
+
+// Commands, die wegen user_rate_limit warten mussten (für STATS)
+unsigned long schedThrottledCount(void)
+{
+   pthread_mutex_lock(&bucketMutex);
+   unsigned long count = throttled;
+   pthread_mutex_unlock(&bucketMutex);
+   return count;
+}
@@ -0,0 +1,59 @@
+#ifndef TWMAILER_SCHED_H
+#define TWMAILER_SCHED_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Faire Verteilung der gemeinsamen Worker auf die User
+// FairQueue: eine Queue pro User (sessionUsername), bedient mit Deficit
+// Round-Robin. Jeder User mit wartenden Einträgen bekommt pro Runde
+// FAIR_QUANTUM Kosten-Einheiten, ein Eintrag wird erst genommen, wenn sein
+// User genug Guthaben hat. Ein User mit vielen Einträgen (Batch-SEND, Export
+// mit mehreren Verbindungen) bekommt damit nicht mehr Worker als ein User mit
+// einem einzelnen Command. Verwendet von der Command-Queue (tagged.c) und dem
+// Disk-Pool (diskpool.c), die eigene Synchronisation bleibt beim Aufrufer.
+//
+// Rate-Limit pro User (user_rate_limit Commands pro Sekunde, Burst
+// user_rate_burst): darüber wartet die Session vor dem Command, bis wieder
+// ein Token frei ist (nur dieser User wird langsamer, kein BUSY).
+
+#define FAIR_QUANTUM 1
+
+// wird in den eigenen Job eingebettet (kein malloc pro Eintrag)
+typedef struct FairItem
+{
+   struct FairItem *next;
+   int cost; // >= 1, z.B. 1 pro Disk-Job
+} FairItem;
+
+typedef struct FairUser
+{
+   char name[256];
+   FairItem *head;
+   FairItem *tail;
+   int deficit;
+   struct FairUser *prev; // Ring der User mit wartenden Einträgen
+   struct FairUser *next;
+} FairUser;
+
+typedef struct FairQueue
+{
+   FairUser *current; // NULL wenn die Queue leer ist
+   FairUser *unused;  // Liste freier FairUser für den nächsten User
+   int length;
+} FairQueue;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void fairInit(FairQueue *queue);
+void fairDestroy(FairQueue *queue);
+int fairPush(FairQueue *queue, const char *user, FairItem *item, int cost);
+FairItem *fairPop(FairQueue *queue);
+
+int schedInit(const ServerConfig *cfg);
+void schedShutdown(void);
+unsigned long schedThrottle(const char *user);
+unsigned long schedThrottledCount(void);
+
+#endif
@@ -0,0 +1,959 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "search.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define MIN_WORD 2
+#define MAX_WORD 32      // längere Wörter werden abgeschnitten
+#define COMPACT_MIN 1000 // neuer Snapshot frühestens nach so vielen Änderungen
+
+typedef struct Term
+{
+   struct Term *next; // Hash-Kette
+   int *numbers;      // aufsteigend sortiert
+   int count;
+   int capacity;
+   char word[MAX_WORD + 1];
+} Term;
+
+typedef struct SearchIndex
+{
+   char userDir[512];
+   Term **buckets;
+   size_t bucketCount;
+   size_t termCount;
+   int logEntries; // angehängte "+"/"-" Zeilen seit dem letzten Snapshot
+   int loaded;     // Terms gelesen (schreiben nur mit mutex und cacheMutex)
+   pthread_mutex_t mutex; // Terms, logEntries und die Datei .index
+   int refs;              // Benutzer, die den Eintrag gerade halten
+   struct SearchIndex *prev; // LRU-Liste, vorne = zuletzt verwendet
+   struct SearchIndex *next;
+} SearchIndex;
+
+typedef struct WordList
+{
+   char (*words)[MAX_WORD + 1];
+   int count;
+   int capacity;
+} WordList;
+
+static SearchIndex *indexes = NULL;
+static int indexCount = 0; // geladene Einträge
+static int cacheSize = 32;
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER; // nur die LRU-Liste
+
+///////////////////////////////////////////////////////////////////////////////
+// WÖRTER
+
+static int isWordChar(unsigned char c)
+{
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c >= 0x80; // UTF-8 (Umlaute usw.)
+}
+
+// hängt alle Wörter aus text (höchstens length Bytes) an list an
+static int addWords(WordList *list, const char *text, size_t length)
+{
+   size_t i = 0;
+
+   while (i < length)
+   {
+      while (i < length && !isWordChar((unsigned char)text[i]))
+      {
+         i++;
+      }
+
+      char word[MAX_WORD + 1];
+      int wordLength = 0;
+      while (i < length && isWordChar((unsigned char)text[i]))
+      {
+         if (wordLength < MAX_WORD)
+         {
+            char c = text[i];
+            word[wordLength++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+         }
+         i++;
+      }
+      if (wordLength < MIN_WORD)
+      {
+         continue;
+      }
+      word[wordLength] = '\0';
+
+      if (list->count == list->capacity)
+      {
+         int capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+         void *grown = realloc(list->words, capacity * sizeof(list->words[0]));
+         if (grown == NULL)
+         {
+            return -1;
+         }
+         list->words = grown;
+         list->capacity = capacity;
+      }
+      strcpy(list->words[list->count++], word);
+   }
+   return 0;
+}
+
+static int compareWords(const void *a, const void *b)
+{
+   return strcmp(a, b);
+}
+
+// sortiert und entfernt doppelte Wörter
+static void uniqueWords(WordList *list)
+{
+   int unique = 0;
+
+   qsort(list->words, list->count, sizeof(list->words[0]), compareWords);
+   for (int i = 0; i < list->count; i++)
+   {
+      if (unique == 0 || strcmp(list->words[unique - 1], list->words[i]) != 0)
+      {
+         memmove(list->words[unique++], list->words[i], sizeof(list->words[0]));
+      }
+   }
+   list->count = unique;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HASH-TABELLE
+
+// FNV-1a
+static size_t hashWord(const char *word)
+{
+   size_t hash = 2166136261u;
+
+   for (; *word != '\0'; word++)
+   {
+      hash = (hash ^ (unsigned char)*word) * 16777619u;
+   }
+   return hash;
+}
+
+static int growBuckets(SearchIndex *index)
+{
+   size_t bucketCount = index->bucketCount == 0 ? 1024 : index->bucketCount * 2;
+   Term **buckets = calloc(bucketCount, sizeof(Term *));
+   if (buckets == NULL)
+   {
+      return -1;
+   }
+
+   for (size_t i = 0; i < index->bucketCount; i++)
+   {
+      Term *term = index->buckets[i];
+      while (term != NULL)
+      {
+         Term *next = term->next;
+         size_t bucket = hashWord(term->word) & (bucketCount - 1);
+         term->next = buckets[bucket];
+         buckets[bucket] = term;
+         term = next;
+      }
+   }
+   free(index->buckets);
+   index->buckets = buckets;
+   index->bucketCount = bucketCount;
+   return 0;
+}
+
+static Term *findTerm(SearchIndex *index, const char *word, int create)
+{
+   if (index->bucketCount == 0)
+   {
+      if (!create || growBuckets(index) == -1)
+      {
+         return NULL;
+      }
+   }
+
+   size_t bucket = hashWord(word) & (index->bucketCount - 1);
+   for (Term *term = index->buckets[bucket]; term != NULL; term = term->next)
+   {
+      if (strcmp(term->word, word) == 0)
+      {
+         return term;
+      }
+   }
+   if (!create)
+   {
+      return NULL;
+   }
+
+   // im Schnitt höchstens 2 Terms pro Kette
+   if (index->termCount >= index->bucketCount * 2)
+   {
+      if (growBuckets(index) == -1)
+      {
+         return NULL;
+      }
+      bucket = hashWord(word) & (index->bucketCount - 1);
+   }
+
+   Term *term = calloc(1, sizeof(Term));
+   if (term == NULL)
+   {
+      return NULL;
+   }
+   snprintf(term->word, sizeof(term->word), "%s", word);
+   term->next = index->buckets[bucket];
+   index->buckets[bucket] = term;
+   index->termCount++;
+   return term;
+}
+
+// Nummern kommen fast immer aufsteigend (werden nie wieder vergeben)
+static int termAdd(Term *term, int number)
+{
+   int position = term->count;
+
+   while (position > 0 && term->numbers[position - 1] >= number)
+   {
+      if (term->numbers[position - 1] == number)
+      {
+         return 0; // schon drin
+      }
+      position--;
+   }
+
+   if (term->count == term->capacity)
+   {
+      int capacity = term->capacity == 0 ? 4 : term->capacity * 2;
+      int *grown = realloc(term->numbers, capacity * sizeof(int));
+      if (grown == NULL)
+      {
+         return -1;
+      }
+      term->numbers = grown;
+      term->capacity = capacity;
+   }
+   memmove(term->numbers + position + 1, term->numbers + position,
+           (term->count - position) * sizeof(int));
+   term->numbers[position] = number;
+   term->count++;
+   return 0;
+}
+
+static int compareNumbers(const void *a, const void *b)
+{
+   int left = *(const int *)a;
+   int right = *(const int *)b;
+   return (left > right) - (left < right);
+}
+
+// entfernt die (sortierten) Nummern aus allen Terms, ein Durchgang
+static void indexRemove(SearchIndex *index, const int *numbers, int count)
+{
+   for (size_t i = 0; i < index->bucketCount; i++)
+   {
+      Term **link = &index->buckets[i];
+      while (*link != NULL)
+      {
+         Term *term = *link;
+         int kept = 0;
+
+         for (int j = 0; j < term->count; j++)
+         {
+            if (bsearch(&term->numbers[j], numbers, count, sizeof(int), compareNumbers) == NULL)
+            {
+               term->numbers[kept++] = term->numbers[j];
+            }
+         }
+         term->count = kept;
+
+         if (kept == 0)
+         {
+            *link = term->next;
+            free(term->numbers);
+            free(term);
+            index->termCount--;
+         }
+         else
+         {
+            link = &term->next;
+         }
+      }
+   }
+}
+
+// alle Terms freigeben (auch nach halb fehlgeschlagenem Laden)
+static void indexClear(SearchIndex *index)
+{
+   for (size_t i = 0; i < index->bucketCount; i++)
+   {
+      Term *term = index->buckets[i];
+      while (term != NULL)
+      {
+         Term *next = term->next;
+         free(term->numbers);
+         free(term);
+         term = next;
+      }
+   }
+   free(index->buckets);
+   index->buckets = NULL;
+   index->bucketCount = 0;
+   index->termCount = 0;
+   index->logEntries = 0;
+}
+
+static void indexFree(SearchIndex *index)
+{
+   indexClear(index);
+   pthread_mutex_destroy(&index->mutex);
+   free(index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PERSISTENZ
+
+static void indexPath(const char *userDir, char *path, size_t size)
+{
+   snprintf(path, size, "%s/.index", userDir);
+}
+
+// schreibt alle Terms als Snapshot (tmp-Datei + rename), danach ist das Log leer
+static int writeSnapshot(SearchIndex *index)
+{
+   char path[600];
+   char tmpPath[610];
+
+   indexPath(index->userDir, path, sizeof(path));
+   snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+   FILE *file = fopen(tmpPath, "w");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", tmpPath);
+      return -1;
+   }
+   for (size_t i = 0; i < index->bucketCount; i++)
+   {
+      for (Term *term = index->buckets[i]; term != NULL; term = term->next)
+      {
+         fprintf(file, "= %s", term->word);
+         for (int j = 0; j < term->count; j++)
+         {
+            fprintf(file, " %d", term->numbers[j]);
+         }
+         fputc('\n', file);
+      }
+   }
+   if (fclose(file) != 0 || rename(tmpPath, path) == -1)
+   {
+      LOG_ERRNO("write %s failed", path);
+      unlink(tmpPath);
+      return -1;
+   }
+
+   LOG_DEBUG("Search index %s compacted (%zu terms)", path, index->termCount);
+   index->logEntries = 0;
+   return 0;
+}
+
+static void maybeCompact(SearchIndex *index)
+{
+   if (index->logEntries >= COMPACT_MIN && (size_t)index->logEntries > index->termCount)
+   {
+      writeSnapshot(index);
+   }
+}
+
+// Wörter einer Nachrichtendatei: Sender, Subject und Body (ohne Empfänger,
+// der steht in jeder Nachricht des Postfachs)
+static int addMessageWords(WordList *list, const char *path)
+{
+   char line[1024];
+   int lineNumber = 0;
+
+   FILE *file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return -1;
+   }
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      if (++lineNumber != 2 && addWords(list, line, strlen(line)) == -1)
+      {
+         fclose(file);
+         return -1;
+      }
+   }
+   fclose(file);
+   return 0;
+}
+
+// Postfach ohne .index: alle Nachrichten einmal lesen, aufsteigend, damit
+// termAdd() immer nur anhängt
+static int buildFromMessages(SearchIndex *index)
+{
+   char path[800];
+   struct dirent *entry;
+   WordList words = {NULL, 0, 0};
+   int *numbers = NULL;
+   int count = 0;
+   int capacity = 0;
+   int number;
+   int result = 0;
+
+   DIR *dir = opendir(index->userDir);
+   if (dir != NULL)
+   {
+      while ((entry = readdir(dir)) != NULL)
+      {
+         if (sscanf(entry->d_name, "%d.txt", &number) != 1)
+         {
+            continue;
+         }
+         if (count == capacity)
+         {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            int *grown = realloc(numbers, capacity * sizeof(int));
+            if (grown == NULL)
+            {
+               free(numbers);
+               closedir(dir);
+               return -1;
+            }
+            numbers = grown;
+         }
+         numbers[count++] = number;
+      }
+      closedir(dir);
+   }
+   qsort(numbers, count, sizeof(int), compareNumbers);
+
+   for (int i = 0; i < count && result == 0; i++)
+   {
+      snprintf(path, sizeof(path), "%s/%d.txt", index->userDir, numbers[i]);
+      words.count = 0;
+      if (addMessageWords(&words, path) == -1)
+      {
+         continue; // inzwischen gelöscht
+      }
+      uniqueWords(&words);
+      for (int j = 0; j < words.count; j++)
+      {
+         Term *term = findTerm(index, words.words[j], 1);
+         if (term == NULL || termAdd(term, numbers[i]) == -1)
+         {
+            result = -1;
+            break;
+         }
+      }
+   }
+   free(words.words);
+   free(numbers);
+   if (result == -1)
+   {
+      return -1;
+   }
+
+   LOG_INFO("Search index for %s built from %d messages", index->userDir, count);
+   return writeSnapshot(index);
+}
+
+// liest Snapshot + Log, gelöschte Nachrichten werden am Ende in einem
+// Durchgang entfernt (Nummern werden nie wieder vergeben)
+static int replayLog(SearchIndex *index, FILE *file)
+{
+   char *line = NULL;
+   size_t lineCapacity = 0;
+   int *deleted = NULL;
+   int deletedCount = 0;
+   int deletedCapacity = 0;
+   int result = 0;
+
+   while (result == 0 && getline(&line, &lineCapacity, file) != -1)
+   {
+      char *position = line + 2;
+      char *word;
+      char *saveptr;
+      int number;
+
+      line[strcspn(line, "\n")] = '\0';
+      if (line[0] == '=' && (word = strtok_r(position, " ", &saveptr)) != NULL)
+      {
+         Term *term = findTerm(index, word, 1);
+         char *value;
+         while (term != NULL && (value = strtok_r(NULL, " ", &saveptr)) != NULL)
+         {
+            termAdd(term, atoi(value));
+         }
+         result = term == NULL ? -1 : 0;
+      }
+      else if (line[0] == '+' && sscanf(position, "%d", &number) == 1)
+      {
+         strtok_r(position, " ", &saveptr);
+         while ((word = strtok_r(NULL, " ", &saveptr)) != NULL)
+         {
+            Term *term = findTerm(index, word, 1);
+            if (term == NULL || termAdd(term, number) == -1)
+            {
+               result = -1;
+               break;
+            }
+         }
+         index->logEntries++;
+      }
+      else if (line[0] == '-' && sscanf(position, "%d", &number) == 1)
+      {
+         if (deletedCount == deletedCapacity)
+         {
+            deletedCapacity = deletedCapacity == 0 ? 64 : deletedCapacity * 2;
+            int *grown = realloc(deleted, deletedCapacity * sizeof(int));
+            if (grown == NULL)
+            {
+               result = -1;
+               break;
+            }
+            deleted = grown;
+         }
+         deleted[deletedCount++] = number;
+         index->logEntries++;
+      }
+   }
+   free(line);
+
+   if (result == 0 && deletedCount > 0)
+   {
+      qsort(deleted, deletedCount, sizeof(int), compareNumbers);
+      indexRemove(index, deleted, deletedCount);
+   }
+   free(deleted);
+   return result;
+}
+
+static void appendLog(const char *userDir, const char *text, size_t length)
+{
+   char path[600];
+
+   indexPath(userDir, path, sizeof(path));
+   FILE *file = fopen(path, "a");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", path);
+      return;
+   }
+   fwrite(text, 1, length, file);
+   if (fclose(file) != 0)
+   {
+      LOG_ERRNO("write %s failed", path);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CACHE
+// cacheMutex schützt nur die LRU-Liste, indexCount und refs. Laden, Suchen
+// und alle Dateizugriffe laufen unter index->mutex, andere Postfächer warten
+// also nicht darauf. Reihenfolge: index->mutex vor cacheMutex.
+
+static void unlinkIndex(SearchIndex *index)
+{
+   if (index->prev != NULL)
+   {
+      index->prev->next = index->next;
+   }
+   else
+   {
+      indexes = index->next;
+   }
+   if (index->next != NULL)
+   {
+      index->next->prev = index->prev;
+   }
+}
+
+static void pushFront(SearchIndex *index)
+{
+   index->prev = NULL;
+   index->next = indexes;
+   if (indexes != NULL)
+   {
+      indexes->prev = index;
+   }
+   indexes = index;
+}
+
+static SearchIndex *findLoaded(const char *userDir)
+{
+   for (SearchIndex *index = indexes; index != NULL; index = index->next)
+   {
+      if (strcmp(index->userDir, userDir) == 0)
+      {
+         return index;
+      }
+   }
+   return NULL;
+}
+
+// über search_cache_size: ältesten unbenutzten Eintrag aus der Liste nehmen
+// (freigeben ohne cacheMutex), NULL wenn keiner zu viel ist oder alle
+// gerade benutzt werden
+static SearchIndex *evictOldest(void)
+{
+   SearchIndex *oldest = indexes;
+
+   if (indexCount <= cacheSize || oldest == NULL)
+   {
+      return NULL;
+   }
+   while (oldest->next != NULL)
+   {
+      oldest = oldest->next;
+   }
+   while (oldest != NULL && (oldest->refs > 0 || !oldest->loaded))
+   {
+      oldest = oldest->prev;
+   }
+   if (oldest != NULL)
+   {
+      unlinkIndex(oldest);
+      indexCount--;
+   }
+   return oldest;
+}
+
+// Eintrag für userDir an den Anfang der LRU-Liste, mit releaseIndex()
+// wieder abgeben. Ein neuer Eintrag ist noch nicht geladen (loadIndex()),
+// dient aber schon als Sperre für die Datei .index.
+static SearchIndex *acquireIndex(const char *userDir)
+{
+   pthread_mutex_lock(&cacheMutex);
+   SearchIndex *index = findLoaded(userDir);
+   if (index != NULL)
+   {
+      unlinkIndex(index);
+   }
+   else
+   {
+      index = calloc(1, sizeof(SearchIndex));
+      if (index == NULL)
+      {
+         pthread_mutex_unlock(&cacheMutex);
+         LOG_ERROR("Out of memory loading search index");
+         return NULL;
+      }
+      snprintf(index->userDir, sizeof(index->userDir), "%s", userDir);
+      pthread_mutex_init(&index->mutex, NULL);
+   }
+   pushFront(index);
+   index->refs++;
+   pthread_mutex_unlock(&cacheMutex);
+   return index;
+}
+
+// nicht geladene Einträge verschwinden mit dem letzten Benutzer wieder
+static void releaseIndex(SearchIndex *index)
+{
+   SearchIndex *evicted;
+
+   pthread_mutex_lock(&cacheMutex);
+   if (--index->refs == 0 && !index->loaded)
+   {
+      unlinkIndex(index);
+      evicted = index;
+   }
+   else
+   {
+      evicted = evictOldest(); // falls beim Laden alle benutzt wurden
+   }
+   pthread_mutex_unlock(&cacheMutex);
+
+   if (evicted != NULL)
+   {
+      indexFree(evicted);
+   }
+}
+
+// liest .index bzw. indexiert alle Nachrichten, index->mutex muss gehalten
+// werden
+static int loadIndex(SearchIndex *index)
+{
+   char path[600];
+   int result;
+
+   if (index->loaded)
+   {
+      return 0;
+   }
+
+   indexPath(index->userDir, path, sizeof(path));
+   FILE *file = fopen(path, "r");
+   if (file != NULL)
+   {
+      result = replayLog(index, file);
+      fclose(file);
+      if (result == 0)
+      {
+         maybeCompact(index);
+      }
+   }
+   else
+   {
+      result = buildFromMessages(index);
+   }
+   if (result == -1)
+   {
+      LOG_ERROR("Could not load search index %s", path);
+      indexClear(index);
+      return -1;
+   }
+
+   pthread_mutex_lock(&cacheMutex);
+   index->loaded = 1;
+   indexCount++;
+   SearchIndex *evicted = evictOldest();
+   pthread_mutex_unlock(&cacheMutex);
+
+   if (evicted != NULL)
+   {
+      indexFree(evicted);
+   }
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int searchInit(const ServerConfig *cfg)
+{
+   if (cfg->searchCacheSize <= 0)
+   {
+      LOG_ERROR("search_cache_size must be positive");
+      return -1;
+   }
+   cacheSize = cfg->searchCacheSize;
+   return 0;
+}
+
+void searchShutdown(void)
+{
+   pthread_mutex_lock(&cacheMutex);
+   while (indexes != NULL)
+   {
+      SearchIndex *next = indexes->next;
+      indexFree(indexes);
+      indexes = next;
+   }
+   indexCount = 0;
+   pthread_mutex_unlock(&cacheMutex);
+}
+
+// nach SEND: Log-Eintrag und, falls geladen, direkt in den Index
+void searchAdd(const char *userDir, int number, const char *sender,
+               const char *subject, const char *body)
+{
+   char path[600];
+   WordList words = {NULL, 0, 0};
+
+   if (addWords(&words, sender, strlen(sender)) == -1 ||
+       addWords(&words, subject, strlen(subject)) == -1 ||
+       addWords(&words, body, strlen(body)) == -1)
+   {
+      LOG_ERROR("Out of memory indexing message %d", number);
+      free(words.words);
+      return;
+   }
+   uniqueWords(&words);
+
+   // "+ n wort wort ...\n"
+   size_t length = 32;
+   for (int i = 0; i < words.count; i++)
+   {
+      length += strlen(words.words[i]) + 1;
+   }
+   char *entry = malloc(length);
+   if (entry == NULL)
+   {
+      free(words.words);
+      return;
+   }
+   size_t used = snprintf(entry, length, "+ %d", number);
+   for (int i = 0; i < words.count; i++)
+   {
+      used += snprintf(entry + used, length - used, " %s", words.words[i]);
+   }
+   entry[used++] = '\n';
+
+   SearchIndex *index = acquireIndex(userDir);
+   if (index == NULL)
+   {
+      free(entry);
+      free(words.words);
+      return;
+   }
+   pthread_mutex_lock(&index->mutex);
+   indexPath(userDir, path, sizeof(path));
+   // ohne .index wird beim ersten SEARCH ohnehin alles indexiert
+   if (index->loaded || access(path, F_OK) == 0)
+   {
+      appendLog(userDir, entry, used);
+   }
+   if (index->loaded)
+   {
+      for (int i = 0; i < words.count; i++)
+      {
+         Term *term = findTerm(index, words.words[i], 1);
+         if (term != NULL)
+         {
+            termAdd(term, number);
+         }
+      }
+      index->logEntries++;
+      maybeCompact(index);
+   }
+   pthread_mutex_unlock(&index->mutex);
+   releaseIndex(index);
+
+   free(entry);
+   free(words.words);
+}
+
+// nach DEL: gelöschte Nummern aus allen Terms entfernen (ein Durchgang)
+void searchRemove(const char *userDir, const int *numbers, int count)
+{
+   char path[600];
+   char line[32];
+
+   if (count == 0)
+   {
+      return;
+   }
+
+   int *sorted = malloc(count * sizeof(int));
+   if (sorted == NULL)
+   {
+      return;
+   }
+   memcpy(sorted, numbers, count * sizeof(int));
+   qsort(sorted, count, sizeof(int), compareNumbers);
+
+   SearchIndex *index = acquireIndex(userDir);
+   if (index == NULL)
+   {
+      free(sorted);
+      return;
+   }
+   pthread_mutex_lock(&index->mutex);
+   indexPath(userDir, path, sizeof(path));
+   if (index->loaded || access(path, F_OK) == 0)
+   {
+      FILE *file = fopen(path, "a");
+      if (file != NULL)
+      {
+         for (int i = 0; i < count; i++)
+         {
+            int length = snprintf(line, sizeof(line), "- %d\n", sorted[i]);
+            fwrite(line, 1, length, file);
+         }
+         fclose(file);
+      }
+   }
+   if (index->loaded)
+   {
+      indexRemove(index, sorted, count);
+      index->logEntries += count;
+      maybeCompact(index);
+   }
+   pthread_mutex_unlock(&index->mutex);
+   releaseIndex(index);
+
+   free(sorted);
+}
+
+// Nachrichten, die alle Wörter der Query enthalten (aufsteigend sortiert,
+// mit free() freigeben), Rückgabe: Anzahl oder -1
+int searchQuery(const char *userDir, const char *query, int **numbers)
+{
+   WordList words = {NULL, 0, 0};
+   int count = 0;
+
+   *numbers = NULL;
+   if (addWords(&words, query, strlen(query)) == -1 || words.count == 0)
+   {
+      free(words.words);
+      return -1;
+   }
+   uniqueWords(&words);
+
+   SearchIndex *index = acquireIndex(userDir);
+   if (index == NULL)
+   {
+      free(words.words);
+      return -1;
+   }
+   pthread_mutex_lock(&index->mutex);
+   if (loadIndex(index) == -1)
+   {
+      pthread_mutex_unlock(&index->mutex);
+      releaseIndex(index);
+      free(words.words);
+      return -1;
+   }
+
+   // mit der kürzesten Liste anfangen, dann schneiden
+   Term *terms[64];
+   int termCount = 0;
+   for (int i = 0; i < words.count && termCount < 64; i++)
+   {
+      Term *term = findTerm(index, words.words[i], 0);
+      if (term == NULL)
+      {
+         termCount = 0; // ein Wort kommt nirgends vor -> kein Treffer
+         break;
+      }
+      terms[termCount++] = term;
+   }
+
+   if (termCount > 0)
+   {
+      int shortest = 0;
+      for (int i = 1; i < termCount; i++)
+      {
+         if (terms[i]->count < terms[shortest]->count)
+         {
+            shortest = i;
+         }
+      }
+
+      *numbers = malloc(terms[shortest]->count * sizeof(int));
+      if (*numbers == NULL)
+      {
+         count = -1;
+      }
+      else
+      {
+         memcpy(*numbers, terms[shortest]->numbers, terms[shortest]->count * sizeof(int));
+         count = terms[shortest]->count;
+         for (int i = 0; i < termCount && count > 0; i++)
+         {
+            int kept = 0;
+            for (int j = 0; j < count; j++)
+            {
+               if (i == shortest ||
+                   bsearch(&(*numbers)[j], terms[i]->numbers, terms[i]->count,
+                           sizeof(int), compareNumbers) != NULL)
+               {
+                  (*numbers)[kept++] = (*numbers)[j];
+               }
+            }
+            count = kept;
+         }
+      }
+   }
+   pthread_mutex_unlock(&index->mutex);
+   releaseIndex(index);
+
+   free(words.words);
+   return count;
+}
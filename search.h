@@ -0,0 +1,26 @@
+#ifndef TWMAILER_SEARCH_H
+#define TWMAILER_SEARCH_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Invertierter Index pro Postfach für SEARCH (Sender, Subject, Body)
+// Wörter: Buchstaben/Ziffern (auch UTF-8), klein geschrieben, min. 2 Zeichen.
+// Im Speicher: Hash-Tabelle Wort -> sortierte Nachrichtennummern, für die
+// zuletzt verwendeten search_cache_size Postfächer.
+// Auf Disk (<spool>/<user>/.index): Snapshot-Zeilen "= wort n1 n2 ..." und
+// danach angehängte Änderungen "+ n wort wort ..." (SEND) bzw. "- n" (DEL).
+// Sind genug Änderungen angehängt, wird ein neuer Snapshot geschrieben.
+// Postfächer ohne .index (ältere Spools) werden beim ersten SEARCH indexiert.
+
+///////////////////////////////////////////////////////////////////////////////
+
+int searchInit(const ServerConfig *cfg);
+void searchShutdown(void);
+void searchAdd(const char *userDir, int number, const char *sender,
+               const char *subject, const char *body);
+void searchRemove(const char *userDir, const int *numbers, int count);
+int searchQuery(const char *userDir, const char *query, int **numbers);
+
+#endif
@@ -0,0 +1,334 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+#include "log.h"
+#include "protocol.h"
+#include "diskpool.h"
+#include "admission.h"
+#include "sched.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct CommandStats
+{
+   unsigned long count;
+   unsigned long errors;
+   unsigned long bytesIn;
+   unsigned long bytesOut;
+   Histogram latency; // in Mikrosekunden
+} CommandStats;
+
+// Index = CommandId aus protocol.h, COMMAND_OTHER sammelt unbekannte Commands
+#define COMMAND_COUNT (COMMAND_OTHER + 1)
+
+__thread unsigned long statsBytesIn = 0;
+__thread unsigned long statsBytesOut = 0;
+
+static CommandStats commandStats[COMMAND_COUNT];
+static Histogram waitStats[STATS_WAIT_COUNT]; // in Mikrosekunden
+static const char *waitNames[STATS_WAIT_COUNT] = {"throttle", "worker"};
+static time_t startTime;
+static char adminList[256];
+static char dumpFile[256];
+static int dumpInterval = 0;
+static int dumpStop = 0;
+static pthread_t dumpThread;
+static int dumpRunning = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dynamischer String für statsFormat()
+typedef struct TextBuffer
+{
+   char *data;
+   size_t length;
+   size_t capacity;
+} TextBuffer;
+
+static void appendf(TextBuffer *text, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void appendf(TextBuffer *text, const char *format, ...)
+{
+   va_list args;
+
+   if (text->data == NULL && text->capacity != 0)
+   {
+      return; // vorheriger realloc ist fehlgeschlagen
+   }
+
+   while (1)
+   {
+      size_t available = text->capacity - text->length;
+      va_start(args, format);
+      int needed = vsnprintf(text->data + text->length, available, format, args);
+      va_end(args);
+
+      if (needed < 0)
+      {
+         return;
+      }
+      if ((size_t)needed < available)
+      {
+         text->length += needed;
+         return;
+      }
+
+      size_t capacity = text->capacity == 0 ? 4096 : text->capacity * 2;
+      while (capacity - text->length <= (size_t)needed)
+      {
+         capacity *= 2;
+      }
+      char *grown = realloc(text->data, capacity);
+      if (grown == NULL)
+      {
+         free(text->data);
+         text->data = NULL;
+         return;
+      }
+      text->data = grown;
+      text->capacity = capacity;
+   }
+}
+
+// schreibt die Stats atomar (tmp-Datei + rename) nach stats_file
+static void dumpStats(void)
+{
+   char tmpPath[sizeof(dumpFile) + 8];
+   size_t length;
+   char *text = statsFormat(&length);
+   if (text == NULL)
+   {
+      return;
+   }
+
+   snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", dumpFile);
+   FILE *file = fopen(tmpPath, "w");
+   if (file == NULL)
+   {
+      LOG_ERRNO("fopen %s failed", tmpPath);
+      free(text);
+      return;
+   }
+
+   if (fwrite(text, 1, length, file) != length)
+   {
+      LOG_ERRNO("write %s failed", tmpPath);
+   }
+   fclose(file);
+   free(text);
+
+   if (rename(tmpPath, dumpFile) == -1)
+   {
+      LOG_ERRNO("rename %s failed", tmpPath);
+   }
+}
+
+static void *statsDumper(void *data)
+{
+   (void)data;
+   const struct timespec second = {1, 0};
+
+   while (!__atomic_load_n(&dumpStop, __ATOMIC_ACQUIRE))
+   {
+      // in 1s Schritten schlafen, damit statsShutdown() nicht lange wartet
+      for (int i = 0; i < dumpInterval && !__atomic_load_n(&dumpStop, __ATOMIC_ACQUIRE); i++)
+      {
+         nanosleep(&second, NULL);
+      }
+      dumpStats();
+   }
+
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int statsInit(const ServerConfig *cfg)
+{
+   memset(commandStats, 0, sizeof(commandStats));
+   memset(waitStats, 0, sizeof(waitStats));
+   startTime = time(NULL);
+   snprintf(adminList, sizeof(adminList), "%s", cfg->statsAdmins);
+   snprintf(dumpFile, sizeof(dumpFile), "%s", cfg->statsFile);
+   dumpInterval = cfg->statsInterval > 0 ? cfg->statsInterval : 10;
+
+   if (dumpFile[0] == '\0')
+   {
+      return 0; // kein periodischer Dump
+   }
+
+   dumpStop = 0;
+   if (pthread_create(&dumpThread, NULL, statsDumper, NULL) != 0)
+   {
+      LOG_ERROR("Could not start stats dump thread");
+      return -1;
+   }
+   dumpRunning = 1;
+   LOG_INFO("Writing stats to %s every %d s", dumpFile, dumpInterval);
+   return 0;
+}
+
+void statsShutdown(void)
+{
+   if (dumpRunning)
+   {
+      __atomic_store_n(&dumpStop, 1, __ATOMIC_RELEASE);
+      pthread_join(dumpThread, NULL);
+      dumpRunning = 0;
+   }
+}
+
+void statsRecord(int command, int failed, unsigned long bytesIn,
+                 unsigned long bytesOut, unsigned long latencyUs)
+{
+   CommandStats *stats = &commandStats[command];
+
+   __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+   if (failed)
+   {
+      __atomic_fetch_add(&stats->errors, 1, __ATOMIC_RELAXED);
+   }
+   __atomic_fetch_add(&stats->bytesIn, bytesIn, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&stats->bytesOut, bytesOut, __ATOMIC_RELAXED);
+   histogramRecord(&stats->latency, latencyUs);
+}
+
+void statsRecordWait(StatsWait reason, unsigned long waitUs)
+{
+   histogramRecord(&waitStats[reason], waitUs);
+}
+
+// alle Stats im Prometheus Text-Format, Ergebnis muss mit free() freigegeben werden
+char *statsFormat(size_t *length)
+{
+   static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+   TextBuffer text = {NULL, 0, 0};
+   AdmissionLoad load;
+   int i;
+
+   appendf(&text, "# HELP twmailer_uptime_seconds Seconds since server start.\n");
+   appendf(&text, "# TYPE twmailer_uptime_seconds gauge\n");
+   appendf(&text, "twmailer_uptime_seconds %ld\n", (long)(time(NULL) - startTime));
+
+   appendf(&text, "# HELP twmailer_disk_queue_length Spool operations waiting for a disk thread.\n");
+   appendf(&text, "# TYPE twmailer_disk_queue_length gauge\n");
+   appendf(&text, "twmailer_disk_queue_length %d\n", diskQueueLength());
+
+   admissionLoad(&load);
+   appendf(&text, "# HELP twmailer_connections Open client connections.\n");
+   appendf(&text, "# TYPE twmailer_connections gauge\n");
+   appendf(&text, "twmailer_connections %d\n", load.connections);
+   appendf(&text, "# HELP twmailer_connections_limit max_connections (0 = no limit).\n");
+   appendf(&text, "# TYPE twmailer_connections_limit gauge\n");
+   appendf(&text, "twmailer_connections_limit %d\n", load.maxConnections);
+   appendf(&text, "# HELP twmailer_commands_in_flight Commands running or waiting for a worker.\n");
+   appendf(&text, "# TYPE twmailer_commands_in_flight gauge\n");
+   appendf(&text, "twmailer_commands_in_flight %d\n", load.inFlight);
+   appendf(&text, "# HELP twmailer_commands_in_flight_limit max_inflight (0 = no limit).\n");
+   appendf(&text, "# TYPE twmailer_commands_in_flight_limit gauge\n");
+   appendf(&text, "twmailer_commands_in_flight_limit %d\n", load.maxInFlight);
+   appendf(&text, "# HELP twmailer_rejected_total Connections and commands answered with BUSY.\n");
+   appendf(&text, "# TYPE twmailer_rejected_total counter\n");
+   appendf(&text, "twmailer_rejected_total{reason=\"connections\"} %lu\n", load.rejectedConnections);
+   appendf(&text, "twmailer_rejected_total{reason=\"commands\"} %lu\n", load.rejectedCommands);
+   appendf(&text, "# HELP twmailer_throttled_total Commands delayed by user_rate_limit.\n");
+   appendf(&text, "# TYPE twmailer_throttled_total counter\n");
+   appendf(&text, "twmailer_throttled_total %lu\n", schedThrottledCount());
+
+   appendf(&text, "# HELP twmailer_commands_total Processed commands.\n");
+   appendf(&text, "# TYPE twmailer_commands_total counter\n");
+   for (i = 0; i < COMMAND_COUNT; i++)
+   {
+      appendf(&text, "twmailer_commands_total{command=\"%s\"} %lu\n", protocolCommandName(i),
+              __atomic_load_n(&commandStats[i].count, __ATOMIC_RELAXED));
+   }
+
+   appendf(&text, "# HELP twmailer_command_errors_total Commands answered with ERR.\n");
+   appendf(&text, "# TYPE twmailer_command_errors_total counter\n");
+   for (i = 0; i < COMMAND_COUNT; i++)
+   {
+      appendf(&text, "twmailer_command_errors_total{command=\"%s\"} %lu\n", protocolCommandName(i),
+              __atomic_load_n(&commandStats[i].errors, __ATOMIC_RELAXED));
+   }
+
+   appendf(&text, "# HELP twmailer_command_received_bytes_total Bytes received per command.\n");
+   appendf(&text, "# TYPE twmailer_command_received_bytes_total counter\n");
+   for (i = 0; i < COMMAND_COUNT; i++)
+   {
+      appendf(&text, "twmailer_command_received_bytes_total{command=\"%s\"} %lu\n", protocolCommandName(i),
+              __atomic_load_n(&commandStats[i].bytesIn, __ATOMIC_RELAXED));
+   }
+
+   appendf(&text, "# HELP twmailer_command_sent_bytes_total Bytes sent per command.\n");
+   appendf(&text, "# TYPE twmailer_command_sent_bytes_total counter\n");
+   for (i = 0; i < COMMAND_COUNT; i++)
+   {
+      appendf(&text, "twmailer_command_sent_bytes_total{command=\"%s\"} %lu\n", protocolCommandName(i),
+              __atomic_load_n(&commandStats[i].bytesOut, __ATOMIC_RELAXED));
+   }
+
+   appendf(&text, "# HELP twmailer_command_latency_seconds Command processing time.\n");
+   appendf(&text, "# TYPE twmailer_command_latency_seconds summary\n");
+   for (i = 0; i < COMMAND_COUNT; i++)
+   {
+      const Histogram *latency = &commandStats[i].latency;
+      for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+      {
+         appendf(&text, "twmailer_command_latency_seconds{command=\"%s\",quantile=\"%g\"} %.6f\n",
+                 protocolCommandName(i), quantiles[q],
+                 histogramPercentile(latency, quantiles[q]) / 1e6);
+      }
+      appendf(&text, "twmailer_command_latency_seconds_sum{command=\"%s\"} %.6f\n", protocolCommandName(i),
+              __atomic_load_n(&latency->sum, __ATOMIC_RELAXED) / 1e6);
+      appendf(&text, "twmailer_command_latency_seconds_count{command=\"%s\"} %lu\n", protocolCommandName(i),
+              __atomic_load_n(&latency->total, __ATOMIC_RELAXED));
+   }
+
+   appendf(&text, "# HELP twmailer_queue_wait_seconds Time a command waited before processing.\n");
+   appendf(&text, "# TYPE twmailer_queue_wait_seconds summary\n");
+   for (i = 0; i < STATS_WAIT_COUNT; i++)
+   {
+      const Histogram *wait = &waitStats[i];
+      for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+      {
+         appendf(&text, "twmailer_queue_wait_seconds{reason=\"%s\",quantile=\"%g\"} %.6f\n",
+                 waitNames[i], quantiles[q], histogramPercentile(wait, quantiles[q]) / 1e6);
+      }
+      appendf(&text, "twmailer_queue_wait_seconds_sum{reason=\"%s\"} %.6f\n", waitNames[i],
+              __atomic_load_n(&wait->sum, __ATOMIC_RELAXED) / 1e6);
+      appendf(&text, "twmailer_queue_wait_seconds_count{reason=\"%s\"} %lu\n", waitNames[i],
+              __atomic_load_n(&wait->total, __ATOMIC_RELAXED));
+   }
+
+   if (text.data != NULL)
+   {
+      *length = text.length;
+   }
+   return text.data;
+}
+
+// stats_admins: durch Beistriche getrennte Liste von Usernamen
+int statsIsAdmin(const char *username)
+{
+   size_t usernameLen = strlen(username);
+   const char *entry = adminList;
+
+   while (*entry != '\0')
+   {
+      size_t entryLen = strcspn(entry, ", ");
+      if (entryLen == usernameLen && entryLen > 0 && strncmp(entry, username, entryLen) == 0)
+      {
+         return 1;
+      }
+      entry += entryLen;
+      entry += strspn(entry, ", ");
+   }
+
+   return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef TWMAILER_STATS_H
+#define TWMAILER_STATS_H
+
+#include <stddef.h>
+#include "config.h"
+#include "histogram.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Statistiken pro Command: Anzahl, Fehler, Bytes und Latenz-Histogramm
+// abrufbar über STATS (nur Admins) bzw. periodisch als Datei (stats_file),
+// beides im Prometheus Text-Format
+
+// Byte-Zähler des aktuellen Threads, werden von readline()/writen() erhöht
+extern __thread unsigned long statsBytesIn;
+extern __thread unsigned long statsBytesOut;
+
+// Wartezeit vor einem Command, getrennt von der Latenz erfasst
+typedef enum StatsWait
+{
+   STATS_WAIT_THROTTLE, // user_rate_limit
+   STATS_WAIT_WORKER,   // getaggte Commands in der Queue
+   STATS_WAIT_COUNT
+} StatsWait;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int statsInit(const ServerConfig *cfg);
+void statsShutdown(void);
+void statsRecord(int command, int failed, unsigned long bytesIn,
+                 unsigned long bytesOut, unsigned long latencyUs);
+void statsRecordWait(StatsWait reason, unsigned long waitUs);
+char *statsFormat(size_t *length);
+int statsIsAdmin(const char *username);
+
+#endif
@@ -0,0 +1,475 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "tagged.h"
+#include "commands.h"
+#include "stats.h"
+#include "trace.h"
+#include "log.h"
+#include "admission.h"
+#include "sched.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define MAX_COMMAND_THREADS 256
+
+// Kopie eines getaggten Requests (die Session liest gleich den nächsten
+// Command in ihre commandArena)
+typedef struct TaggedCommand
+{
+   FairItem item; // muss vorne stehen (Cast von fairPop())
+   TaggedSession *session;
+   char tag[PROTOCOL_TAG_MAX + 1];
+   char username[256];
+   ProtocolRequest request; // zeigt in data
+   unsigned long bytesIn;
+   struct timespec queued; // Übergabe an die Queue
+   char data[]; // Argumente und Body
+} TaggedCommand;
+
+// ein Frame (Header + Daten) in der Ausgabe-Queue einer Session
+struct TaggedFrame
+{
+   TaggedFrame *next;
+   size_t length;
+   char data[];
+};
+
+// eine Queue pro User, reihum bedient (siehe sched.h)
+static FairQueue queue;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workers[MAX_COMMAND_THREADS];
+static int workerCount = 0;
+static int workerStop = 0;
+static int maxInFlight = 16;
+static size_t outputLimit = 16 * 1024 * 1024;
+
+// Antwort des aktuellen Threads geht als Frames an diese Session
+static __thread TaggedSession *replySession = NULL;
+static __thread const char *replyTag = NULL;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// schickt alle length Bytes, ohne SIGPIPE
+static int sendAll(int socket, const char *data, size_t length)
+{
+   while (length > 0)
+   {
+      ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+      if (sent == -1 && errno == EINTR)
+      {
+         continue;
+      }
+      if (sent <= 0)
+      {
+         return -1;
+      }
+      data += sent;
+      length -= sent;
+   }
+   return 0;
+}
+
+// Verbindung aufgeben: Queue verwerfen, shutdown() weckt Writer und
+// Session-Thread (session->mutex muss gehalten werden)
+static void markBroken(TaggedSession *session)
+{
+   session->broken = 1;
+   while (session->frames != NULL)
+   {
+      TaggedFrame *next = session->frames->next;
+      session->queued -= session->frames->length;
+      free(session->frames);
+      session->frames = next;
+   }
+   session->lastFrame = NULL;
+   shutdown(session->socket, SHUT_RDWR);
+   pthread_cond_broadcast(&session->changed);
+}
+
+// schickt die Frames einer Session der Reihe nach, nur dieser Thread wartet
+// auf den Client
+static void *sessionWriter(void *data)
+{
+   TaggedSession *session = data;
+
+   pthread_mutex_lock(&session->mutex);
+   while (1)
+   {
+      TaggedFrame *frame = session->frames;
+      if (frame == NULL)
+      {
+         if (session->writerStop)
+         {
+            break;
+         }
+         pthread_cond_wait(&session->changed, &session->mutex);
+         continue;
+      }
+      session->frames = frame->next;
+      if (session->frames == NULL)
+      {
+         session->lastFrame = NULL;
+      }
+      pthread_mutex_unlock(&session->mutex);
+
+      int result = sendAll(session->socket, frame->data, frame->length);
+
+      pthread_mutex_lock(&session->mutex);
+      session->queued -= frame->length;
+      if (result == -1 && !session->broken)
+      {
+         LOG_ERRNO("send tagged reply failed");
+         markBroken(session);
+      }
+      pthread_cond_broadcast(&session->changed);
+      free(frame);
+   }
+   pthread_mutex_unlock(&session->mutex);
+   return NULL;
+}
+
+// hängt header + data als einen Frame an die Queue der Session, wartet nie
+// auf den Client
+static int queueFrame(TaggedSession *session, const char *header, size_t headerLength,
+                      const void *data, size_t dataLength)
+{
+   TaggedFrame *frame = malloc(sizeof(TaggedFrame) + headerLength + dataLength);
+   if (frame == NULL)
+   {
+      LOG_ERROR("Out of memory for tagged reply");
+      return -1;
+   }
+   frame->next = NULL;
+   frame->length = headerLength + dataLength;
+   memcpy(frame->data, header, headerLength);
+   if (dataLength > 0)
+   {
+      memcpy(frame->data + headerLength, data, dataLength);
+   }
+
+   pthread_mutex_lock(&session->mutex);
+   if (!session->broken && session->queued + frame->length > outputLimit)
+   {
+      LOG_WARN("Client does not read its tagged replies (%zu bytes queued), closing connection",
+               session->queued);
+      markBroken(session);
+   }
+   if (!session->broken && !session->writerRunning)
+   {
+      if (pthread_create(&session->writer, NULL, sessionWriter, session) != 0)
+      {
+         LOG_ERROR("Could not start writer thread");
+         markBroken(session);
+      }
+      else
+      {
+         session->writerRunning = 1;
+      }
+   }
+   if (session->broken)
+   {
+      pthread_mutex_unlock(&session->mutex);
+      free(frame);
+      errno = EPIPE;
+      return -1;
+   }
+
+   if (session->lastFrame != NULL)
+   {
+      session->lastFrame->next = frame;
+   }
+   else
+   {
+      session->frames = frame;
+   }
+   session->lastFrame = frame;
+   session->queued += frame->length;
+   pthread_cond_broadcast(&session->changed);
+   pthread_mutex_unlock(&session->mutex);
+   return 0;
+}
+
+static void runCommand(TaggedCommand *command)
+{
+   const ProtocolCommand *info = command->request.command;
+   TaggedSession *session = command->session;
+   struct timespec start, end;
+
+   // Wartezeit auf einen Worker getrennt, nicht in der Latenz
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   statsRecordWait(STATS_WAIT_WORKER, (start.tv_sec - command->queued.tv_sec) * 1000000UL +
+                                          (start.tv_nsec - command->queued.tv_nsec) / 1000);
+
+   // Session-Daten der Verbindung übernehmen (thread-lokal)
+   isAuthenticated = 1;
+   snprintf(sessionUsername, sizeof(sessionUsername), "%s", command->username);
+   statsBytesIn = command->bytesIn;
+   statsBytesOut = 0;
+
+   traceCommandBegin(info->name);
+   taggedBegin(session, command->tag);
+   int failed = commandHandlers[info->id](session->socket, &command->request) == -1;
+   if (failed && writen(session->socket, "ERR\n", 4) == -1)
+   {
+      LOG_ERRNO("send error response failed");
+   }
+   taggedEnd();
+   traceCommandEnd(sessionUsername, failed);
+
+   // Latenz ab der Übernahme durch den Worker
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   statsRecord(info->id, failed, statsBytesIn, statsBytesOut,
+               (end.tv_sec - start.tv_sec) * 1000000UL + (end.tv_nsec - start.tv_nsec) / 1000);
+   arenaReset(&commandArena);
+   admissionEnd();
+
+   pthread_mutex_lock(&session->mutex);
+   session->inFlight--;
+   pthread_cond_broadcast(&session->changed);
+   pthread_mutex_unlock(&session->mutex);
+   free(command);
+}
+
+static void *commandWorker(void *data)
+{
+   (void)data;
+
+   pthread_mutex_lock(&queueMutex);
+   while (1)
+   {
+      TaggedCommand *command = (TaggedCommand *)fairPop(&queue);
+      if (command == NULL)
+      {
+         if (workerStop)
+         {
+            break;
+         }
+         pthread_cond_wait(&queueCond, &queueMutex);
+         continue;
+      }
+      pthread_mutex_unlock(&queueMutex);
+
+      runCommand(command);
+
+      pthread_mutex_lock(&queueMutex);
+   }
+   pthread_mutex_unlock(&queueMutex);
+
+   arenaRelease(&commandArena);
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int taggedInit(const ServerConfig *cfg)
+{
+   int threads = cfg->commandThreads > 0 ? cfg->commandThreads : 1;
+
+   if (threads > MAX_COMMAND_THREADS)
+   {
+      LOG_WARN("command_threads limited to %d", MAX_COMMAND_THREADS);
+      threads = MAX_COMMAND_THREADS;
+   }
+   maxInFlight = cfg->taggedMaxInFlight > 0 ? cfg->taggedMaxInFlight : 16;
+   outputLimit = (cfg->taggedOutputKbytes > 0 ? cfg->taggedOutputKbytes : 16 * 1024) * (size_t)1024;
+   fairInit(&queue);
+   workerStop = 0;
+
+   for (workerCount = 0; workerCount < threads; workerCount++)
+   {
+      if (pthread_create(&workers[workerCount], NULL, commandWorker, NULL) != 0)
+      {
+         LOG_ERROR("Could not start command thread");
+         taggedShutdown();
+         return -1;
+      }
+   }
+   return 0;
+}
+
+// noch wartende Commands werden vorher ausgeführt
+void taggedShutdown(void)
+{
+   pthread_mutex_lock(&queueMutex);
+   workerStop = 1;
+   pthread_cond_broadcast(&queueCond);
+   pthread_mutex_unlock(&queueMutex);
+
+   for (int i = 0; i < workerCount; i++)
+   {
+      pthread_join(workers[i], NULL);
+   }
+   workerCount = 0;
+   fairDestroy(&queue);
+}
+
+void taggedSessionInit(TaggedSession *session, int socket)
+{
+   session->socket = socket;
+   session->inFlight = 0;
+   session->frames = NULL;
+   session->lastFrame = NULL;
+   session->queued = 0;
+   session->broken = 0;
+   session->writerRunning = 0;
+   session->writerStop = 0;
+   pthread_mutex_init(&session->mutex, NULL);
+   pthread_cond_init(&session->changed, NULL);
+}
+
+// wartet, bis alle getaggten Commands der Verbindung fertig und ihre Frames
+// geschickt sind (danach darf der Session-Thread wieder direkt schicken)
+void taggedSessionWait(TaggedSession *session)
+{
+   pthread_mutex_lock(&session->mutex);
+   while (session->inFlight > 0 || (session->queued > 0 && !session->broken))
+   {
+      pthread_cond_wait(&session->changed, &session->mutex);
+   }
+   pthread_mutex_unlock(&session->mutex);
+}
+
+void taggedSessionDestroy(TaggedSession *session)
+{
+   taggedSessionWait(session);
+
+   pthread_mutex_lock(&session->mutex);
+   session->writerStop = 1;
+   pthread_cond_broadcast(&session->changed);
+   pthread_mutex_unlock(&session->mutex);
+   if (session->writerRunning)
+   {
+      pthread_join(session->writer, NULL);
+   }
+
+   pthread_mutex_destroy(&session->mutex);
+   pthread_cond_destroy(&session->changed);
+}
+
+// kopiert den Request (aus commandArena der Session) und gibt ihn an einen
+// Worker, wartet vorher falls schon tagged_max_inflight Commands laufen
+int taggedSubmit(TaggedSession *session, const char *tag, const ProtocolRequest *request,
+                 unsigned long bytesIn)
+{
+   const ProtocolCommand *info = request->command;
+   size_t size = request->bodyLength + 1;
+
+   for (int i = 0; i < info->argCount; i++)
+   {
+      size += request->argLengths[i] + 1;
+   }
+
+   TaggedCommand *command = malloc(sizeof(TaggedCommand) + size);
+   if (command == NULL)
+   {
+      LOG_ERROR("Out of memory for tagged command");
+      return -1;
+   }
+   command->session = session;
+   snprintf(command->tag, sizeof(command->tag), "%s", tag);
+   snprintf(command->username, sizeof(command->username), "%s", sessionUsername);
+   command->request = *request;
+   command->bytesIn = bytesIn;
+   clock_gettime(CLOCK_MONOTONIC, &command->queued);
+
+   char *position = command->data;
+   for (int i = 0; i < info->argCount; i++)
+   {
+      memcpy(position, request->args[i], request->argLengths[i] + 1);
+      command->request.args[i] = position;
+      position += request->argLengths[i] + 1;
+   }
+   if (request->body != NULL)
+   {
+      memcpy(position, request->body, request->bodyLength + 1);
+      command->request.body = position;
+   }
+
+   pthread_mutex_lock(&session->mutex);
+   while (session->inFlight >= maxInFlight)
+   {
+      pthread_cond_wait(&session->changed, &session->mutex);
+   }
+   session->inFlight++;
+   pthread_mutex_unlock(&session->mutex);
+
+   // große Requests (SEND) kosten mehr Guthaben
+   pthread_mutex_lock(&queueMutex);
+   int result = fairPush(&queue, command->username, &command->item, 1 + bytesIn / 65536);
+   if (result == 0)
+   {
+      pthread_cond_signal(&queueCond);
+   }
+   pthread_mutex_unlock(&queueMutex);
+
+   if (result == -1)
+   {
+      LOG_ERROR("Out of memory for tagged command");
+      pthread_mutex_lock(&session->mutex);
+      session->inFlight--;
+      pthread_cond_broadcast(&session->changed);
+      pthread_mutex_unlock(&session->mutex);
+      free(command);
+      return -1;
+   }
+   return 0;
+}
+
+// ab jetzt schickt writen() in diesem Thread Frames mit tag
+void taggedBegin(TaggedSession *session, const char *tag)
+{
+   replySession = session;
+   replyTag = tag;
+}
+
+// "<tag> .", danach wieder normale Antworten
+void taggedEnd(void)
+{
+   char header[PROTOCOL_TAG_MAX + 8];
+   TaggedSession *session = replySession;
+
+   replySession = NULL;
+   if (session == NULL)
+   {
+      return;
+   }
+
+   int length = snprintf(header, sizeof(header), "%s .\n", replyTag);
+   if (queueFrame(session, header, length, NULL, 0) == -1)
+   {
+      LOG_DEBUG("end of tagged reply %s dropped", replyTag);
+   }
+}
+
+int taggedReplying(void)
+{
+   return replySession != NULL;
+}
+
+// ein Frame "<tag> <n>\n" + buffer, für writen(), nur in die Queue
+ssize_t taggedWrite(const void *buffer, size_t n)
+{
+   char header[PROTOCOL_TAG_MAX + 32];
+
+   if (n == 0)
+   {
+      return 0; // Länge 0 hätte keine Bedeutung, "." beendet die Antwort
+   }
+
+   int length = snprintf(header, sizeof(header), "%s %zu\n", replyTag, n);
+   if (queueFrame(replySession, header, length, buffer, n) == -1)
+   {
+      return -1;
+   }
+   statsBytesOut += n;
+   return n;
+}
@@ -0,0 +1,68 @@
+#ifndef TWMAILER_TAGGED_H
+#define TWMAILER_TAGGED_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "config.h"
+#include "protocol.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Getaggte Commands (optional, pro Command)
+// Command-Zeile "<tag> <COMMAND>" statt "<COMMAND>", Argumente wie sonst.
+// Die Antwort kommt in Frames, die Daten sind genau die normale Antwort:
+//
+//    <tag> <length>\n<length Bytes>
+//    ...
+//    <tag> .\n                       (Antwort vollständig)
+//
+// Getaggte Commands laufen in command_threads Workern, mehrere Commands einer
+// Verbindung also gleichzeitig und in beliebiger Reihenfolge fertig. Frames
+// verschiedener Tags können sich abwechseln, die Frames eines Tags kommen in
+// Reihenfolge. Die Worker bedienen die User reihum (sched.h), nicht in
+// Reihenfolge der Commands. Pro Verbindung laufen höchstens
+// tagged_max_inflight Commands, danach liest die Session erst weiter, wenn
+// einer fertig ist.
+// Die Worker schicken nicht selbst: Frames kommen in eine Queue pro
+// Verbindung, die ein Writer-Thread der Verbindung abarbeitet (erst beim
+// ersten getaggten Command gestartet). Ein Client, der nicht liest, blockiert
+// so keinen Worker. Über tagged_output_kbytes in der Queue wird die
+// Verbindung geschlossen.
+// Commands ohne Tag warten, bis alle getaggten Commands der Verbindung fertig
+// und ihre Antworten geschickt sind (wie bisher). LOGIN, RESUME und QUIT mit
+// Tag ändern die Session und laufen daher ebenso erst danach im
+// Session-Thread. IDLE geht nur ohne Tag.
+
+typedef struct TaggedFrame TaggedFrame;
+
+// pro Verbindung
+typedef struct TaggedSession
+{
+   int socket;
+   pthread_mutex_t mutex;
+   pthread_cond_t changed;
+   int inFlight;
+   TaggedFrame *frames; // noch zu schicken, vorne das älteste
+   TaggedFrame *lastFrame;
+   size_t queued;       // Bytes in frames (inkl. dem gerade geschickten)
+   int broken;          // Senden fehlgeschlagen bzw. Limit überschritten
+   int writerRunning;
+   int writerStop;
+   pthread_t writer;
+} TaggedSession;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int taggedInit(const ServerConfig *cfg);
+void taggedShutdown(void);
+void taggedSessionInit(TaggedSession *session, int socket);
+void taggedSessionWait(TaggedSession *session);
+void taggedSessionDestroy(TaggedSession *session);
+int taggedSubmit(TaggedSession *session, const char *tag, const ProtocolRequest *request,
+                 unsigned long bytesIn);
+void taggedBegin(TaggedSession *session, const char *tag);
+void taggedEnd(void);
+int taggedReplying(void);
+ssize_t taggedWrite(const void *buffer, size_t n);
+
+#endif
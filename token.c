@@ -0,0 +1,189 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include "token.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define SECRET_MAX 64
+#define SECRET_MIN 16
+
+static unsigned char tokenSecret[SECRET_MAX];
+static size_t tokenSecretLen = 0;
+static int tokenTtl = 0;
+static int tokenMaxAge = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Secret aus session_secret_file laden, sonst zufällig erzeugen
+// (zufälliges Secret -> Tokens sind nach einem Neustart ungültig)
+int tokenInit(const ServerConfig *cfg)
+{
+   tokenTtl = cfg->sessionTokenTtl;
+   tokenMaxAge = cfg->sessionMaxAge;
+   if (tokenTtl <= 0)
+   {
+      LOG_INFO("Session tokens disabled");
+      return 0;
+   }
+
+   if (cfg->sessionSecretFile[0] != '\0')
+   {
+      FILE *file = fopen(cfg->sessionSecretFile, "rb");
+      if (file == NULL)
+      {
+         LOG_ERRNO("fopen session_secret_file failed");
+         return -1;
+      }
+      tokenSecretLen = fread(tokenSecret, 1, sizeof(tokenSecret), file);
+      fclose(file);
+
+      if (tokenSecretLen < SECRET_MIN)
+      {
+         LOG_ERROR("session_secret_file must contain at least %d bytes", SECRET_MIN);
+         return -1;
+      }
+   }
+   else
+   {
+      if (RAND_bytes(tokenSecret, sizeof(tokenSecret)) != 1)
+      {
+         LOG_ERROR("RAND_bytes failed");
+         return -1;
+      }
+      tokenSecretLen = sizeof(tokenSecret);
+   }
+
+   return 0;
+}
+
+// HMAC-SHA256 über "username:issued:expiry" als hex string
+static void tokenSign(const char *payload, char *hex)
+{
+   unsigned char mac[EVP_MAX_MD_SIZE];
+   unsigned int macLen = 0;
+
+   HMAC(EVP_sha256(), tokenSecret, (int)tokenSecretLen,
+        (const unsigned char *)payload, strlen(payload), mac, &macLen);
+
+   for (unsigned int i = 0; i < macLen; i++)
+   {
+      sprintf(hex + i * 2, "%02x", mac[i]);
+   }
+   hex[macLen * 2] = '\0';
+}
+
+// neues Token für username ausstellen, issued = Zeit des LOGIN (aus dem
+// alten Token bei RESUME), -1 wenn Tokens deaktiviert sind oder die Session
+// session_max_age erreicht hat
+int tokenIssue(const char *username, time_t issued, char *token, size_t tokenLen)
+{
+   char payload[TOKEN_MAX];
+   char hex[EVP_MAX_MD_SIZE * 2 + 1];
+   time_t now = time(NULL);
+   time_t expiry = now + tokenTtl;
+
+   if (tokenTtl <= 0 || strpbrk(username, ": \r\n") != NULL)
+   {
+      return -1;
+   }
+
+   // Ablauf nie über das maximale Alter der Session hinaus
+   if (tokenMaxAge > 0)
+   {
+      if (issued + tokenMaxAge <= now)
+      {
+         return -1;
+      }
+      if (expiry > issued + tokenMaxAge)
+      {
+         expiry = issued + tokenMaxAge;
+      }
+   }
+
+   int len = snprintf(payload, sizeof(payload), "%s:%ld:%ld", username, (long)issued, (long)expiry);
+   if (len < 0 || len >= (int)sizeof(payload))
+   {
+      return -1;
+   }
+
+   tokenSign(payload, hex);
+   len = snprintf(token, tokenLen, "%s:%s", payload, hex);
+   if (len < 0 || len >= (int)tokenLen)
+   {
+      return -1;
+   }
+   return 0;
+}
+
+// prüft Signatur, Ablaufzeit und maximales Alter, bei Erfolg stehen
+// Username und Login-Zeit in username bzw. issued
+int tokenVerify(const char *token, char *username, size_t usernameLen, time_t *issued)
+{
+   char payload[TOKEN_MAX];
+   char expected[EVP_MAX_MD_SIZE * 2 + 1];
+
+   if (tokenTtl <= 0 || strlen(token) >= sizeof(payload))
+   {
+      return -1;
+   }
+
+   // letzter ':' trennt payload und Signatur
+   const char *signature = strrchr(token, ':');
+   if (signature == NULL)
+   {
+      return -1;
+   }
+   memcpy(payload, token, signature - token);
+   payload[signature - token] = '\0';
+   signature++;
+
+   tokenSign(payload, expected);
+   if (strlen(signature) != strlen(expected) ||
+       CRYPTO_memcmp(signature, expected, strlen(expected)) != 0)
+   {
+      LOG_WARN("Invalid token signature");
+      return -1;
+   }
+
+   char *expiry = strrchr(payload, ':');
+   if (expiry == NULL || expiry == payload)
+   {
+      return -1;
+   }
+   *expiry++ = '\0';
+
+   char *issuedText = strrchr(payload, ':');
+   if (issuedText == NULL || issuedText == payload)
+   {
+      return -1;
+   }
+   *issuedText++ = '\0';
+
+   time_t now = time(NULL);
+   if (atol(expiry) < (long)now)
+   {
+      LOG_WARN("Token expired for user: %s", payload);
+      return -1;
+   }
+   if (tokenMaxAge > 0 && atol(issuedText) + tokenMaxAge <= (long)now)
+   {
+      LOG_WARN("Session too old for user: %s", payload);
+      return -1;
+   }
+
+   if (strlen(payload) >= usernameLen)
+   {
+      return -1;
+   }
+   strcpy(username, payload);
+   *issued = (time_t)atol(issuedText);
+   return 0;
+}
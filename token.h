@@ -0,0 +1,20 @@
+#ifndef TWMAILER_TOKEN_H
+#define TWMAILER_TOKEN_H
+
+#include <stddef.h>
+#include <time.h>
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Session-Resumption Tokens
+// Format: <username>:<login-zeit>:<ablaufzeit>:<hmac-sha256 hex>
+// mit RESUME kann eine Session ohne erneuten Login wiederhergestellt werden,
+// das neue Token behält die Login-Zeit (höchstens session_max_age gültig)
+#define TOKEN_MAX 256
+
+int tokenInit(const ServerConfig *cfg);
+int tokenIssue(const char *username, time_t issued, char *token, size_t tokenLen);
+int tokenVerify(const char *token, char *username, size_t usernameLen, time_t *issued);
+
+#endif
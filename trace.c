@@ -0,0 +1,197 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define TRACE_MAX_EVENTS 128
+
+typedef struct TraceEvent
+{
+   const char *name;
+   unsigned long start; // Mikrosekunden seit traceInit()
+   unsigned long end;
+} TraceEvent;
+
+static FILE *traceFile = NULL;
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static int sampleRate = 0;
+static struct timespec traceStart;
+static int nextThreadId = 1;
+
+// Zustand des Commands der gerade in diesem Thread läuft
+static __thread int sampled = 0;
+static __thread unsigned int randomState = 0;
+static __thread int threadId = 0;
+static __thread char commandName[16];
+static __thread unsigned long commandStart;
+static __thread TraceEvent events[TRACE_MAX_EVENTS];
+static __thread int eventCount;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static unsigned long traceNow(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - traceStart.tv_sec) * 1000000UL +
+          (now.tv_nsec - traceStart.tv_nsec) / 1000;
+}
+
+// xorshift32, reicht für die Sampling-Entscheidung
+static unsigned int nextRandom(void)
+{
+   if (randomState == 0)
+   {
+      randomState = (unsigned int)(traceNow() ^ (unsigned long)&randomState) | 1;
+   }
+   randomState ^= randomState << 13;
+   randomState ^= randomState >> 17;
+   randomState ^= randomState << 5;
+   return randomState;
+}
+
+// String als JSON-String ausgeben (ohne Anführungszeichen)
+static void writeJsonString(const char *text)
+{
+   for (; *text != '\0'; text++)
+   {
+      unsigned char c = (unsigned char)*text;
+      if (c == '"' || c == '\\')
+      {
+         fputc('\\', traceFile);
+         fputc(c, traceFile);
+      }
+      else if (c < 0x20)
+      {
+         fprintf(traceFile, "\\u%04x", c);
+      }
+      else
+      {
+         fputc(c, traceFile);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int traceInit(const ServerConfig *cfg)
+{
+   clock_gettime(CLOCK_MONOTONIC, &traceStart);
+
+   if (cfg->traceFile[0] == '\0' || cfg->traceSampleRate <= 0)
+   {
+      return 0; // Tracing deaktiviert
+   }
+
+   traceFile = fopen(cfg->traceFile, "w");
+   if (traceFile == NULL)
+   {
+      LOG_ERRNO("fopen trace_file failed");
+      return -1;
+   }
+
+   // JSON Array Format, das schließende ']' ist laut Spezifikation optional
+   fputs("[\n", traceFile);
+   sampleRate = cfg->traceSampleRate;
+   LOG_INFO("Tracing 1 of %d commands to %s", sampleRate, cfg->traceFile);
+   return 0;
+}
+
+void traceShutdown(void)
+{
+   pthread_mutex_lock(&traceMutex);
+   if (traceFile != NULL)
+   {
+      fclose(traceFile);
+      traceFile = NULL;
+      sampleRate = 0;
+   }
+   pthread_mutex_unlock(&traceMutex);
+}
+
+// entscheidet ob der Command aufgezeichnet wird
+void traceCommandBegin(const char *command)
+{
+   sampled = sampleRate > 0 && nextRandom() % sampleRate == 0;
+   if (!sampled)
+   {
+      return;
+   }
+
+   if (threadId == 0)
+   {
+      threadId = __atomic_fetch_add(&nextThreadId, 1, __ATOMIC_RELAXED);
+   }
+   snprintf(commandName, sizeof(commandName), "%s", command);
+   eventCount = 0;
+   commandStart = traceNow();
+}
+
+// schreibt den Command und alle Spans in das Trace-File
+void traceCommandEnd(const char *username, int failed)
+{
+   if (!sampled)
+   {
+      return;
+   }
+   sampled = 0;
+
+   unsigned long commandEnd = traceNow();
+
+   pthread_mutex_lock(&traceMutex);
+   if (traceFile != NULL)
+   {
+      fputs("{\"name\":\"", traceFile);
+      writeJsonString(commandName);
+      fprintf(traceFile, "\",\"cat\":\"command\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,"
+                         "\"pid\":1,\"tid\":%d,\"args\":{\"user\":\"",
+              commandStart, commandEnd - commandStart, threadId);
+      writeJsonString(username);
+      fprintf(traceFile, "\",\"failed\":%d}},\n", failed);
+
+      for (int i = 0; i < eventCount; i++)
+      {
+         fprintf(traceFile, "{\"name\":\"%s\",\"cat\":\"", events[i].name);
+         writeJsonString(commandName);
+         fprintf(traceFile, "\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":%d},\n",
+                 events[i].start, events[i].end - events[i].start, threadId);
+      }
+      fflush(traceFile);
+   }
+   pthread_mutex_unlock(&traceMutex);
+}
+
+TraceSpan traceBegin(const char *name)
+{
+   TraceSpan span = {NULL, 0};
+
+   if (sampled)
+   {
+      span.name = name;
+      span.start = traceNow();
+   }
+   return span;
+}
+
+void traceEnd(TraceSpan *span)
+{
+   if (span->name == NULL)
+   {
+      return;
+   }
+
+   if (sampled && eventCount < TRACE_MAX_EVENTS)
+   {
+      events[eventCount].name = span->name;
+      events[eventCount].start = span->start;
+      events[eventCount].end = traceNow();
+      eventCount++;
+   }
+   span->name = NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef TWMAILER_TRACE_H
+#define TWMAILER_TRACE_H
+
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Tracing von einzelnen Phasen eines Commands (Netzwerk, Disk, Auth)
+// Jeder n-te Command (trace_sample_rate, zufällig) wird aufgezeichnet und
+// im Chrome Trace Format (chrome://tracing, Perfetto) nach trace_file
+// geschrieben. Nicht gesampelte Commands kosten nur einen Vergleich.
+//
+//    TraceSpan span = traceBegin("disk.write");
+//    ...
+//    traceEnd(&span);
+
+typedef struct TraceSpan
+{
+   const char *name; // NULL -> Command wird nicht gesampelt
+   unsigned long start;
+} TraceSpan;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int traceInit(const ServerConfig *cfg);
+void traceShutdown(void);
+void traceCommandBegin(const char *command);
+void traceCommandEnd(const char *username, int failed);
+TraceSpan traceBegin(const char *name);
+void traceEnd(TraceSpan *span);
+
+#endif
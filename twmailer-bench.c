@@ -0,0 +1,695 @@
+#define _DEFAULT_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "histogram.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Lastgenerator für den twmailer-server
+// Öffnet N Verbindungen (ein Thread pro Verbindung), jede meldet sich als
+// eigener User an und schickt zufällig gewählte Commands laut Mix.
+// Ohne -r läuft jede Verbindung closed-loop (nächster Command sobald die
+// Antwort da ist), mit -r wird eine fixe Gesamtrate angepeilt. Die Latenz
+// wird dann ab dem geplanten Startzeitpunkt gemessen, damit ein langsamer
+// Server die Perzentile nicht schönt (coordinated omission).
+
+#define BUF 1024
+#define READ_BUFFER 16384
+
+enum
+{
+   CMD_LOGIN,
+   CMD_SEND,
+   CMD_LIST,
+   CMD_READ,
+   CMD_DEL,
+   CMD_COUNT
+};
+
+static const char *commandNames[CMD_COUNT] = {"LOGIN", "SEND", "LIST", "READ", "DEL"};
+
+typedef struct Connection
+{
+   int index;
+   int socket;
+   char username[16]; // max. 8 Zeichen, siehe main()
+   unsigned int seed;
+   int messages; // höchste Nachrichtennummer im eigenen Postfach (geschätzt)
+
+   char readBuffer[READ_BUFFER];
+   size_t readStart;
+   size_t readEnd;
+
+   unsigned long count[CMD_COUNT];
+   unsigned long errors[CMD_COUNT];
+   Histogram latency[CMD_COUNT]; // in Mikrosekunden
+   int failed;                   // Verbindung abgebrochen
+   pthread_t thread;
+} Connection;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Optionen (siehe usage())
+static const char *serverIp;
+static int serverPort;
+static int connectionCount = 4;
+static int duration = 10;
+static long requestsPerConnection = 0;
+static double rate = 0;
+static int weights[CMD_COUNT] = {0, 30, 40, 20, 10};
+static const char *userPrefix = "bench";
+static const char *password = "bench";
+static int messageSize = 200;
+static unsigned int seed = 1;
+static int timeoutSeconds = 5;
+
+static char *sendBody; // SEND Nachricht, für alle Verbindungen gleich
+static struct timespec benchStart;
+static struct timespec benchDeadline;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void usage(const char *program);
+int parseMix(const char *mix);
+void buildSendBody(void);
+void *connectionThread(void *data);
+int connectToServer(Connection *conn);
+int runCommand(Connection *conn, int command);
+int sendAll(Connection *conn, const char *buffer, size_t length);
+int readLine(Connection *conn, char *line, size_t maxlen);
+int pickCommand(Connection *conn);
+unsigned long elapsedUs(const struct timespec *from, const struct timespec *to);
+void addUs(struct timespec *time, double us);
+int isBefore(const struct timespec *a, const struct timespec *b);
+void printReport(Connection *connections);
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+   int option;
+   Connection *connections;
+
+   ////////////////////////////////////////////////////////////////////////////
+   // CHECK ARGUMENTS
+   while ((option = getopt(argc, argv, "c:d:n:r:m:u:s:S:t:")) != -1)
+   {
+      switch (option)
+      {
+      case 'c':
+         connectionCount = atoi(optarg);
+         break;
+      case 'd':
+         duration = atoi(optarg);
+         break;
+      case 'n':
+         requestsPerConnection = atol(optarg);
+         break;
+      case 'r':
+         rate = atof(optarg);
+         break;
+      case 'm':
+         if (parseMix(optarg) == -1)
+         {
+            return EXIT_FAILURE;
+         }
+         break;
+      case 'u':
+         userPrefix = optarg;
+         break;
+      case 's':
+         messageSize = atoi(optarg);
+         break;
+      case 'S':
+         seed = (unsigned int)strtoul(optarg, NULL, 10);
+         break;
+      case 't':
+         timeoutSeconds = atoi(optarg);
+         break;
+      default:
+         usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (argc - optind != 2)
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   serverIp = argv[optind];
+   serverPort = atoi(argv[optind + 1]);
+   if (serverPort <= 0 || serverPort > 65535)
+   {
+      fprintf(stderr, "Error: Invalid port number\n");
+      return EXIT_FAILURE;
+   }
+
+   if (connectionCount <= 0 || duration <= 0 || rate < 0 || timeoutSeconds <= 0 ||
+       messageSize < 1 || messageSize > BUF * 8)
+   {
+      fprintf(stderr, "Error: Invalid option value\n");
+      return EXIT_FAILURE;
+   }
+
+   // Username = Prefix + Verbindungsnummer, max. 8 Zeichen (a-z, 0-9)
+   if (strlen(userPrefix) + snprintf(NULL, 0, "%d", connectionCount - 1) > 8)
+   {
+      fprintf(stderr, "Error: user prefix too long for %d connections\n", connectionCount);
+      return EXIT_FAILURE;
+   }
+
+   // Passwort nicht über argv, damit es nicht in ps auftaucht
+   if (getenv("TWMAILER_BENCH_PASSWORD") != NULL)
+   {
+      password = getenv("TWMAILER_BENCH_PASSWORD");
+   }
+
+   buildSendBody();
+
+   connections = calloc(connectionCount, sizeof(Connection));
+   if (connections == NULL || sendBody == NULL)
+   {
+      fprintf(stderr, "Error: out of memory\n");
+      return EXIT_FAILURE;
+   }
+
+   ////////////////////////////////////////////////////////////////////////////
+   // START CONNECTIONS
+   clock_gettime(CLOCK_MONOTONIC, &benchStart);
+   benchDeadline = benchStart;
+   benchDeadline.tv_sec += duration;
+
+   for (int i = 0; i < connectionCount; i++)
+   {
+      Connection *conn = &connections[i];
+      conn->index = i;
+      conn->socket = -1;
+      conn->seed = seed + i;
+      snprintf(conn->username, sizeof(conn->username), "%s%d", userPrefix, i);
+
+      if (pthread_create(&conn->thread, NULL, connectionThread, conn) != 0)
+      {
+         fprintf(stderr, "Error: could not start thread %d\n", i);
+         return EXIT_FAILURE;
+      }
+   }
+
+   for (int i = 0; i < connectionCount; i++)
+   {
+      pthread_join(connections[i].thread, NULL);
+   }
+
+   printReport(connections);
+
+   free(connections);
+   free(sendBody);
+   return EXIT_SUCCESS;
+}
+
+void usage(const char *program)
+{
+   fprintf(stderr,
+           "Usage: %s [options] <ip> <port>\n"
+           "  -c connections   concurrent connections (default 4)\n"
+           "  -d seconds       run time (default 10)\n"
+           "  -n requests      stop each connection after n requests (default: no limit)\n"
+           "  -r rate          total requests per second, 0 = closed loop (default 0)\n"
+           "  -m mix           command weights, e.g. send=30,list=40,read=20,del=10,login=0\n"
+           "  -u prefix        username prefix, connection i uses <prefix><i> (default bench)\n"
+           "  -s bytes         SEND message size (default 200)\n"
+           "  -S seed          random seed for reproducible runs (default 1)\n"
+           "  -t seconds       response timeout (default 5)\n"
+           "Password is taken from TWMAILER_BENCH_PASSWORD (default \"bench\").\n",
+           program);
+}
+
+// Mix im Format name=gewicht,name=gewicht,... (nicht genannte Commands -> 0)
+int parseMix(const char *mix)
+{
+   char copy[256];
+   char *saveptr;
+   int total = 0;
+
+   snprintf(copy, sizeof(copy), "%s", mix);
+   memset(weights, 0, sizeof(weights));
+
+   for (char *item = strtok_r(copy, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr))
+   {
+      char *separator = strchr(item, '=');
+      int found = 0;
+
+      if (separator == NULL)
+      {
+         fprintf(stderr, "Error: invalid mix entry '%s'\n", item);
+         return -1;
+      }
+      *separator = '\0';
+
+      for (int i = 0; i < CMD_COUNT; i++)
+      {
+         if (strcasecmp(item, commandNames[i]) == 0)
+         {
+            weights[i] = atoi(separator + 1);
+            found = 1;
+         }
+      }
+      if (!found)
+      {
+         fprintf(stderr, "Error: unknown command '%s' in mix\n", item);
+         return -1;
+      }
+   }
+
+   for (int i = 0; i < CMD_COUNT; i++)
+   {
+      if (weights[i] < 0)
+      {
+         fprintf(stderr, "Error: negative weight in mix\n");
+         return -1;
+      }
+      total += weights[i];
+   }
+   if (total == 0)
+   {
+      fprintf(stderr, "Error: mix has no commands\n");
+      return -1;
+   }
+   return 0;
+}
+
+// Nachricht mit messageSize Bytes in Zeilen zu 64 Zeichen, mit "." am Ende
+void buildSendBody(void)
+{
+   size_t capacity = messageSize + messageSize / 64 + 8;
+   size_t length = 0;
+
+   sendBody = malloc(capacity);
+   if (sendBody == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < messageSize; i++)
+   {
+      sendBody[length++] = 'a' + i % 26;
+      if (i % 64 == 63 && i != messageSize - 1)
+      {
+         sendBody[length++] = '\n';
+      }
+   }
+   memcpy(sendBody + length, "\n.\n", 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void *connectionThread(void *data)
+{
+   Connection *conn = data;
+   char line[BUF];
+   struct timespec next, start, end;
+   double intervalUs = 0;
+
+   if (connectToServer(conn) == -1)
+   {
+      conn->failed = 1;
+      return NULL;
+   }
+
+   // jede Verbindung meldet sich einmal an, weitere LOGINs nur laut Mix
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   conn->count[CMD_LOGIN]++;
+   if (runCommand(conn, CMD_LOGIN) != 0)
+   {
+      fprintf(stderr, "Connection %d: LOGIN as %s failed\n", conn->index, conn->username);
+      conn->errors[CMD_LOGIN]++;
+      conn->failed = 1;
+      close(conn->socket);
+      return NULL;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   histogramRecord(&conn->latency[CMD_LOGIN], elapsedUs(&start, &end));
+
+   // Anzahl der Nachrichten vom letzten Lauf, READ/DEL beziehen sich darauf
+   if (sendAll(conn, "LIST\n", 5) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+   {
+      conn->failed = 1;
+      close(conn->socket);
+      return NULL;
+   }
+   conn->messages = atoi(line);
+   for (int i = 0; i < conn->messages; i++)
+   {
+      if (readLine(conn, line, sizeof(line)) <= 0)
+      {
+         conn->failed = 1;
+         close(conn->socket);
+         return NULL;
+      }
+   }
+
+   if (rate > 0)
+   {
+      intervalUs = 1e6 * connectionCount / rate;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &next);
+
+   for (long request = 0; requestsPerConnection == 0 || request < requestsPerConnection; request++)
+   {
+      int command = pickCommand(conn);
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (!isBefore(&start, &benchDeadline))
+      {
+         break;
+      }
+
+      if (rate > 0)
+      {
+         // geplanter Zeitpunkt, auch wenn wir schon hinterher sind
+         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+         start = next;
+         addUs(&next, intervalUs);
+      }
+
+      int result = runCommand(conn, command);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+
+      conn->count[command]++;
+      if (result != 0)
+      {
+         conn->errors[command]++;
+      }
+      if (result == -1)
+      {
+         fprintf(stderr, "Connection %d: %s failed, closing connection\n", conn->index,
+                 commandNames[command]);
+         conn->failed = 1;
+         break;
+      }
+      histogramRecord(&conn->latency[command], elapsedUs(&start, &end));
+   }
+
+   sendAll(conn, "QUIT\n", 5);
+   close(conn->socket);
+   return NULL;
+}
+
+int connectToServer(Connection *conn)
+{
+   struct sockaddr_in address;
+   struct timeval timeout = {timeoutSeconds, 0};
+   char line[BUF];
+
+   if ((conn->socket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+   {
+      perror("Socket error");
+      return -1;
+   }
+
+   // hängt der Server, soll der Benchmark trotzdem enden
+   setsockopt(conn->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(serverPort);
+   if (inet_aton(serverIp, &address.sin_addr) == 0)
+   {
+      fprintf(stderr, "Error: Invalid IP address\n");
+      close(conn->socket);
+      return -1;
+   }
+
+   if (connect(conn->socket, (struct sockaddr *)&address, sizeof(address)) == -1)
+   {
+      perror("Connect error - no server available");
+      close(conn->socket);
+      return -1;
+   }
+
+   // Welcome Message überspringen
+   if (readLine(conn, line, sizeof(line)) <= 0)
+   {
+      fprintf(stderr, "Connection %d: no welcome message\n", conn->index);
+      close(conn->socket);
+      return -1;
+   }
+   return 0;
+}
+
+// führt einen Command aus und liest die komplette Antwort
+// 0 = OK, 1 = ERR vom Server, -1 = Verbindung kaputt
+int runCommand(Connection *conn, int command)
+{
+   char request[BUF * 9];
+   char line[BUF];
+   int length;
+   int number;
+
+   switch (command)
+   {
+   case CMD_LOGIN:
+      length = snprintf(request, sizeof(request), "LOGIN\n%s\n%s\n", conn->username, password);
+      if (sendAll(conn, request, length) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+      {
+         return -1;
+      }
+      return strncmp(line, "OK", 2) == 0 ? 0 : 1;
+
+   case CMD_SEND:
+      // an sich selbst, damit READ/DEL etwas zu tun haben
+      // ein einziges send(), sonst misst man Nagle statt dem Server
+      length = snprintf(request, sizeof(request), "SEND\n%s\nbench %d\n%s",
+                        conn->username, conn->messages + 1, sendBody);
+      if (sendAll(conn, request, length) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(line, "OK\n") != 0)
+      {
+         return 1;
+      }
+      conn->messages++;
+      return 0;
+
+   case CMD_LIST:
+      if (sendAll(conn, "LIST\n", 5) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(line, "ERR\n") == 0)
+      {
+         return 1;
+      }
+      number = atoi(line);
+      for (int i = 0; i < number; i++)
+      {
+         if (readLine(conn, line, sizeof(line)) <= 0)
+         {
+            return -1;
+         }
+      }
+      return 0;
+
+   case CMD_READ:
+      number = conn->messages > 0 ? 1 + rand_r(&conn->seed) % conn->messages : 1;
+      length = snprintf(request, sizeof(request), "READ\n%d\n", number);
+      if (sendAll(conn, request, length) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(line, "OK\n") != 0)
+      {
+         return 1;
+      }
+      do
+      {
+         if (readLine(conn, line, sizeof(line)) <= 0)
+         {
+            return -1;
+         }
+      } while (strcmp(line, ".\n") != 0);
+      return 0;
+
+   case CMD_DEL:
+      // immer die höchste Nummer, dann bleiben die Nummern lückenlos
+      number = conn->messages > 0 ? conn->messages : 1;
+      length = snprintf(request, sizeof(request), "DEL\n%d\n", number);
+      if (sendAll(conn, request, length) == -1 || readLine(conn, line, sizeof(line)) <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(line, "OK\n") != 0)
+      {
+         return 1;
+      }
+      conn->messages--;
+      return 0;
+   }
+
+   return -1;
+}
+
+int sendAll(Connection *conn, const char *buffer, size_t length)
+{
+   while (length > 0)
+   {
+      ssize_t sent = send(conn->socket, buffer, length, MSG_NOSIGNAL);
+      if (sent == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return -1;
+      }
+      buffer += sent;
+      length -= sent;
+   }
+   return 0;
+}
+
+// gepufferte Version von readline(), liefert die Zeile inkl. '\n'
+// 0 = Verbindung geschlossen, -1 = Fehler oder Timeout
+int readLine(Connection *conn, char *line, size_t maxlen)
+{
+   size_t length = 0;
+
+   while (length < maxlen - 1)
+   {
+      if (conn->readStart == conn->readEnd)
+      {
+         ssize_t received = recv(conn->socket, conn->readBuffer, sizeof(conn->readBuffer), 0);
+         if (received == -1 && errno == EINTR)
+         {
+            continue;
+         }
+         if (received <= 0)
+         {
+            return received == 0 && length == 0 ? 0 : -1;
+         }
+         conn->readStart = 0;
+         conn->readEnd = received;
+      }
+
+      char c = conn->readBuffer[conn->readStart++];
+      line[length++] = c;
+      if (c == '\n')
+      {
+         break;
+      }
+   }
+
+   line[length] = '\0';
+   return (int)length;
+}
+
+int pickCommand(Connection *conn)
+{
+   int total = 0;
+
+   for (int i = 0; i < CMD_COUNT; i++)
+   {
+      total += weights[i];
+   }
+
+   int value = rand_r(&conn->seed) % total;
+   for (int i = 0; i < CMD_COUNT; i++)
+   {
+      if (value < weights[i])
+      {
+         return i;
+      }
+      value -= weights[i];
+   }
+   return CMD_COUNT - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long elapsedUs(const struct timespec *from, const struct timespec *to)
+{
+   long us = (to->tv_sec - from->tv_sec) * 1000000L + (to->tv_nsec - from->tv_nsec) / 1000;
+   return us > 0 ? (unsigned long)us : 0;
+}
+
+void addUs(struct timespec *time, double us)
+{
+   long ns = time->tv_nsec + (long)(us * 1000);
+   time->tv_sec += ns / 1000000000L;
+   time->tv_nsec = ns % 1000000000L;
+}
+
+int isBefore(const struct timespec *a, const struct timespec *b)
+{
+   return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+void printReport(Connection *connections)
+{
+   static Histogram latency[CMD_COUNT + 1]; // letzter Eintrag = alle Commands
+   unsigned long count[CMD_COUNT + 1] = {0};
+   unsigned long errors[CMD_COUNT + 1] = {0};
+   struct timespec end;
+   int failed = 0;
+
+   for (int i = 0; i < connectionCount; i++)
+   {
+      for (int c = 0; c < CMD_COUNT; c++)
+      {
+         histogramMerge(&latency[c], &connections[i].latency[c]);
+         histogramMerge(&latency[CMD_COUNT], &connections[i].latency[c]);
+         count[c] += connections[i].count[c];
+         errors[c] += connections[i].errors[c];
+         count[CMD_COUNT] += connections[i].count[c];
+         errors[CMD_COUNT] += connections[i].errors[c];
+      }
+      failed += connections[i].failed;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   double seconds = elapsedUs(&benchStart, &end) / 1e6;
+
+   printf("connections: %d, duration: %.2f s, mode: ", connectionCount, seconds);
+   if (rate > 0)
+   {
+      printf("%.1f req/s target\n", rate);
+   }
+   else
+   {
+      printf("closed loop\n");
+   }
+   if (failed > 0)
+   {
+      printf("failed connections: %d\n", failed);
+   }
+
+   printf("%-8s %10s %8s %10s %10s %10s %10s %10s\n",
+          "command", "count", "errors", "req/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+   for (int c = 0; c <= CMD_COUNT; c++)
+   {
+      if (count[c] == 0 && c != CMD_COUNT)
+      {
+         continue;
+      }
+      printf("%-8s %10lu %8lu %10.1f %10.3f %10.3f %10.3f %10.3f\n",
+             c == CMD_COUNT ? "TOTAL" : commandNames[c], count[c], errors[c], count[c] / seconds,
+             histogramPercentile(&latency[c], 0.5) / 1e3,
+             histogramPercentile(&latency[c], 0.99) / 1e3,
+             histogramPercentile(&latency[c], 0.999) / 1e3,
+             latency[c].max / 1e3);
+   }
+}
@@ -10,23 +10,55 @@
 #include <string.h>
 #include <errno.h>
 #include <termios.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include "client.h"
+#include "batch.h"
+#include "export.h"
+#include "cache.h"
+#include "protocol.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#define BUF 1024
+char tokenPath[512];
 
 ///////////////////////////////////////////////////////////////////////////////
 
 int handleLoginCommand(int socket);
+int handleResumeCommand(int socket);
+void initTokenPath(const char *ip, int port);
+int appendScript(char **script, const char *text, size_t length);
+int readScriptFile(char **script, const char *path);
+int loadCredentials(Credentials *credentials, const char *username, int passwordFd);
 int handleSendCommand(int socket);
 int handleListCommand(int socket);
 int handleReadCommand(int socket);
+int readBatchResponse(int socket, const char *numbers);
+int readPartialResponse(int socket, const char *request);
 int handleDelCommand(int socket);
-ssize_t readline(int fd, void *vptr, size_t maxlen);
-int isValidUsername(const char *username);
+int handleStatsCommand(int socket);
+int handleSyncCommand(int socket);
+int handleIdleCommand(int socket);
+int handleSearchCommand(int socket);
 int getch();
 void getpass_masked(char *password, size_t maxlen);
 
+// interaktive Commands, die Argumente abfragen bzw. die Antwort auswerten
+// (Index = CommandId, alle anderen werden unverändert geschickt)
+static int (*const commandHandlers[COMMAND_OTHER])(int socket) = {
+    [COMMAND_LOGIN] = handleLoginCommand,
+    [COMMAND_RESUME] = handleResumeCommand,
+    [COMMAND_SEND] = handleSendCommand,
+    [COMMAND_LIST] = handleListCommand,
+    [COMMAND_READ] = handleReadCommand,
+    [COMMAND_DEL] = handleDelCommand,
+    [COMMAND_STATS] = handleStatsCommand,
+    [COMMAND_SYNC] = handleSyncCommand,
+    [COMMAND_IDLE] = handleIdleCommand,
+    [COMMAND_SEARCH] = handleSearchCommand,
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 int main(int argc, char **argv)
@@ -37,14 +69,73 @@ int main(int argc, char **argv)
    int size;
    int isQuit;
    int port;
+   int option;
+   char *script = NULL; // Batch-Modus wenn gesetzt
+   const char *username = NULL;
+   int passwordFd = -1;
+   const char *exportTarget = NULL; // Export-Modus wenn gesetzt
+   int exportFormat = EXPORT_DIRECTORY;
+   int exportConnections = 4;
+   int tagged = 0; // Batch-Commands mit Tag (gleichzeitig am Server)
 
    ////////////////////////////////////////////////////////////////////////////
    // CHECK ARGUMENTS
-   if (argc != 3)
+   // -f <script> / -e <commands> -> Batch-Modus statt interaktiver Eingabe
+   // -x <dir> / -m <mbox> -> ganzes Postfach exportieren
+   // -t -> Batch-Commands getaggt schicken
+   while ((option = getopt(argc, argv, "f:e:u:p:x:m:k:t")) != -1)
+   {
+      switch (option)
+      {
+      case 'f':
+         if (readScriptFile(&script, optarg) == -1)
+         {
+            return EXIT_FAILURE;
+         }
+         break;
+      case 'e':
+         if (appendScript(&script, optarg, strlen(optarg)) == -1 ||
+             appendScript(&script, "\n", 1) == -1)
+         {
+            return EXIT_FAILURE;
+         }
+         break;
+      case 'u':
+         username = optarg;
+         break;
+      case 'p':
+         passwordFd = atoi(optarg);
+         break;
+      case 'x':
+         exportTarget = optarg;
+         exportFormat = EXPORT_DIRECTORY;
+         break;
+      case 'm':
+         exportTarget = optarg;
+         exportFormat = EXPORT_MBOX;
+         break;
+      case 'k':
+         exportConnections = atoi(optarg);
+         break;
+      case 't':
+         tagged = 1;
+         break;
+      default:
+         argc = 0; // Usage ausgeben
+         break;
+      }
+   }
+
+   if (argc - optind != 2 || exportConnections <= 0)
    {
-      fprintf(stderr, "Usage: %s <ip> <port>\n", argv[0]);
+      fprintf(stderr, "Usage: %s [-f script|-] [-e commands]... [-t] [-u user] [-p password-fd] <ip> <port>\n"
+                      "       %s {-x directory|-m mbox-file} [-k connections] [-u user] [-p password-fd] <ip> <port>\n"
+                      "Batch (-f/-e) and export (-x/-m) mode read the password from TWMAILER_PASSWORD\n"
+                      "or from fd -p, the username from -u or TWMAILER_USER.\n",
+              argv[0], argv[0]);
       return EXIT_FAILURE;
    }
+   argv += optind - 1; // ab hier wie bisher: argv[1] = ip, argv[2] = port
 
    port = atoi(argv[2]);
    if (port <= 0 || port > 65535)
@@ -79,6 +170,24 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
+   ////////////////////////////////////////////////////////////////////////////
+   // EXPORT MODE
+   // baut eigene Verbindungen auf (INDEX + k parallele READ-Verbindungen)
+   if (exportTarget != NULL)
+   {
+      Credentials credentials;
+      int failed = -1;
+
+      close(create_socket);
+      initTokenPath(argv[1], port);
+      if (loadCredentials(&credentials, username, passwordFd) == 0)
+      {
+         failed = exportMailbox(&address, &credentials, exportTarget, exportFormat, exportConnections);
+      }
+      memset(&credentials, 0, sizeof(credentials));
+      return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+   }
+
    ////////////////////////////////////////////////////////////////////////////
    // CREATE A CONNECTION
    // https://man7.org/linux/man-pages/man2/connect.2.html
@@ -91,6 +200,30 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
+   ////////////////////////////////////////////////////////////////////////////
+   // BATCH MODE
+   // stdout enthält nur die Ausgaben von LIST/READ/STATS
+   if (script != NULL)
+   {
+      Credentials credentials;
+      int failed = -1;
+
+      initTokenPath(argv[1], port);
+      size = readline(create_socket, buffer, BUF - 1);
+      if (size > 0 && strncmp(buffer, "BUSY", 4) == 0)
+      {
+         fprintf(stderr, "Server busy, try again later\n");
+      }
+      else if (size > 0 && loadCredentials(&credentials, username, passwordFd) == 0)
+      {
+         failed = batchRun(create_socket, script, &credentials, tagged);
+      }
+      memset(&credentials, 0, sizeof(credentials));
+      free(script);
+      close(create_socket);
+      return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+   }
+
    // ignore return value of printf
    printf("Connection with server (%s) established\n",
           inet_ntoa(address.sin_addr));
@@ -111,76 +244,32 @@ int main(int argc, char **argv)
       printf("%s", buffer); // ignore error
    }
 
+   ////////////////////////////////////////////////////////////////////////////
+   // RESUME SESSION
+   // falls ein Token vom letzten LOGIN gespeichert ist -> kein LOGIN nötig
+   initTokenPath(argv[1], port);
+   cacheInit(argv[1], port);
+   if (access(tokenPath, R_OK) == 0)
+   {
+      handleResumeCommand(create_socket); // bei Fehler einfach normal LOGIN
+   }
+
    do
    {
       printf(">> ");
       if (fgets(buffer, BUF - 1, stdin) != NULL)
       {
-         int size = strlen(buffer);
-         // remove new-line signs from string at the end
-         if (buffer[size - 2] == '\r' && buffer[size - 1] == '\n')
-         {
-            size -= 2;
-            buffer[size] = 0;
-         }
-         else if (buffer[size - 1] == '\n')
-         {
-            --size;
-            buffer[size] = 0;
-         }
-
+         int size = protocolStripLine(buffer, strlen(buffer));
          isQuit = strcmp(buffer, "QUIT") == 0;
 
-         // Check if LOGIN command
-         if (strcmp(buffer, "LOGIN") == 0)
-         {
-            if (handleLoginCommand(create_socket) == -1)
-            {
-               fprintf(stderr, "<< LOGIN command failed\n");
-            }
-            continue; 
-         }
-
-         // Check if SEND command
-         if (strcmp(buffer, "SEND") == 0)
-         {
-            // Handle SEND command specially
-            if (handleSendCommand(create_socket) == -1)
-            {
-               fprintf(stderr, "<< SEND command failed\n");
-            }
-            continue; 
-         }
-
-         // Check if LIST command
-         if (strcmp(buffer, "LIST") == 0)
-         {
-            // Handle LIST command specially
-            if (handleListCommand(create_socket) == -1)
-            {
-               fprintf(stderr, "<< LIST command failed\n");
-            }
-            continue; 
-         }
-
-         // Check if READ command
-         if (strcmp(buffer, "READ") == 0)
-         {
-            if (handleReadCommand(create_socket) == -1)
-            {
-               fprintf(stderr, "<< READ command failed\n");
-            }
-            continue; 
-         }
-
-         // Check if DEL command
-         if (strcmp(buffer, "DEL") == 0)
+         const ProtocolCommand *command = protocolLookup(buffer, size);
+         if (command != NULL && commandHandlers[command->id] != NULL)
          {
-            if (handleDelCommand(create_socket) == -1)
+            if (commandHandlers[command->id](create_socket) == -1)
             {
-               fprintf(stderr, "<< DEL command failed\n");
+               fprintf(stderr, "<< %s command failed\n", command->name);
             }
-            continue; 
+            continue;
          }
 
          //////////////////////////////////////////////////////////////////////
@@ -188,7 +277,9 @@ int main(int argc, char **argv)
          // https://man7.org/linux/man-pages/man2/send.2.html
          // send will fail if connection is closed, but does not set
          // the error of send, but still the count of bytes sent
-         if ((send(create_socket, buffer, size + 1, 0)) == -1)
+         // Server liest zeilenweise -> mit newline abschließen
+         buffer[size++] = '\n';
+         if ((send(create_socket, buffer, size, 0)) == -1)
          {
             // in case the server is gone offline we will still not enter
             // this part of code: see docs: https://linux.die.net/man/3/send
@@ -332,6 +423,8 @@ int handleLoginCommand(int socket)
    if (strncmp(buffer, "OK", 2) == 0)
    {
       printf("Login successful!\n");
+      saveToken(buffer);
+      cacheSetUser(username);
       return 0;
    }
    else
@@ -341,6 +434,218 @@ int handleLoginCommand(int socket)
    }
 }
 
+// RESUME command handler
+// schickt das gespeicherte Token statt Username/Passwort
+int handleResumeCommand(int socket)
+{
+   char buffer[BUF];
+   char token[512];
+   int size;
+
+   FILE *file = fopen(tokenPath, "r");
+   if (file == NULL)
+   {
+      fprintf(stderr, "No saved session, please LOGIN\n");
+      return -1;
+   }
+   if (fgets(token, sizeof(token), file) == NULL)
+   {
+      fclose(file);
+      fprintf(stderr, "Saved session is empty, please LOGIN\n");
+      return -1;
+   }
+   fclose(file);
+   token[strcspn(token, "\r\n")] = '\0';
+
+   // Send RESUME command
+   snprintf(buffer, sizeof(buffer), "RESUME\n%s\n", token);
+   if (send(socket, buffer, strlen(buffer), 0) == -1)
+   {
+      perror("send RESUME command failed");
+      return -1;
+   }
+
+   // Receive response
+   size = readline(socket, buffer, BUF - 1);
+   if (size == -1)
+   {
+      perror("readline response failed");
+      return -1;
+   }
+   else if (size == 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+
+   if (strncmp(buffer, "OK", 2) == 0)
+   {
+      // Username steht im Token vor dem ersten ':'
+      token[strcspn(token, ":")] = '\0';
+      printf("Session resumed as %s\n", token);
+      cacheSetUser(token);
+      saveToken(buffer); // Server schickt ein erneuertes Token
+      return 0;
+   }
+
+   // Token abgelaufen oder ungültig -> verwerfen
+   printf("Saved session expired, please LOGIN\n");
+   unlink(tokenPath);
+   return -1;
+}
+
+// Token-Datei: $TWMAILER_TOKEN_FILE oder ~/.twmailer-token-<ip>-<port>
+void initTokenPath(const char *ip, int port)
+{
+   const char *path = getenv("TWMAILER_TOKEN_FILE");
+   const char *home = getenv("HOME");
+
+   if (path != NULL && *path != '\0')
+   {
+      snprintf(tokenPath, sizeof(tokenPath), "%s", path);
+   }
+   else
+   {
+      snprintf(tokenPath, sizeof(tokenPath), "%s/.twmailer-token-%s-%d",
+               home != NULL ? home : ".", ip, port);
+   }
+}
+
+// hängt Text an das Batch-Script an (-e und -f können kombiniert werden)
+int appendScript(char **script, const char *text, size_t length)
+{
+   size_t oldLength = *script != NULL ? strlen(*script) : 0;
+   char *grown = realloc(*script, oldLength + length + 1);
+
+   if (grown == NULL)
+   {
+      fprintf(stderr, "Error: out of memory\n");
+      return -1;
+   }
+   memcpy(grown + oldLength, text, length);
+   grown[oldLength + length] = '\0';
+   *script = grown;
+   return 0;
+}
+
+// liest ein Batch-Script, "-" = stdin
+int readScriptFile(char **script, const char *path)
+{
+   char chunk[BUF];
+   size_t length;
+   FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+
+   if (file == NULL)
+   {
+      perror("open script failed");
+      return -1;
+   }
+
+   while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+   {
+      if (appendScript(script, chunk, length) == -1)
+      {
+         return -1;
+      }
+   }
+
+   // letzte Zeile ohne newline soll nicht mit dem nächsten -e verschmelzen
+   if (appendScript(script, "\n", 1) == -1)
+   {
+      return -1;
+   }
+   if (file != stdin)
+   {
+      fclose(file);
+   }
+   return 0;
+}
+
+// Login-Daten für den Batch-Modus: Username aus -u oder TWMAILER_USER,
+// Passwort aus dem fd von -p (erste Zeile) oder TWMAILER_PASSWORD
+// ohne Username wird die gespeicherte Session (RESUME) verwendet
+int loadCredentials(Credentials *credentials, const char *username, int passwordFd)
+{
+   memset(credentials, 0, sizeof(*credentials));
+
+   if (username == NULL)
+   {
+      username = getenv("TWMAILER_USER");
+   }
+   if (username == NULL || *username == '\0')
+   {
+      return 0;
+   }
+   snprintf(credentials->username, sizeof(credentials->username), "%s", username);
+
+   if (passwordFd >= 0)
+   {
+      size_t length = 0;
+      char c;
+
+      // zeichenweise, damit nichts nach der ersten Zeile verbraucht wird
+      while (length < sizeof(credentials->password) - 1 && read(passwordFd, &c, 1) == 1 && c != '\n')
+      {
+         credentials->password[length++] = c;
+      }
+      credentials->password[strcspn(credentials->password, "\r")] = '\0';
+   }
+   else if (getenv("TWMAILER_PASSWORD") != NULL)
+   {
+      snprintf(credentials->password, sizeof(credentials->password), "%s", getenv("TWMAILER_PASSWORD"));
+   }
+
+   if (credentials->password[0] == '\0')
+   {
+      fprintf(stderr, "No password for %s (set TWMAILER_PASSWORD or use -p <fd>)\n", credentials->username);
+      return -1;
+   }
+   return 0;
+}
+
+// liest das gespeicherte Token, -1 wenn keines vorhanden ist
+int loadToken(char *token, size_t size)
+{
+   FILE *file = fopen(tokenPath, "r");
+   if (file == NULL)
+   {
+      return -1;
+   }
+   if (fgets(token, size, file) == NULL)
+   {
+      fclose(file);
+      return -1;
+   }
+   fclose(file);
+   token[strcspn(token, "\r\n")] = '\0';
+   return token[0] != '\0' ? 0 : -1;
+}
+
+// speichert das Token aus "OK <token>" (nur für den User lesbar)
+void saveToken(const char *response)
+{
+   char token[BUF];
+
+   if (strncmp(response, "OK ", 3) != 0)
+   {
+      return; // Server hat kein Token geschickt
+   }
+   snprintf(token, sizeof(token), "%s", response + 3);
+   token[strcspn(token, "\r\n")] = '\0';
+
+   int fd = open(tokenPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1)
+   {
+      perror("open token file failed");
+      return;
+   }
+   if (write(fd, token, strlen(token)) == -1 || write(fd, "\n", 1) == -1)
+   {
+      perror("write token file failed");
+   }
+   close(fd);
+}
+
 // Verarbeitet den SEND command zwischen  user und server
 int handleSendCommand(int socket)
 {
@@ -383,8 +688,9 @@ int handleSendCommand(int socket)
          ;
    }
 
-   // prüft Länge des receiver
-   if (size == 0 || size > 8)
+   // prüft Länge des receiver (Grenzen aus der Protokoll-Tabelle)
+   const ProtocolCommand *command = protocolLookup("SEND", 4);
+   if (protocolCheckArg(command, 0, size) == -1)
    {
       fprintf(stderr, "Invalid receiver length (must be 1-8 characters)\n");
       return -1;
@@ -429,7 +735,7 @@ int handleSendCommand(int socket)
    }
 
    // prüft Länge des betreffs
-   if (size == 0 || size > 80)
+   if (protocolCheckArg(command, 1, size) == -1)
    {
       fprintf(stderr, "Invalid subject length (must be 1-80 characters)\n");
       return -1;
@@ -569,20 +875,23 @@ int handleListCommand(int socket)
 
 // READ command handler
 // Pro Version: Username wird aus Session genommen
+// Nachrichten im Cache werden nur mit STAT revalidiert (kein Download)
 int handleReadCommand(int socket)
 {
    char buffer[BUF];
-   char messageNum[10];
+   char messageNum[256]; // Nummer oder Batch, z.B. "3,7,9" oder "1-500"
    int size;
-
-   // Send READ command
-   if (send(socket, "READ\n", 5, 0) == -1)
-   {
-      perror("send READ command failed");
-      return -1;
-   }
+   int number;
+   unsigned long uidValidity;
+   unsigned long currentValidity;
+   size_t cachedSize;
+   long currentSize;
+   char *content = NULL;
+   size_t contentLength = 0;
+   size_t contentCapacity = 0;
 
    printf("(Reading message from your logged-in account)\n");
+   printf("(<n>, <n>,<m>, <n>-<m>, <n> HEADER or <n> RANGE <offset> <length>)\n");
 
    // Get message number
    printf("Message number: ");
@@ -598,12 +907,63 @@ int handleReadCommand(int socket)
    {
       messageNum[size - 1] = '\0';
    }
+   number = atoi(messageNum);
 
-   // Send message number
-   snprintf(buffer, sizeof(buffer), "%s\n", messageNum);
+   // Batch (Liste/Bereich): eine Antwort für alle, ohne Cache
+   if (strpbrk(messageNum, ",-") != NULL)
+   {
+      return readBatchResponse(socket, messageNum);
+   }
+
+   // "<n> HEADER" oder "<n> RANGE <offset> <length>", ohne Cache
+   if (strchr(messageNum, ' ') != NULL)
+   {
+      return readPartialResponse(socket, messageNum);
+   }
+
+   // im Cache -> STAT reicht, wenn uidvalidity und Größe noch stimmen
+   if (number > 0 && cacheLookup(number, &uidValidity, &cachedSize, &content) == 0)
+   {
+      snprintf(buffer, sizeof(buffer), "STAT\n%d\n", number);
+      if (send(socket, buffer, strlen(buffer), 0) == -1)
+      {
+         perror("send STAT command failed");
+         free(content);
+         return -1;
+      }
+
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         printf("Server closed connection\n");
+         free(content);
+         return -1;
+      }
+
+      if (sscanf(buffer, "OK %lu %ld", &currentValidity, &currentSize) == 2 &&
+          currentValidity == uidValidity && (size_t)currentSize == cachedSize)
+      {
+         printf("<< OK (cached)\n%s", content);
+         free(content);
+         return 0;
+      }
+
+      // veraltet oder gelöscht
+      free(content);
+      content = NULL;
+      cacheRemove(number);
+      if (strncmp(buffer, "ERR", 3) == 0)
+      {
+         printf("<< %s", buffer);
+         return -1;
+      }
+   }
+
+   // READ und STAT (für den Cache) in einem Round-Trip
+   snprintf(buffer, sizeof(buffer), "READ\n%s\nSTAT\n%s\n", messageNum, messageNum);
    if (send(socket, buffer, strlen(buffer), 0) == -1)
    {
-      perror("send message number failed");
+      perror("send READ command failed");
       return -1;
    }
 
@@ -624,6 +984,7 @@ int handleReadCommand(int socket)
    if (strncmp(buffer, "ERR", 3) == 0)
    {
       printf("<< %s", buffer);
+      readline(socket, buffer, BUF - 1); // Antwort auf STAT (auch ERR)
       return -1;
    }
 
@@ -636,7 +997,8 @@ int handleReadCommand(int socket)
       size = readline(socket, buffer, BUF - 1);
       if (size <= 0)
       {
-         break;
+         free(content);
+         return -1;
       }
 
       // end marker check
@@ -646,52 +1008,189 @@ int handleReadCommand(int socket)
       }
 
       printf("%s", buffer);
+
+      // für den Cache mitschreiben
+      if (contentLength + size > contentCapacity)
+      {
+         contentCapacity = (contentLength + size) * 2;
+         char *grown = realloc(content, contentCapacity);
+         if (grown == NULL)
+         {
+            free(content);
+            return -1;
+         }
+         content = grown;
+      }
+      memcpy(content + contentLength, buffer, size);
+      contentLength += size;
    }
 
-   return 0;
+   // STAT Antwort: nur cachen wenn die Größe zum Inhalt passt
+   size = readline(socket, buffer, BUF - 1);
+   if (size > 0 && sscanf(buffer, "OK %lu %ld", &currentValidity, &currentSize) == 2 &&
+       (size_t)currentSize == contentLength)
+   {
+      cacheStore(number, currentValidity, content != NULL ? content : "", contentLength);
+   }
+   free(content);
+
+   return size > 0 ? 0 : -1;
 }
 
-// DEL command handler
-int handleDelCommand(int socket)
+// Batch-READ: "OK <count>", dann pro Nachricht Nummer, Inhalt, "."
+int readBatchResponse(int socket, const char *numbers)
 {
    char buffer[BUF];
-   char messageNum[10];
    int size;
 
-   // Send DEL command
-   if (send(socket, "DEL\n", 4, 0) == -1)
+   size = snprintf(buffer, sizeof(buffer), "READ\n%s\n", numbers);
+   if (sendAll(socket, buffer, size) == -1)
    {
-      perror("send DEL command failed");
+      perror("send READ command failed");
       return -1;
    }
 
-   printf("(Deleting message from your logged-in account)\n");
-
-   // Get message number
-   printf("Message number: ");
-   if (fgets(messageNum, sizeof(messageNum), stdin) == NULL)
+   size = readline(socket, buffer, BUF - 1);
+   if (size <= 0)
    {
-      fprintf(stderr, "Error reading message number\n");
+      printf("Server closed connection\n");
       return -1;
    }
-
-   // Remove newline
-   size = strlen(messageNum);
-   if (messageNum[size - 1] == '\n')
-   {
-      messageNum[size - 1] = '\0';
-   }
-
-   // Send message number
-   snprintf(buffer, sizeof(buffer), "%s\n", messageNum);
-   if (send(socket, buffer, strlen(buffer), 0) == -1)
+   printf("<< %s", buffer);
+   if (strncmp(buffer, "OK", 2) != 0)
    {
-      perror("send message number failed");
       return -1;
    }
 
-   // Receive response
-   size = readline(socket, buffer, BUF - 1);
+   for (int count = atoi(buffer + 2); count > 0; count--)
+   {
+      // Nummer der Nachricht
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         return -1;
+      }
+      printf("--- message %s", buffer);
+
+      while (1)
+      {
+         size = readline(socket, buffer, BUF - 1);
+         if (size <= 0)
+         {
+            return -1;
+         }
+         if (strcmp(buffer, ".\n") == 0)
+         {
+            break;
+         }
+         printf("%s", buffer);
+      }
+   }
+   return 0;
+}
+
+// Teil-READ: HEADER endet mit ".", bei RANGE folgen genau <length> Bytes
+int readPartialResponse(int socket, const char *request)
+{
+   char buffer[BUF];
+   long bodySize;
+   long offset;
+   long length;
+   int size;
+
+   size = snprintf(buffer, sizeof(buffer), "READ\n%s\n", request);
+   if (sendAll(socket, buffer, size) == -1)
+   {
+      perror("send READ command failed");
+      return -1;
+   }
+
+   size = readline(socket, buffer, BUF - 1);
+   if (size <= 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+   printf("<< %s", buffer);
+
+   if (sscanf(buffer, "OK %ld %ld %ld", &bodySize, &offset, &length) == 3)
+   {
+      while (length > 0)
+      {
+         ssize_t received = recv(socket, buffer, length < BUF ? length : BUF, 0);
+         if (received <= 0)
+         {
+            perror("recv range failed");
+            return -1;
+         }
+         fwrite(buffer, 1, received, stdout);
+         length -= received;
+      }
+      printf("\n");
+      return 0;
+   }
+   if (sscanf(buffer, "OK %ld", &bodySize) != 1)
+   {
+      return -1;
+   }
+
+   while (1)
+   {
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(buffer, ".\n") == 0)
+      {
+         break;
+      }
+      printf("%s", buffer);
+   }
+   return 0;
+}
+
+// DEL command handler
+int handleDelCommand(int socket)
+{
+   char buffer[BUF];
+   char messageNum[256]; // Nummer oder Batch, z.B. "1-500"
+   int size;
+
+   // Send DEL command
+   if (send(socket, "DEL\n", 4, 0) == -1)
+   {
+      perror("send DEL command failed");
+      return -1;
+   }
+
+   printf("(Deleting message from your logged-in account)\n");
+
+   // Get message number
+   printf("Message number: ");
+   if (fgets(messageNum, sizeof(messageNum), stdin) == NULL)
+   {
+      fprintf(stderr, "Error reading message number\n");
+      return -1;
+   }
+
+   // Remove newline
+   size = strlen(messageNum);
+   if (messageNum[size - 1] == '\n')
+   {
+      messageNum[size - 1] = '\0';
+   }
+
+   // Send message number
+   snprintf(buffer, sizeof(buffer), "%s\n", messageNum);
+   if (send(socket, buffer, strlen(buffer), 0) == -1)
+   {
+      perror("send message number failed");
+      return -1;
+   }
+
+   // Receive response
+   size = readline(socket, buffer, BUF - 1);
    if (size == -1)
    {
       perror("readline response failed");
@@ -709,6 +1208,12 @@ int handleDelCommand(int socket)
    // Check if OK or ERR
    if (strncmp(buffer, "OK", 2) == 0)
    {
+      // bei Batch-DEL bleiben veraltete Einträge liegen, STAT beim
+      // nächsten READ erkennt sie
+      if (strpbrk(messageNum, ",-") == NULL)
+      {
+         cacheRemove(atoi(messageNum));
+      }
       return 0; // Success
    }
    else
@@ -717,6 +1222,267 @@ int handleDelCommand(int socket)
    }
 }
 
+// STATS command handler (nur für Admins)
+// gibt die Server-Statistiken bis zum end marker aus
+int handleStatsCommand(int socket)
+{
+   char buffer[BUF];
+   int size;
+
+   // Send STATS command
+   if (send(socket, "STATS\n", 6, 0) == -1)
+   {
+      perror("send STATS command failed");
+      return -1;
+   }
+
+   // Receive response
+   size = readline(socket, buffer, BUF - 1);
+   if (size == -1)
+   {
+      perror("readline response failed");
+      return -1;
+   }
+   else if (size == 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+
+   printf("<< %s", buffer);
+   if (strncmp(buffer, "OK", 2) != 0)
+   {
+      return -1;
+   }
+
+   // Stats zeilenweise bis zum end marker ausgeben
+   while (1)
+   {
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         break;
+      }
+
+      if (strcmp(buffer, ".\n") == 0)
+      {
+         break;
+      }
+
+      printf("%s", buffer);
+   }
+
+   return 0;
+}
+
+// SEARCH command handler
+// Treffer mit Nachrichtennummer (für READ/DEL), Format wie INDEX
+int handleSearchCommand(int socket)
+{
+   char buffer[BUF];
+   char query[BUF - 16];
+   int size;
+
+   printf("Search words: ");
+   if (fgets(query, sizeof(query), stdin) == NULL)
+   {
+      fprintf(stderr, "Error reading search words\n");
+      return -1;
+   }
+   query[strcspn(query, "\r\n")] = '\0';
+
+   size = snprintf(buffer, sizeof(buffer), "SEARCH\n%s\n", query);
+   if (sendAll(socket, buffer, size) == -1)
+   {
+      perror("send SEARCH command failed");
+      return -1;
+   }
+
+   size = readline(socket, buffer, BUF - 1);
+   if (size <= 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+   if (strncmp(buffer, "ERR", 3) == 0)
+   {
+      printf("<< %s", buffer);
+      return -1;
+   }
+
+   int messageCount = atoi(buffer);
+   printf("<< %d message(s) found\n", messageCount);
+   for (int i = 0; i < messageCount; i++)
+   {
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         return -1;
+      }
+      printf("  %s", buffer);
+   }
+   return 0;
+}
+
+// SYNC command handler
+// zeigt nur neue/gelöschte Nachrichten seit dem letzten SYNC, der Stand
+// (uidvalidity + modseq) wird im Cache-Verzeichnis gespeichert
+int handleSyncCommand(int socket)
+{
+   char buffer[BUF];
+   unsigned long uidValidity;
+   unsigned long modSeq;
+   char mode[8];
+   int size;
+   int changes = 0;
+
+   cacheLoadWatermark(&uidValidity, &modSeq);
+   size = snprintf(buffer, sizeof(buffer), "SYNC\n%lu %lu\n", uidValidity, modSeq);
+   if (sendAll(socket, buffer, size) == -1)
+   {
+      perror("send SYNC command failed");
+      return -1;
+   }
+
+   size = readline(socket, buffer, BUF - 1);
+   if (size == -1)
+   {
+      perror("readline response failed");
+      return -1;
+   }
+   else if (size == 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+
+   printf("<< %s", buffer);
+   if (sscanf(buffer, "OK %lu %lu %7s", &uidValidity, &modSeq, mode) != 3)
+   {
+      return -1;
+   }
+   if (strcmp(mode, "FULL") == 0)
+   {
+      printf("(full resync, showing all messages)\n");
+   }
+
+   // Änderungen bis zum end marker
+   while (1)
+   {
+      size = readline(socket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         return -1;
+      }
+      if (strcmp(buffer, ".\n") == 0)
+      {
+         break;
+      }
+
+      // gelöschte Nachrichten auch aus dem Cache entfernen
+      if (buffer[0] == '-')
+      {
+         cacheRemove(atoi(buffer + 2));
+      }
+      printf("  %s", buffer);
+      changes++;
+   }
+
+   if (changes == 0)
+   {
+      printf("(no changes)\n");
+   }
+   cacheSaveWatermark(uidValidity, modSeq);
+   return 0;
+}
+
+// IDLE command handler
+// wartet auf Push-Meldungen vom Server bis der User Enter drückt (-> DONE)
+int handleIdleCommand(int socket)
+{
+   char buffer[BUF];
+   struct pollfd fds[2];
+   int size;
+
+   if (sendAll(socket, "IDLE\n", 5) == -1)
+   {
+      perror("send IDLE command failed");
+      return -1;
+   }
+
+   size = readline(socket, buffer, BUF - 1);
+   if (size <= 0)
+   {
+      printf("Server closed connection\n");
+      return -1;
+   }
+   printf("<< %s", buffer);
+   if (strncmp(buffer, "OK", 2) != 0)
+   {
+      return -1;
+   }
+   printf("(waiting for new mail, press Enter to stop)\n");
+   fflush(stdout);
+
+   fds[0].fd = socket;
+   fds[0].events = POLLIN;
+   fds[1].fd = STDIN_FILENO;
+   fds[1].events = POLLIN;
+   int doneSent = 0;
+
+   // Push-Zeilen ausgeben bis zum end marker (nach DONE oder Server-Timeout)
+   while (1)
+   {
+      if (poll(fds, doneSent ? 1 : 2, -1) == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         perror("poll failed");
+         return -1;
+      }
+
+      if (!doneSent && (fds[1].revents & (POLLIN | POLLHUP)))
+      {
+         // Eingabe (oder EOF) beendet IDLE
+         if (fgets(buffer, sizeof(buffer), stdin) == NULL)
+         {
+            clearerr(stdin);
+         }
+         if (sendAll(socket, "DONE\n", 5) == -1)
+         {
+            perror("send DONE failed");
+            return -1;
+         }
+         doneSent = 1;
+      }
+
+      if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+      {
+         size = readline(socket, buffer, BUF - 1);
+         if (size <= 0)
+         {
+            printf("Server closed connection\n");
+            return -1;
+         }
+         if (strcmp(buffer, ".\n") == 0)
+         {
+            break;
+         }
+
+         if (buffer[0] == '-')
+         {
+            cacheRemove(atoi(buffer + 2));
+         }
+         printf("  %s", buffer);
+         fflush(stdout);
+      }
+   }
+
+   return 0;
+}
+
 // readline() - Stevens Implementation from PDF
 ssize_t readline(int fd, void *vptr, size_t maxlen)
 {
@@ -752,24 +1518,89 @@ ssize_t readline(int fd, void *vptr, size_t maxlen)
    return (n);
 }
 
-// Validiert Username: nur a-z und 0-9 erlaubt
-int isValidUsername(const char *username)
+// gepufferte Version von readline(), liefert die Zeile inkl. '\n'
+// 0 = Verbindung geschlossen, -1 = Fehler
+int lineReaderRead(LineReader *reader, char *line, size_t maxlen)
 {
-   if (username == NULL || *username == '\0')
+   size_t length = 0;
+
+   while (length < maxlen - 1)
    {
-      return 0; // leer
+      if (reader->start == reader->end)
+      {
+         ssize_t received = recv(reader->socket, reader->buffer, sizeof(reader->buffer), 0);
+         if (received == -1 && errno == EINTR)
+         {
+            continue;
+         }
+         if (received <= 0)
+         {
+            return length == 0 ? (int)received : -1;
+         }
+         reader->start = 0;
+         reader->end = received;
+      }
+
+      char c = reader->buffer[reader->start++];
+      line[length++] = c;
+      if (c == '\n')
+      {
+         break;
+      }
    }
 
-   for (int i = 0; username[i] != '\0'; i++)
+   line[length] = '\0';
+   return (int)length;
+}
+
+// liest genau length Bytes (Rest im Buffer zuerst), -1 bei Fehler oder EOF
+int lineReaderReadBytes(LineReader *reader, char *data, size_t length)
+{
+   while (length > 0)
    {
-      char c = username[i];
-      if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')))
+      if (reader->start == reader->end)
       {
-         return 0; // ungültiges Zeichen
+         ssize_t received = recv(reader->socket, reader->buffer, sizeof(reader->buffer), 0);
+         if (received == -1 && errno == EINTR)
+         {
+            continue;
+         }
+         if (received <= 0)
+         {
+            return -1;
+         }
+         reader->start = 0;
+         reader->end = received;
       }
+
+      size_t available = reader->end - reader->start;
+      size_t count = available < length ? available : length;
+      memcpy(data, reader->buffer + reader->start, count);
+      reader->start += count;
+      data += count;
+      length -= count;
    }
+   return 0;
+}
 
-   return 1; // valid
+// schickt alle Bytes (send() kann auch nur einen Teil schreiben)
+int sendAll(int socket, const char *buffer, size_t length)
+{
+   while (length > 0)
+   {
+      ssize_t sent = send(socket, buffer, length, MSG_NOSIGNAL);
+      if (sent == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return -1;
+      }
+      buffer += sent;
+      length -= sent;
+   }
+   return 0;
 }
 
 //um einen char ohne eingabe zu lesen
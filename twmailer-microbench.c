@@ -0,0 +1,446 @@
+#define _DEFAULT_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include "commands.h"
+#include "histogram.h"
+#include "log.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Micro-Benchmark für die Hot Paths des Servers
+// readline(), readRequest(), getNextMessageNumber(), handleList() und
+// handleRead() werden direkt aufgerufen, der Client ist das andere Ende
+// eines socketpair().
+// Die Spools (Default 10, 1k, 100k und 1M Nachrichten) werden einmal in
+// <workdir>/<size>/ erzeugt und bei späteren Läufen wiederverwendet.
+// Ergebnisse werden als CSV an die Output-Datei angehängt, mit -l (z.B.
+// Commit-Hash) lassen sich Läufe verschiedener Versionen vergleichen.
+
+#define SPOOL_USER "bench"
+#define READLINE_BATCH 64
+#define REQUEST_BATCH 256 // Requests pro Aufruf von benchRequest()
+
+typedef int (*BenchFunction)(void *data);
+
+typedef struct BenchContext
+{
+   int serverSocket; // an diesem Ende laufen die Handler
+   int peerSocket;   // Client-Seite, wird vom Drain-Thread geleert
+   char userDir[512];
+   long spoolSize;
+   long nextMessage;
+} BenchContext;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const char *workDir = "/tmp/twmailer-microbench";
+static const char *outputPath = "microbench.csv";
+static const char *label = "";
+static double minSeconds = 1.0;
+static FILE *output;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void usage(const char *program);
+int prepareSpool(long size, char *spoolDir, size_t spoolDirSize);
+void *drainPeer(void *data);
+int benchReadline(void *data);
+int benchRequest(void *data);
+int benchNextNumber(void *data);
+int benchList(void *data);
+int benchRead(void *data);
+int runBenchmark(const char *name, long spoolSize, BenchFunction function, void *data);
+unsigned long elapsedNs(const struct timespec *from, const struct timespec *to);
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+   char sizeList[256] = "10,1000,100000,1000000";
+   char spoolDir[256];
+   char *saveptr;
+   int option;
+   int failed = 0;
+
+   while ((option = getopt(argc, argv, "s:d:o:l:t:")) != -1)
+   {
+      switch (option)
+      {
+      case 's':
+         snprintf(sizeList, sizeof(sizeList), "%s", optarg);
+         break;
+      case 'd':
+         workDir = optarg;
+         break;
+      case 'o':
+         outputPath = optarg;
+         break;
+      case 'l':
+         label = optarg;
+         break;
+      case 't':
+         minSeconds = atof(optarg);
+         break;
+      default:
+         usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (optind != argc || minSeconds <= 0)
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   // Handler loggen sonst jeden Aufruf, readRequest() braucht die Grenzen
+   configDefaults(&serverConfig);
+   logLevel = LOG_LEVEL_ERROR;
+
+   output = fopen(outputPath, "a");
+   if (output == NULL)
+   {
+      perror("fopen output");
+      return EXIT_FAILURE;
+   }
+   fseek(output, 0, SEEK_END);
+   if (ftell(output) == 0)
+   {
+      fprintf(output, "label,benchmark,spool_size,iterations,mean_ns,p50_ns,p99_ns,max_ns\n");
+   }
+
+   printf("%-22s %10s %10s %12s %12s %12s %12s\n",
+          "benchmark", "spool", "iterations", "mean us", "p50 us", "p99 us", "per second");
+
+   ////////////////////////////////////////////////////////////////////////////
+   // READLINE
+   // unabhängig von der Spool-Größe, nur einmal
+   BenchContext context;
+   int sockets[2];
+   pthread_t drainThread;
+
+   memset(&context, 0, sizeof(context));
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1)
+   {
+      perror("socketpair");
+      return EXIT_FAILURE;
+   }
+   context.serverSocket = sockets[0];
+   context.peerSocket = sockets[1];
+   failed |= runBenchmark("readline", 0, benchReadline, &context);
+   failed |= runBenchmark("readRequest", 0, benchRequest, &context);
+
+   // ab hier liest der Drain-Thread alles was die Handler schicken
+   if (pthread_create(&drainThread, NULL, drainPeer, &context) != 0)
+   {
+      fprintf(stderr, "Error: could not start drain thread\n");
+      return EXIT_FAILURE;
+   }
+
+   ////////////////////////////////////////////////////////////////////////////
+   // SPOOL BENCHMARKS
+   for (char *item = strtok_r(sizeList, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr))
+   {
+      long size = atol(item);
+      if (size <= 0)
+      {
+         fprintf(stderr, "Error: invalid spool size '%s'\n", item);
+         failed = 1;
+         continue;
+      }
+
+      if (prepareSpool(size, spoolDir, sizeof(spoolDir)) == -1)
+      {
+         failed = 1;
+         continue;
+      }
+
+      mailSpoolDir = spoolDir;
+      strcpy(sessionUsername, SPOOL_USER);
+      isAuthenticated = 1;
+      snprintf(context.userDir, sizeof(context.userDir), "%s/%s", spoolDir, SPOOL_USER);
+      context.spoolSize = size;
+      context.nextMessage = 0;
+
+      failed |= runBenchmark("getNextMessageNumber", size, benchNextNumber, &context);
+      failed |= runBenchmark("handleList", size, benchList, &context);
+      failed |= runBenchmark("handleRead", size, benchRead, &context);
+   }
+
+   shutdown(context.serverSocket, SHUT_RDWR);
+   pthread_join(drainThread, NULL);
+   close(context.serverSocket);
+   close(context.peerSocket);
+   fclose(output);
+
+   return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void usage(const char *program)
+{
+   fprintf(stderr,
+           "Usage: %s [-s sizes] [-d workdir] [-o output.csv] [-l label] [-t seconds]\n"
+           "  -s sizes     comma separated spool sizes (default 10,1000,100000,1000000)\n"
+           "  -d workdir   generated spools are kept here (default /tmp/twmailer-microbench)\n"
+           "  -o file      CSV results are appended to this file (default microbench.csv)\n"
+           "  -l label     value of the label column, e.g. the commit hash\n"
+           "  -t seconds   minimum run time per benchmark (default 1)\n",
+           program);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// erzeugt <workdir>/<size>/bench/1.txt ... <size>.txt im Format des Servers
+// ein fertiger Spool wird an der Datei .complete erkannt und wiederverwendet
+int prepareSpool(long size, char *spoolDir, size_t spoolDirSize)
+{
+   char userDir[512];
+   char path[600];
+   char content[256];
+   struct stat info;
+
+   snprintf(spoolDir, spoolDirSize, "%s/%ld", workDir, size);
+   snprintf(userDir, sizeof(userDir), "%s/%s", spoolDir, SPOOL_USER);
+   snprintf(path, sizeof(path), "%s/.complete", spoolDir);
+
+   if (stat(path, &info) == 0)
+   {
+      return 0;
+   }
+
+   fprintf(stderr, "Generating spool with %ld messages in %s...\n", size, spoolDir);
+   if ((mkdir(workDir, 0700) == -1 && errno != EEXIST) ||
+       (mkdir(spoolDir, 0700) == -1 && errno != EEXIST) ||
+       (mkdir(userDir, 0700) == -1 && errno != EEXIST))
+   {
+      perror("mkdir spool");
+      return -1;
+   }
+
+   for (long i = 1; i <= size; i++)
+   {
+      int length = snprintf(content, sizeof(content),
+                            "sender\n%s\nSubject of message %ld\nHello,\nthis is message %ld.\n",
+                            SPOOL_USER, i, i);
+      snprintf(path, sizeof(path), "%s/%ld.txt", userDir, i);
+
+      int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      if (fd == -1 || write(fd, content, length) != length)
+      {
+         perror("write spool message");
+         if (fd != -1)
+         {
+            close(fd);
+         }
+         return -1;
+      }
+      close(fd);
+   }
+
+   snprintf(path, sizeof(path), "%s/.complete", spoolDir);
+   int fd = open(path, O_WRONLY | O_CREAT, 0600);
+   if (fd == -1)
+   {
+      perror("create .complete");
+      return -1;
+   }
+   close(fd);
+   return 0;
+}
+
+// Client-Seite: verwirft alles was der Server schickt
+void *drainPeer(void *data)
+{
+   BenchContext *context = data;
+   char buffer[65536];
+
+   while (recv(context->peerSocket, buffer, sizeof(buffer), 0) > 0)
+      ;
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ein Aufruf = READLINE_BATCH Zeilen, die vorher in den Socket geschrieben werden
+int benchReadline(void *data)
+{
+   static char batch[READLINE_BATCH * 64];
+   BenchContext *context = data;
+   char buffer[BUF];
+
+   if (batch[0] == '\0')
+   {
+      for (int i = 0; i < READLINE_BATCH; i++)
+      {
+         memset(batch + i * 64, 'x', 63);
+         batch[i * 64 + 63] = '\n';
+      }
+   }
+
+   if (writen(context->peerSocket, batch, sizeof(batch)) == -1)
+   {
+      return -1;
+   }
+   for (int i = 0; i < READLINE_BATCH; i++)
+   {
+      if (readline(context->serverSocket, buffer, BUF - 1) != 64)
+      {
+         return -1;
+      }
+   }
+   return 0;
+}
+
+// ein Aufruf = REQUEST_BATCH gemischte Requests über den Socket, zerlegt wie
+// in clientCommunication(): Command-Zeile, Tag, Lookup, readRequest()
+int benchRequest(void *data)
+{
+   static const char *requests[] = {
+       "LOGIN\nbench\nsecret\n",
+       "SEND\nbench\nHello\nfirst line\nsecond line\n.\n",
+       "LIST\n",
+       "READ\n42\n",
+       "a1 READ\n1-500\n",
+       "DEL\n3,7,9\n",
+       "STAT\n42\n",
+       "SYNC\n1700000000 17\n",
+       "a2 SEARCH\nmeeting notes\n",
+       "QUIT\n",
+   };
+   static char batch[REQUEST_BATCH * 64];
+   static size_t batchLength = 0;
+   BenchContext *context = data;
+   ProtocolRequest request;
+   char buffer[BUF];
+   char *name;
+   int nameLength;
+
+   if (batchLength == 0)
+   {
+      int count = sizeof(requests) / sizeof(requests[0]);
+      for (int i = 0; i < REQUEST_BATCH; i++)
+      {
+         size_t length = strlen(requests[i % count]);
+         memcpy(batch + batchLength, requests[i % count], length);
+         batchLength += length;
+      }
+   }
+
+   if (writen(context->peerSocket, batch, batchLength) == -1)
+   {
+      return -1;
+   }
+   for (int i = 0; i < REQUEST_BATCH; i++)
+   {
+      int size = readline(context->serverSocket, buffer, BUF - 1);
+      if (size <= 0)
+      {
+         return -1;
+      }
+      size = protocolStripLine(buffer, size);
+      if (protocolSplitTag(buffer, size, &name, &nameLength) == -1)
+      {
+         return -1;
+      }
+      const ProtocolCommand *command = protocolLookup(name, nameLength);
+      if (command == NULL || readRequest(context->serverSocket, command, &request) == -1)
+      {
+         return -1;
+      }
+      arenaReset(&commandArena);
+   }
+   return 0;
+}
+
+int benchNextNumber(void *data)
+{
+   BenchContext *context = data;
+   return getNextMessageNumber(context->userDir) == context->spoolSize + 1 ? 0 : -1;
+}
+
+int benchList(void *data)
+{
+   BenchContext *context = data;
+   ProtocolRequest request = {protocolLookup("LIST", 4)};
+   int result = handleList(context->serverSocket, &request);
+   arenaReset(&commandArena); // wie nach jedem Command im Server
+   return result;
+}
+
+// liest die Nachrichten der Reihe nach, damit nicht immer dieselbe im Cache liegt
+int benchRead(void *data)
+{
+   BenchContext *context = data;
+   ProtocolRequest request = {protocolLookup("READ", 4)};
+   char argument[32];
+
+   context->nextMessage = context->nextMessage % context->spoolSize + 1;
+   request.argLengths[0] = snprintf(argument, sizeof(argument), "%ld", context->nextMessage);
+   request.args[0] = argument;
+   int result = handleRead(context->serverSocket, &request);
+   arenaReset(&commandArena);
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// misst function bis minSeconds vergangen sind (mindestens 3 Aufrufe)
+int runBenchmark(const char *name, long spoolSize, BenchFunction function, void *data)
+{
+   static Histogram latency;
+   struct timespec begin, start, end;
+   unsigned long iterations = 0;
+   unsigned long perCall = strcmp(name, "readline") == 0        ? READLINE_BATCH
+                           : strcmp(name, "readRequest") == 0   ? REQUEST_BATCH
+                                                                : 1;
+
+   memset(&latency, 0, sizeof(latency));
+
+   // Warmup (Page Cache, Dentry Cache)
+   if (function(data) == -1)
+   {
+      fprintf(stderr, "Error: %s failed on spool %ld\n", name, spoolSize);
+      return 1;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &begin);
+   do
+   {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (function(data) == -1)
+      {
+         fprintf(stderr, "Error: %s failed on spool %ld\n", name, spoolSize);
+         return 1;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+
+      histogramRecord(&latency, elapsedNs(&start, &end) / perCall);
+      iterations++;
+   } while (iterations < 3 || elapsedNs(&begin, &end) < minSeconds * 1e9);
+
+   double mean = (double)latency.sum / latency.total;
+   unsigned long p50 = histogramPercentile(&latency, 0.5);
+   unsigned long p99 = histogramPercentile(&latency, 0.99);
+
+   printf("%-22s %10ld %10lu %12.3f %12.3f %12.3f %12.0f\n", name, spoolSize,
+          iterations * perCall, mean / 1e3, p50 / 1e3, p99 / 1e3, 1e9 / mean);
+   fprintf(output, "%s,%s,%ld,%lu,%.0f,%lu,%lu,%lu\n", label, name, spoolSize,
+           iterations * perCall, mean, p50, p99, latency.max);
+   fflush(stdout);
+   fflush(output);
+   return 0;
+}
+
+unsigned long elapsedNs(const struct timespec *from, const struct timespec *to)
+{
+   return (to->tv_sec - from->tv_sec) * 1000000000UL + (to->tv_nsec - from->tv_nsec);
+}